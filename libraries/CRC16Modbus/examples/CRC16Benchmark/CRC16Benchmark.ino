@@ -0,0 +1,73 @@
+/*
+Compares the CRC-16/Modbus implementations on the target.
+
+Each variant checksums a Modbus sized frame (8 bytes), a PZEM reply (25 bytes)
+and a large block (256 bytes) and prints the time per byte.
+*/
+
+#include <CRC16Modbus.h>
+
+typedef uint16_t (*CrcFunction)(uint16_t crc, const uint8_t *data, size_t len);
+
+struct Variant {
+    const char *name;
+    CrcFunction fn;
+};
+
+static const Variant variants[] = {
+    {"bitwise", crc16ModbusBitwise},
+    {"table",   crc16ModbusTable},
+#if CRC16_MODBUS_SLICES >= 4
+    {"slice4",  crc16ModbusSlice4},
+#endif
+#if CRC16_MODBUS_SLICES >= 8
+    {"slice8",  crc16ModbusSlice8},
+#endif
+};
+
+static const size_t sizes[] = {8, 25, 256};
+static const uint32_t ITERATIONS = 2000;
+
+uint8_t buffer[256];
+
+void setup() {
+    Serial.begin(115200);
+    delay(1000);
+
+    for(size_t i = 0; i < sizeof(buffer); i++){
+        buffer[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    // All variants must agree before timing them
+    uint16_t expected = crc16ModbusBitwise(CRC16_MODBUS_INIT, buffer, sizeof(buffer));
+    for(const Variant &v : variants){
+        if(v.fn(CRC16_MODBUS_INIT, buffer, sizeof(buffer)) != expected){
+            Serial.print("Mismatch in ");
+            Serial.println(v.name);
+        }
+    }
+
+    for(size_t len : sizes){
+        Serial.print("Frame of ");
+        Serial.print(len);
+        Serial.println(" bytes:");
+
+        for(const Variant &v : variants){
+            volatile uint16_t sink = 0;
+            unsigned long start = micros();
+            for(uint32_t i = 0; i < ITERATIONS; i++){
+                sink ^= v.fn(CRC16_MODBUS_INIT, buffer, len);
+            }
+            unsigned long elapsed = micros() - start;
+
+            Serial.print("  ");
+            Serial.print(v.name);
+            Serial.print(": ");
+            Serial.print((float)elapsed * 1000.0 / ((float)ITERATIONS * len), 1);
+            Serial.println(" ns/byte");
+        }
+    }
+}
+
+void loop() {
+}
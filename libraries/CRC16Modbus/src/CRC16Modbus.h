@@ -0,0 +1,60 @@
+/*
+ * CRC16Modbus.h
+ *
+ * CRC-16/Modbus (poly 0xA001 reflected, init 0xFFFF) shared by the Modbus RTU
+ * master and the PZEM-004T driver.
+ *
+ * The block functions use slicing-by-N lookup tables: N bytes are folded into
+ * the CRC per step with N independent table reads instead of N dependent ones.
+ * The byte function is meant for receive paths that update the CRC as each
+ * byte comes off the UART.
+ *
+ * A frame with its CRC appended (low byte first) always checks to
+ * CRC16_MODBUS_RESIDUE, so a streaming receiver does not need to know where
+ * the data ends and the checksum starts.
+ *
+*/
+
+#ifndef CRC16MODBUS_H
+#define CRC16MODBUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CRC16_MODBUS_INIT       0xFFFF
+#define CRC16_MODBUS_RESIDUE    0x0000
+
+/* Number of slice tables kept in flash (1, 4 or 8), 512 bytes each.
+ * Defaults to 8 except on AVR where flash is scarce */
+#ifndef CRC16_MODBUS_SLICES
+ #if defined(__AVR__)
+ #define CRC16_MODBUS_SLICES 1
+ #else
+ #define CRC16_MODBUS_SLICES 8
+ #endif
+#endif
+
+#if CRC16_MODBUS_SLICES != 1 && CRC16_MODBUS_SLICES != 4 && CRC16_MODBUS_SLICES != 8
+#error "CRC16_MODBUS_SLICES must be 1, 4 or 8"
+#endif
+
+/* CRC of a whole buffer using the widest slicing available */
+uint16_t crc16Modbus(const uint8_t *data, size_t len);
+
+/* Continue a CRC with one more byte (start from CRC16_MODBUS_INIT) */
+uint16_t crc16ModbusUpdate(uint16_t crc, uint8_t byte);
+
+/* Continue a CRC with a buffer */
+uint16_t crc16ModbusUpdate(uint16_t crc, const uint8_t *data, size_t len);
+
+/* Individual implementations, kept public for benchmarking */
+uint16_t crc16ModbusBitwise(uint16_t crc, const uint8_t *data, size_t len);
+uint16_t crc16ModbusTable(uint16_t crc, const uint8_t *data, size_t len);
+#if CRC16_MODBUS_SLICES >= 4
+uint16_t crc16ModbusSlice4(uint16_t crc, const uint8_t *data, size_t len);
+#endif
+#if CRC16_MODBUS_SLICES >= 8
+uint16_t crc16ModbusSlice8(uint16_t crc, const uint8_t *data, size_t len);
+#endif
+
+#endif // CRC16MODBUS_H
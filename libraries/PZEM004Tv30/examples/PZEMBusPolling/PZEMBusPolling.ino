@@ -0,0 +1,78 @@
+/*
+Non-blocking polling of several PZEM modules on one ModBUS.
+================================================================
+
+Assign each module a unique address first (see PZEMChangeAddress).
+On startup the bus probes addresses 0x01-0x20 in the background and
+adds every module that answers. After that each meter is read in turn
+without ever blocking loop(), and the cached values are printed once
+per second.
+*/
+
+#include <PZEMBus.h>
+
+
+#if !defined(PZEM_RX_PIN) && !defined(PZEM_TX_PIN)
+#define PZEM_RX_PIN 16
+#define PZEM_TX_PIN 17
+#endif
+
+#if !defined(PZEM_SERIAL)
+#define PZEM_SERIAL Serial2
+#endif
+
+#if defined(ESP32)
+PZEMBus bus(PZEM_SERIAL, PZEM_RX_PIN, PZEM_TX_PIN);
+#else
+PZEMBus bus(PZEM_SERIAL);
+#endif
+
+bool metersAdded = false;
+unsigned long lastPrint = 0;
+
+void setup() {
+    Serial.begin(115200);
+#if !defined(ESP32)
+    PZEM_SERIAL.begin(PZEM_BAUD_RATE);
+#endif
+
+    bus.beginDiscovery(0x01, 0x20);
+}
+
+void loop() {
+    bus.loop();
+
+    // Discovery finished, start polling what was found
+    if(!metersAdded && !bus.discovering()){
+        uint8_t addrs[PZEM_BUS_MAX_METERS];
+        uint8_t n = bus.discovered(addrs, PZEM_BUS_MAX_METERS);
+        for(uint8_t i = 0; i < n; i++){
+            Serial.print("Found PZEM at 0x");
+            Serial.println(addrs[i], HEX);
+            bus.addMeter(addrs[i]);
+        }
+        metersAdded = true;
+    }
+
+    if(millis() - lastPrint < 1000)
+        return;
+    lastPrint = millis();
+
+    for(uint8_t i = 0; i < bus.meterCount(); i++){
+        PZEMValues values;
+        Serial.print("PZEM 0x");
+        Serial.print(bus.meter(i)->addr, HEX);
+
+        if(!bus.getValues(i, values)){
+            Serial.println(": no reading");
+            continue;
+        }
+
+        Serial.print(": ");
+        Serial.print(values.voltage);   Serial.print("V ");
+        Serial.print(values.current);   Serial.print("A ");
+        Serial.print(values.power);     Serial.print("W ");
+        Serial.print(values.energy, 3); Serial.print("kWh, ");
+        Serial.print(bus.valuesAge(i)); Serial.println("ms old");
+    }
+}
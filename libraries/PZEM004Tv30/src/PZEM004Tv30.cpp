@@ -21,6 +21,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 
 #include "PZEM004Tv30.h"
+#include <CRC16Modbus.h>
 #include <stdio.h>
 
 #define REG_VOLTAGE     0x0000
@@ -420,39 +421,255 @@ bool PZEM004Tv30::updateValues()
 
 
 
-    // Update the current values
-    _currentValues.voltage = ((uint32_t)response[3] << 8 | // Raw voltage in 0.1V
-                              (uint32_t)response[4])/10.0;
+    decodeValues(response);
 
-    _currentValues.current = ((uint32_t)response[5] << 8 | // Raw current in 0.001A
-                              (uint32_t)response[6] |
-                              (uint32_t)response[7] << 24 |
-                              (uint32_t)response[8] << 16) / 1000.0;
+    return true;
+}
+
+
+/*!
+ * PZEM004Tv30::decode
+ *
+ * Parse the reply to reading registers 0x00-0x09
+ *
+ * @param[in] response 25 byte, CRC checked reply
+ * @param[out] values Decoded measurements
+*/
+void PZEM004Tv30::decode(const uint8_t *response, PZEMValues &values)
+{
+    values.voltage = ((uint32_t)response[3] << 8 | // Raw voltage in 0.1V
+                      (uint32_t)response[4])/10.0;
+
+    values.current = ((uint32_t)response[5] << 8 | // Raw current in 0.001A
+                      (uint32_t)response[6] |
+                      (uint32_t)response[7] << 24 |
+                      (uint32_t)response[8] << 16) / 1000.0;
+
+    values.power =   ((uint32_t)response[9] << 8 | // Raw power in 0.1W
+                      (uint32_t)response[10] |
+                      (uint32_t)response[11] << 24 |
+                      (uint32_t)response[12] << 16) / 10.0;
+
+    values.energy =  ((uint32_t)response[13] << 8 | // Raw Energy in 1Wh
+                      (uint32_t)response[14] |
+                      (uint32_t)response[15] << 24 |
+                      (uint32_t)response[16] << 16) / 1000.0;
+
+    values.frequency=((uint32_t)response[17] << 8 | // Raw Frequency in 0.1Hz
+                      (uint32_t)response[18]) / 10.0;
+
+    values.pf =      ((uint32_t)response[19] << 8 | // Raw pf in 0.01
+                      (uint32_t)response[20])/100.0;
+
+    values.alarms =  ((uint32_t)response[21] << 8 | // Raw alarm value
+                      (uint32_t)response[22]);
+}
+
+/*!
+ * PZEM004Tv30::checkReply
+ *
+ * Check the header of a read input registers reply as its bytes arrive, so a
+ * stray frame or an exception ends the read without waiting for the timeout.
+ * Replies to the general address come from whichever meter is on the line,
+ * their address is not checked.
+ *
+ * @param[in] buf Reply bytes received so far
+ * @param[in] len Number of bytes in buf
+ * @param[in] addr Slave address the request went to
+ * @param[in] byteCount Data bytes asked for (2 per register)
+ *
+ * @return PZEM_REPLY_OK while the bytes so far fit the request
+*/
+PZEMReplyCheck PZEM004Tv30::checkReply(const uint8_t *buf, uint8_t len, uint8_t addr, uint8_t byteCount)
+{
+    if(len >= 1 && addr != PZEM_DEFAULT_ADDR && buf[0] != addr)
+        return PZEM_REPLY_BAD;
+    if(len >= 2 && buf[1] == (CMD_RIR | 0x80))
+        return PZEM_REPLY_EXCEPTION;
+    if(len >= 2 && buf[1] != CMD_RIR)
+        return PZEM_REPLY_BAD;
+    if(len >= 3 && buf[2] != byteCount)
+        return PZEM_REPLY_BAD;
+    return PZEM_REPLY_OK;
+}
+
+/*!
+ * PZEM004Tv30::isExceptionFrame
+ *
+ * checkReply() calls a reply an exception from its function code alone. Only
+ * a complete 5 byte frame whose CRC checks out really is one, anything else
+ * is noise or a stray frame.
+ *
+ * @param[in] buf Reply bytes received so far
+ * @param[in] len Number of bytes in buf
+ *
+ * @return true if buf starts with a valid exception reply
+*/
+bool PZEM004Tv30::isExceptionFrame(const uint8_t *buf, uint8_t len)
+{
+    return len >= PZEM_EXCEPTION_LEN && (buf[1] & 0x80) &&
+           crc16Modbus(buf, PZEM_EXCEPTION_LEN) == CRC16_MODBUS_RESIDUE;
+}
+
+/*!
+ * PZEM004Tv30::decodeValues
+ *
+ * Update the cached values from a complete, CRC checked reply
+ *
+ * @param[in] response 25 byte reply to reading registers 0x00-0x09
+*/
+void PZEM004Tv30::decodeValues(const uint8_t *response)
+{
+    decode(response, _currentValues);
+    _hasValues = true;
+    _valuesTime = millis();
+}
+
+
+/*!
+ * PZEM004Tv30::readAll
+ *
+ * Get every measurement from a single transaction
+ *
+ * @param[out] values Measured values
+ *
+ * @return success
+*/
+bool PZEM004Tv30::readAll(PZEMValues &values)
+{
+    if(!updateValues()) // Update vales if necessary
+        return false;
+
+    values = _currentValues;
+    return true;
+}
+
+/*!
+ * PZEM004Tv30::beginRead
+ *
+ * Send the request for all registers without waiting for the reply.
+ * Call poll() until it reports PZEM_READ_DONE or PZEM_READ_ERROR.
+ *
+ * @return false if a read is already in progress
+*/
+bool PZEM004Tv30::beginRead()
+{
+    if(_asyncState == PZEM_READ_BUSY)
+        return false;
+
+    #if defined(PZEM004_SOFTSERIAL)
+        if(_isSoft)
+            ((SoftwareSerial *)_serial)->listen(); // Start software serial listen
+    #endif
+
+    // Drop anything left over from an earlier, late reply
+    while(_serial->available() > 0)
+        _serial->read();
+
+    // Read 10 registers starting at 0x00 (no check)
+    sendCmd8(CMD_RIR, 0x00, 0x0A, false);
+
+    _asyncState = PZEM_READ_BUSY;
+    _asyncStart = millis();
+    _asyncLen = 0;
+    _asyncCrc = CRC16_MODBUS_INIT;
+    return true;
+}
+
+/*!
+ * PZEM004Tv30::poll
+ *
+ * Consume whatever reply bytes have arrived. Never blocks.
+ * DONE or ERROR is returned once when the read finishes, IDLE afterwards.
+ *
+ * @return state of the read
+*/
+PZEMReadState PZEM004Tv30::poll()
+{
+    if(_asyncState != PZEM_READ_BUSY)
+        return PZEM_READ_IDLE;
+
+    // Bytes past the buffer can only belong to a frame being waited out
+    while(_serial->available() > 0){
+        uint8_t c = (uint8_t)_serial->read();
+        _asyncLastByte = micros();
+        if(_asyncLen < sizeof(_asyncBuf)){
+            _asyncBuf[_asyncLen++] = c;
+            _asyncCrc = crc16ModbusUpdate(_asyncCrc, c);
+        }
+    }
+
+    PZEMReplyCheck check = checkReply(_asyncBuf, _asyncLen, _addr, 20);
 
-    _currentValues.power =   ((uint32_t)response[9] << 8 | // Raw power in 0.1W
-                              (uint32_t)response[10] |
-                              (uint32_t)response[11] << 24 |
-                              (uint32_t)response[12] << 16) / 10.0;
+    // A checked exception is complete at 5 bytes: it answered, just not with values
+    if(check == PZEM_REPLY_EXCEPTION && isExceptionFrame(_asyncBuf, _asyncLen)){
+        _asyncState = PZEM_READ_IDLE;
+        _isConnected = true;
+        return PZEM_READ_ERROR;
+    }
 
-    _currentValues.energy =  ((uint32_t)response[13] << 8 | // Raw Energy in 1Wh
-                              (uint32_t)response[14] |
-                              (uint32_t)response[15] << 24 |
-                              (uint32_t)response[16] << 16) / 1000.0;
+    // Anything else that is not our reply is waited out until the line is
+    // quiet, so the next request cannot collide with the rest of it.
+    // It says nothing about our meter, _isConnected stays as it was
+    if(check != PZEM_REPLY_OK){
+        if(micros() - _asyncLastByte < PZEM_SILENCE_MICROS && millis() - _asyncStart < PZEM_DRAIN_TIMEOUT)
+            return PZEM_READ_BUSY;
+        _asyncState = PZEM_READ_IDLE;
+        return PZEM_READ_ERROR;
+    }
 
-    _currentValues.frequency=((uint32_t)response[17] << 8 | // Raw Frequency in 0.1Hz
-                              (uint32_t)response[18]) / 10.0;
+    if(_asyncLen == sizeof(_asyncBuf)){
+        _asyncState = PZEM_READ_IDLE;
 
-    _currentValues.pf =      ((uint32_t)response[19] << 8 | // Raw pf in 0.01
-                              (uint32_t)response[20])/100.0;
+        // CRC over the whole frame including its checksum is zero when valid
+        if(_asyncCrc != CRC16_MODBUS_RESIDUE){
+            _isConnected = false;
+            return PZEM_READ_ERROR;
+        }
 
-    _currentValues.alarms =  ((uint32_t)response[21] << 8 | // Raw alarm value
-                              (uint32_t)response[22]);
+        _isConnected = true;
+        _lastRead = millis();
+        decodeValues(_asyncBuf);
+        return PZEM_READ_DONE;
+    }
+
+    if(millis() - _asyncStart >= READ_TIMEOUT){
+        _asyncState = PZEM_READ_IDLE;
+        _isConnected = false;
+        return PZEM_READ_ERROR;
+    }
 
-    
+    return PZEM_READ_BUSY;
+}
 
+/*!
+ * PZEM004Tv30::getValues
+ *
+ * Copy of the most recent values without touching the bus
+ *
+ * @param[out] values Measured values
+ *
+ * @return false if nothing has been received yet
+*/
+bool PZEM004Tv30::getValues(PZEMValues &values)
+{
+    if(!_hasValues)
+        return false;
+
+    values = _currentValues;
     return true;
 }
 
+/*!
+ * PZEM004Tv30::valuesAge
+ *
+ * @return ms since the cached values were received
+*/
+unsigned long PZEM004Tv30::valuesAge()
+{
+    return millis() - _valuesTime;
+}
+
 
 /*!
  * PZEM004Tv30::sendCmd8
@@ -585,48 +802,11 @@ void PZEM004Tv30::setCRC(uint8_t *buf, uint16_t len){
 }
 
 
-// Pre computed CRC table
-static const uint16_t crcTable[] PROGMEM = {
-    0X0000, 0XC0C1, 0XC181, 0X0140, 0XC301, 0X03C0, 0X0280, 0XC241,
-    0XC601, 0X06C0, 0X0780, 0XC741, 0X0500, 0XC5C1, 0XC481, 0X0440,
-    0XCC01, 0X0CC0, 0X0D80, 0XCD41, 0X0F00, 0XCFC1, 0XCE81, 0X0E40,
-    0X0A00, 0XCAC1, 0XCB81, 0X0B40, 0XC901, 0X09C0, 0X0880, 0XC841,
-    0XD801, 0X18C0, 0X1980, 0XD941, 0X1B00, 0XDBC1, 0XDA81, 0X1A40,
-    0X1E00, 0XDEC1, 0XDF81, 0X1F40, 0XDD01, 0X1DC0, 0X1C80, 0XDC41,
-    0X1400, 0XD4C1, 0XD581, 0X1540, 0XD701, 0X17C0, 0X1680, 0XD641,
-    0XD201, 0X12C0, 0X1380, 0XD341, 0X1100, 0XD1C1, 0XD081, 0X1040,
-    0XF001, 0X30C0, 0X3180, 0XF141, 0X3300, 0XF3C1, 0XF281, 0X3240,
-    0X3600, 0XF6C1, 0XF781, 0X3740, 0XF501, 0X35C0, 0X3480, 0XF441,
-    0X3C00, 0XFCC1, 0XFD81, 0X3D40, 0XFF01, 0X3FC0, 0X3E80, 0XFE41,
-    0XFA01, 0X3AC0, 0X3B80, 0XFB41, 0X3900, 0XF9C1, 0XF881, 0X3840,
-    0X2800, 0XE8C1, 0XE981, 0X2940, 0XEB01, 0X2BC0, 0X2A80, 0XEA41,
-    0XEE01, 0X2EC0, 0X2F80, 0XEF41, 0X2D00, 0XEDC1, 0XEC81, 0X2C40,
-    0XE401, 0X24C0, 0X2580, 0XE541, 0X2700, 0XE7C1, 0XE681, 0X2640,
-    0X2200, 0XE2C1, 0XE381, 0X2340, 0XE101, 0X21C0, 0X2080, 0XE041,
-    0XA001, 0X60C0, 0X6180, 0XA141, 0X6300, 0XA3C1, 0XA281, 0X6240,
-    0X6600, 0XA6C1, 0XA781, 0X6740, 0XA501, 0X65C0, 0X6480, 0XA441,
-    0X6C00, 0XACC1, 0XAD81, 0X6D40, 0XAF01, 0X6FC0, 0X6E80, 0XAE41,
-    0XAA01, 0X6AC0, 0X6B80, 0XAB41, 0X6900, 0XA9C1, 0XA881, 0X6840,
-    0X7800, 0XB8C1, 0XB981, 0X7940, 0XBB01, 0X7BC0, 0X7A80, 0XBA41,
-    0XBE01, 0X7EC0, 0X7F80, 0XBF41, 0X7D00, 0XBDC1, 0XBC81, 0X7C40,
-    0XB401, 0X74C0, 0X7580, 0XB541, 0X7700, 0XB7C1, 0XB681, 0X7640,
-    0X7200, 0XB2C1, 0XB381, 0X7340, 0XB101, 0X71C0, 0X7080, 0XB041,
-    0X5000, 0X90C1, 0X9181, 0X5140, 0X9301, 0X53C0, 0X5280, 0X9241,
-    0X9601, 0X56C0, 0X5780, 0X9741, 0X5500, 0X95C1, 0X9481, 0X5440,
-    0X9C01, 0X5CC0, 0X5D80, 0X9D41, 0X5F00, 0X9FC1, 0X9E81, 0X5E40,
-    0X5A00, 0X9AC1, 0X9B81, 0X5B40, 0X9901, 0X59C0, 0X5880, 0X9841,
-    0X8801, 0X48C0, 0X4980, 0X8941, 0X4B00, 0X8BC1, 0X8A81, 0X4A40,
-    0X4E00, 0X8EC1, 0X8F81, 0X4F40, 0X8D01, 0X4DC0, 0X4C80, 0X8C41,
-    0X4400, 0X84C1, 0X8581, 0X4540, 0X8701, 0X47C0, 0X4680, 0X8641,
-    0X8201, 0X42C0, 0X4380, 0X8341, 0X4100, 0X81C1, 0X8081, 0X4040
-};
-
-
 /*!
  * PZEM004Tv30::CRC16
  *
  * Calculate the CRC16-Modbus for a buffer
- * Based on https://www.modbustools.com/modbus_crc16.html
+ * Uses the shared slice-by-N implementation from CRC16Modbus
  *
  * @param[in] data Memory buffer containing the data to checksum
  * @param[in] len  Length of the respBuffer
@@ -635,16 +815,7 @@ static const uint16_t crcTable[] PROGMEM = {
 */
 uint16_t PZEM004Tv30::CRC16(const uint8_t *data, uint16_t len)
 {
-    uint8_t nTemp; // CRC table index
-    uint16_t crc = 0xFFFF; // Default value
-
-    while (len--)
-    {
-        nTemp = *data++ ^ crc;
-        crc >>= 8;
-        crc ^= (uint16_t)pgm_read_word(&crcTable[nTemp]);
-    }
-    return crc;
+    return crc16Modbus(data, len);
 }
 
 /*!
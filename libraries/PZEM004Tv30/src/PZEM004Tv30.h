@@ -61,6 +61,42 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define PZEM_DEFAULT_ADDR   0xF8
 #define PZEM_BAUD_RATE      9600
 
+/* Modbus T3.5 inter-frame gap at PZEM_BAUD_RATE: 3.5 characters of 11 bits */
+#define PZEM_SILENCE_MICROS (3500UL * 11 * 1000 / PZEM_BAUD_RATE)
+
+/* Exception reply: address + function | 0x80 + exception code + 2 CRC */
+#define PZEM_EXCEPTION_LEN  5
+
+/* Longest an unusable reply is waited out before the bus is used again
+ * (a 25 byte frame takes ~29ms), a line that never goes quiet is given up on */
+#define PZEM_DRAIN_TIMEOUT  100
+
+
+/* All measurements from one register read */
+struct PZEMValues {
+    float voltage;   // V
+    float current;   // A
+    float power;     // W
+    float energy;    // kWh
+    float frequency; // Hz
+    float pf;
+    uint16_t alarms;
+};
+
+/* State of an asynchronous read started with beginRead() */
+enum PZEMReadState {
+    PZEM_READ_IDLE,    // No read in progress
+    PZEM_READ_BUSY,    // Waiting for the reply
+    PZEM_READ_DONE,    // Reply received, values updated (reported once, then IDLE)
+    PZEM_READ_ERROR    // Timeout, bad CRC, wrong frame or exception (reported once, then IDLE)
+};
+
+/* What the first bytes of a read reply say about it */
+enum PZEMReplyCheck {
+    PZEM_REPLY_OK,         // Consistent with the request so far
+    PZEM_REPLY_BAD,        // Wrong slave address, function code or byte count
+    PZEM_REPLY_EXCEPTION   // Modbus exception reply (function | 0x80), CRC not checked yet
+};
 
 class PZEM004Tv30
 {
@@ -104,6 +140,17 @@ public:
     float frequency();
     float pf();
 
+    bool readAll(PZEMValues &values); // All values from one transaction (blocking)
+
+    bool beginRead();                 // Send the read request and return immediately
+    PZEMReadState poll();             // Collect reply bytes, never blocks
+    bool getValues(PZEMValues &values); // Last values received, false if none yet
+    unsigned long valuesAge();        // ms since the last values were received
+
+    static void decode(const uint8_t *response, PZEMValues &values); // Parse a 25 byte register reply
+    static PZEMReplyCheck checkReply(const uint8_t *buf, uint8_t len, uint8_t addr, uint8_t byteCount); // Header of a partial read reply
+    static bool isExceptionFrame(const uint8_t *buf, uint8_t len); // Complete exception reply with a good CRC
+
 
     bool setAddress(uint8_t addr);
     uint8_t getAddress();
@@ -131,23 +178,26 @@ private:
 
     bool _isConnected; // Flag set on successful communication
 
-    struct {
-        float voltage;
-        float current;
-        float power;
-        float energy;
-        float frequency;
-        float pf;
-        uint16_t alarms;
-    }  _currentValues; // Measured values
+    PZEMValues _currentValues; // Measured values
 
     uint64_t _lastRead; // Last time values were updated
 
+    // Asynchronous read (beginRead/poll)
+    PZEMReadState _asyncState = PZEM_READ_IDLE;
+    unsigned long _asyncStart = 0;   // millis() when the request was sent
+    uint8_t _asyncBuf[25];           // Reply being received
+    uint8_t _asyncLen = 0;           // Bytes received so far
+    uint16_t _asyncCrc = 0;          // CRC of the bytes received so far
+    unsigned long _asyncLastByte = 0; // micros() of the last byte received
+    bool _hasValues = false;         // _currentValues holds a real reading
+    unsigned long _valuesTime = 0;   // millis() when _currentValues was filled
+
 
 
     void init(Stream* port, bool isSoft, uint8_t addr); // Init common to all constructors
 
     bool updateValues();    // Get most up to date values from device registers and cache them
+    void decodeValues(const uint8_t *response); // Fill _currentValues from a 25 byte reply
     uint16_t receive(uint8_t *resp, uint16_t len); // Receive len bytes into a buffer
 
     bool sendCmd8(uint8_t cmd, uint16_t rAddr, uint16_t val, bool check=false, uint16_t slave_addr=0xFFFF); // Send 8 byte command
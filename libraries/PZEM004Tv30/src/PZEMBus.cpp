@@ -0,0 +1,319 @@
+/*
+ * PZEMBus.cpp
+ *
+ * Scheduling: each meter has a due time. When the bus is free the most overdue
+ * meter is read next, so N meters share the bandwidth evenly and a silent meter
+ * only costs its own timeout.
+ *
+*/
+
+#include "PZEMBus.h"
+#include <CRC16Modbus.h>
+
+#define CMD_RIR         0X04
+
+#if defined(ESP32)
+/*!
+ * PZEMBus::PZEMBus
+ *
+ * Hardware serial constructor
+ *
+ * @param port Hardware serial to use
+ * @param receivePin receive Pin to use
+ * @param transmitPin transmit Pin to use
+*/
+PZEMBus::PZEMBus(HardwareSerial& port, uint8_t receivePin, uint8_t transmitPin)
+{
+    port.begin(PZEM_BAUD_RATE, SERIAL_8N1, receivePin, transmitPin);
+    _serial = &port;
+}
+#endif
+
+/*!
+ * PZEMBus::PZEMBus
+ *
+ * Stream constructor, the port must already be begun
+ *
+ * @param port Stream instance
+*/
+PZEMBus::PZEMBus(Stream& port)
+{
+    _serial = &port;
+}
+
+/*!
+ * PZEMBus::addMeter
+ *
+ * Add a meter to the polling schedule
+ *
+ * @param[in] addr Slave address of the meter 0x01-0xF8
+ *
+ * @return meter index, -1 if the bus is full or the address is invalid
+*/
+int PZEMBus::addMeter(uint8_t addr)
+{
+    if(_meterCount >= PZEM_BUS_MAX_METERS || addr < 0x01 || addr > PZEM_DEFAULT_ADDR)
+        return -1;
+
+    PZEMMeter &m = _meters[_meterCount];
+    m.addr = addr;
+    m.valid = false;
+    m.updated = 0;
+    m.nextDue = millis(); // Read right away
+    m.reads = 0;
+    m.errors = 0;
+    m.exceptions = 0;
+    return _meterCount++;
+}
+
+uint8_t PZEMBus::meterCount()
+{
+    return _meterCount;
+}
+
+const PZEMMeter* PZEMBus::meter(uint8_t index)
+{
+    if(index >= _meterCount)
+        return nullptr;
+    return &_meters[index];
+}
+
+/*!
+ * PZEMBus::getValues
+ *
+ * Last reading of a meter, never touches the bus
+ *
+ * @param[in] index Meter index from addMeter()
+ * @param[out] values Measured values
+ *
+ * @return false if the meter has not answered yet
+*/
+bool PZEMBus::getValues(uint8_t index, PZEMValues &values)
+{
+    if(index >= _meterCount || !_meters[index].valid)
+        return false;
+
+    values = _meters[index].values;
+    return true;
+}
+
+/*!
+ * PZEMBus::valuesAge
+ *
+ * @return ms since the meter last answered
+*/
+unsigned long PZEMBus::valuesAge(uint8_t index)
+{
+    if(index >= _meterCount)
+        return (unsigned long)-1;
+    return millis() - _meters[index].updated;
+}
+
+/*!
+ * PZEMBus::setInterval
+ *
+ * With the default of 0 meters are read back to back as fast as the bus allows
+ *
+ * @param[in] ms Minimum time between two reads of the same meter
+*/
+void PZEMBus::setInterval(unsigned long ms)
+{
+    _interval = ms;
+}
+
+/*!
+ * PZEMBus::beginDiscovery
+ *
+ * Probe each address in [first, last] with a one register read and a short
+ * timeout. Runs from loop() in place of normal polling.
+ *
+ * @param[in] first First address to probe
+ * @param[in] last Last address to probe
+ * @param[in] timeout ms to wait for each probe reply
+*/
+void PZEMBus::beginDiscovery(uint8_t first, uint8_t last, uint16_t timeout)
+{
+    if(first < 0x01)
+        first = 0x01;
+    if(last > 0xF7)
+        last = 0xF7;
+
+    _discovering = first <= last;
+    _probeAddr = first;
+    _probeLast = last;
+    _probeTimeout = timeout;
+    _foundCount = 0;
+}
+
+bool PZEMBus::discovering()
+{
+    return _discovering;
+}
+
+/*!
+ * PZEMBus::discovered
+ *
+ * @param[out] addrs Buffer for the addresses that answered
+ * @param[in] max Size of the buffer
+ *
+ * @return number of addresses written
+*/
+uint8_t PZEMBus::discovered(uint8_t *addrs, uint8_t max)
+{
+    uint8_t n = _foundCount < max ? _foundCount : max;
+    for(uint8_t i = 0; i < n; i++)
+        addrs[i] = _found[i];
+    return n;
+}
+
+/*!
+ * PZEMBus::send
+ *
+ * Send a read input registers request starting at 0x0000
+*/
+void PZEMBus::send(uint8_t addr, uint16_t count, uint8_t expected, uint16_t timeout)
+{
+    uint8_t frame[8];
+
+    frame[0] = addr;
+    frame[1] = CMD_RIR;
+    frame[2] = 0x00;
+    frame[3] = 0x00;
+    frame[4] = (count >> 8) & 0xFF;
+    frame[5] = count & 0xFF;
+
+    uint16_t crc = crc16Modbus(frame, 6);
+    frame[6] = crc & 0xFF; // Low byte first
+    frame[7] = (crc >> 8) & 0xFF;
+
+    // Drop anything left over from an earlier, late reply
+    while(_serial->available() > 0)
+        _serial->read();
+
+    _serial->write(frame, 8);
+
+    _start = millis();
+    _timeout = timeout;
+    _len = 0;
+    _expected = expected;
+    _wireAddr = addr;
+    _byteCount = count * 2;
+    _crc = CRC16_MODBUS_INIT;
+}
+
+/*!
+ * PZEMBus::nextDueMeter
+ *
+ * @return index of the most overdue meter, -1 if none is due
+*/
+int PZEMBus::nextDueMeter(unsigned long now)
+{
+    int best = -1;
+    long bestLate = 0;
+
+    for(uint8_t i = 0; i < _meterCount; i++){
+        long late = (long)(now - _meters[i].nextDue);
+        if(late >= 0 && (best < 0 || late > bestLate)){
+            best = i;
+            bestLate = late;
+        }
+    }
+    return best;
+}
+
+/*!
+ * PZEMBus::finish
+ *
+ * Record the outcome of the transaction on the wire
+ *
+ * @param[in] ok A valid reply was received
+ * @param[in] exception The slave answered with a Modbus exception
+*/
+void PZEMBus::finish(bool ok, bool exception)
+{
+    unsigned long now = millis();
+
+    if(_state == BUS_READING){
+        PZEMMeter &m = _meters[_current];
+        if(ok){
+            PZEM004Tv30::decode(_buf, m.values);
+            m.valid = true;
+            m.updated = now;
+            m.reads++;
+        } else {
+            m.errors++;
+            if(exception)
+                m.exceptions++;
+        }
+        m.nextDue = now + _interval;
+    } else if(_state == BUS_PROBING){
+        // A (CRC checked) exception still means something answered at this address
+        if((ok || exception) && _foundCount < PZEM_BUS_MAX_METERS)
+            _found[_foundCount++] = _buf[0];
+
+        if(_probeAddr >= _probeLast)
+            _discovering = false;
+        else
+            _probeAddr++;
+    }
+
+    _state = BUS_IDLE;
+}
+
+/*!
+ * PZEMBus::loop
+ *
+ * Collect reply bytes and start the next request. Never blocks.
+*/
+void PZEMBus::loop()
+{
+    if(_state != BUS_IDLE){
+        // Bytes past the reply can only belong to a frame being waited out
+        while(_serial->available() > 0){
+            uint8_t c = (uint8_t)_serial->read();
+            _lastByte = micros();
+            if(_len < _expected){
+                _buf[_len++] = c;
+                _crc = crc16ModbusUpdate(_crc, c);
+            }
+        }
+
+        // An exception ends the transaction as soon as its 5 bytes are in and
+        // checked. A stray or garbled frame is waited out until the line has
+        // been quiet for T3.5, the next request would collide with its tail
+        PZEMReplyCheck check = PZEM004Tv30::checkReply(_buf, _len, _wireAddr, _byteCount);
+        bool quiet = micros() - _lastByte >= PZEM_SILENCE_MICROS;
+
+        if(check == PZEM_REPLY_EXCEPTION && PZEM004Tv30::isExceptionFrame(_buf, _len)){
+            finish(false, true);
+        } else if(check != PZEM_REPLY_OK){
+            if(!quiet && millis() - _start < PZEM_DRAIN_TIMEOUT)
+                return;
+            finish(false);
+        } else if(_len == _expected){
+            // CRC over the whole frame including its checksum is zero when valid
+            finish(_crc == CRC16_MODBUS_RESIDUE);
+        } else if(millis() - _start >= _timeout){
+            finish(false);
+        } else {
+            return;
+        }
+    }
+
+    // The bus is free, start the next request right away
+    if(_discovering){
+        // One register: address + function + byte count + 2 data + 2 CRC
+        send(_probeAddr, 0x01, 7, _probeTimeout);
+        _state = BUS_PROBING;
+        return;
+    }
+
+    int next = nextDueMeter(millis());
+    if(next < 0)
+        return;
+
+    // Read 10 registers starting at 0x00
+    _current = next;
+    send(_meters[next].addr, 0x0A, 25, PZEM_BUS_READ_TIMEOUT);
+    _state = BUS_READING;
+}
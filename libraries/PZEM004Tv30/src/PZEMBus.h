@@ -0,0 +1,106 @@
+/*
+ * PZEMBus.h
+ *
+ * Non-blocking poller for several PZEM-004T v3.0 modules sharing one UART.
+ *
+ * Every meter is addressed individually (see PZEMChangeAddress). The bus keeps
+ * exactly one request on the wire, starts the next one as soon as the previous
+ * reply is complete, and caches the last reading of each meter with its
+ * timestamp. loop() never waits on the UART.
+ *
+*/
+
+#ifndef PZEMBUS_H
+#define PZEMBUS_H
+
+#include "PZEM004Tv30.h"
+
+/* Meters one bus can hold */
+#ifndef PZEM_BUS_MAX_METERS
+#define PZEM_BUS_MAX_METERS 16
+#endif
+
+/* How long a meter has to start answering a read */
+#define PZEM_BUS_READ_TIMEOUT       100
+
+/* How long to wait for a probe reply during discovery
+ * A 7 byte reply takes ~8ms at 9600 baud, the modules answer well within this */
+#define PZEM_BUS_DISCOVERY_TIMEOUT  30
+
+/* Last reading of one meter */
+struct PZEMMeter {
+    uint8_t addr;
+    PZEMValues values;
+    bool valid;              // values holds a real reading
+    unsigned long updated;   // millis() of the last good reading
+    unsigned long nextDue;   // millis() of the next scheduled read
+    uint32_t reads;          // Good replies
+    uint32_t errors;         // Timeouts, CRC errors, wrong frames and exceptions
+    uint32_t exceptions;     // Of which Modbus exception replies
+};
+
+class PZEMBus
+{
+public:
+#if defined(ESP32)
+    /* ESP32 Hardware serial interface requires the receive and transmit pin specified */
+    PZEMBus(HardwareSerial& port, uint8_t receivePin, uint8_t transmitPin);
+#endif
+    /* The port must already be begun at PZEM_BAUD_RATE */
+    PZEMBus(Stream& port);
+
+    int addMeter(uint8_t addr);          // Returns the meter index or -1
+    uint8_t meterCount();
+    const PZEMMeter* meter(uint8_t index);
+
+    bool getValues(uint8_t index, PZEMValues &values); // false if no valid reading yet
+    unsigned long valuesAge(uint8_t index);            // ms since the last good reading
+
+    void setInterval(unsigned long ms);  // Minimum time between two reads of the same meter
+
+    void loop();                          // Advance the bus, call every loop()
+
+    void beginDiscovery(uint8_t first = 0x01, uint8_t last = 0xF7,
+                        uint16_t timeout = PZEM_BUS_DISCOVERY_TIMEOUT); // Probe a range of addresses in the background
+    bool discovering();
+    uint8_t discovered(uint8_t *addrs, uint8_t max); // Addresses that answered during the last discovery
+
+private:
+    enum State {
+        BUS_IDLE,
+        BUS_READING,     // Waiting for a 25 byte reply
+        BUS_PROBING      // Waiting for a 7 byte discovery reply
+    };
+
+    Stream* _serial;
+
+    PZEMMeter _meters[PZEM_BUS_MAX_METERS];
+    uint8_t _meterCount = 0;
+    unsigned long _interval = 0;
+
+    State _state = BUS_IDLE;
+    uint8_t _current = 0;            // Meter being read
+    unsigned long _start = 0;        // millis() when the request was sent
+    uint16_t _timeout = 0;           // Timeout of the request on the wire
+    uint8_t _buf[25];
+    uint8_t _len = 0;
+    uint8_t _expected = 0;
+    uint8_t _wireAddr = 0;           // Slave address of the request on the wire
+    uint8_t _byteCount = 0;          // Data bytes it asked for
+    uint16_t _crc = 0;
+    unsigned long _lastByte = 0;     // micros() of the last byte received
+
+    // Discovery
+    bool _discovering = false;
+    uint8_t _probeAddr = 0;
+    uint8_t _probeLast = 0;
+    uint16_t _probeTimeout = 0;
+    uint8_t _found[PZEM_BUS_MAX_METERS];
+    uint8_t _foundCount = 0;
+
+    void send(uint8_t addr, uint16_t count, uint8_t expected, uint16_t timeout);
+    int nextDueMeter(unsigned long now);
+    void finish(bool ok, bool exception = false);
+};
+
+#endif // PZEMBUS_H
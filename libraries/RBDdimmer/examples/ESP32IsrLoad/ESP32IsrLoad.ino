@@ -0,0 +1,69 @@
+/**************
+ *  RobotDyn
+ *  Dimmer Library
+ *  **************
+ *  ESP32 only: measures how much CPU time the dimmer interrupts take.
+ *
+ *  Build it twice and compare the output:
+ *    default backend       - timer interrupt every ~94 us polling every dimmer
+ *    event driven backend  - add -DRBDDIMMER_ESP32_EVENT_DRIVEN to the build flags
+ *                            (the platformio.ini next to this sketch has both envs)
+ *
+ *  Every second it prints the interrupts per second and the share of one core
+ *  spent inside them, for DIMMERS lamps at different power levels.
+ */
+
+#include <RBDdimmer.h>
+
+#define USE_SERIAL  Serial
+#define zerocross  14 // Zero-cross input pin
+#define DIMMERS    4
+
+const int outputPins[DIMMERS] = {13, 12, 27, 26};
+const int powers[DIMMERS] = {20, 45, 70, 95};
+
+dimmerLamp dimmer0(outputPins[0], zerocross);
+dimmerLamp dimmer1(outputPins[1], zerocross);
+dimmerLamp dimmer2(outputPins[2], zerocross);
+dimmerLamp dimmer3(outputPins[3], zerocross);
+dimmerLamp *dimmers[DIMMERS] = {&dimmer0, &dimmer1, &dimmer2, &dimmer3};
+
+unsigned long lastReport = 0;
+
+void setup() {
+  USE_SERIAL.begin(115200);
+#if defined(RBDDIMMER_ESP32_EVENT_DRIVEN)
+  USE_SERIAL.println("--- Dimmer ISR load: event driven backend ---");
+#else
+  USE_SERIAL.println("--- Dimmer ISR load: default backend ---");
+#endif
+
+  for (int i = 0; i < DIMMERS; i++) {
+    dimmers[i]->begin(NORMAL_MODE, ON);
+    dimmers[i]->setPower(powers[i]);
+  }
+
+  resetDimmerIsrStats();
+  lastReport = micros();
+}
+
+void loop() {
+  if (micros() - lastReport < 1000000) return;
+
+  DIMMER_ISR_STATS_typedef stats;
+  getDimmerIsrStats(&stats);
+  resetDimmerIsrStats();
+  unsigned long now = micros();
+  float seconds = (now - lastReport) / 1000000.0;
+  lastReport = now;
+
+  USE_SERIAL.print("zero-cross/s: ");
+  USE_SERIAL.print(stats.zeroCrossInterrupts / seconds, 0);
+  USE_SERIAL.print("  timer irq/s: ");
+  USE_SERIAL.print(stats.timerInterrupts / seconds, 0);
+  USE_SERIAL.print("  isr us/s: ");
+  USE_SERIAL.print(stats.busyMicros / seconds, 0);
+  USE_SERIAL.print("  cpu: ");
+  USE_SERIAL.print(stats.busyMicros / seconds / 10000.0, 2);
+  USE_SERIAL.println(" %");
+}
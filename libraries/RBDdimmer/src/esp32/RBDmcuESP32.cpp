@@ -1,4 +1,4 @@
-#if defined(ARDUINO_ARCH_ESP32)
+#if defined(ARDUINO_ARCH_ESP32) && !defined(RBDDIMMER_ESP32_EVENT_DRIVEN)
 
 #include "RBDmcuESP32.h"
 
@@ -25,6 +25,8 @@ volatile uint16_t togMax[ALL_DIMMERS];
 volatile uint16_t togMin[ALL_DIMMERS];
 volatile bool togDir[ALL_DIMMERS];
 
+static volatile DIMMER_ISR_STATS_typedef isrStats;
+
 dimmerLamp::dimmerLamp(int user_dimmer_pin, int zc_dimmer_pin):
 	dimmer_pin(user_dimmer_pin),
 	zc_pin(zc_dimmer_pin)
@@ -154,17 +156,20 @@ void dimmerLamp::toggleSettings(int minValue, int maxValue)
  
 void IRAM_ATTR isr_ext()
 {
+	unsigned long start = micros();
 	for (int i = 0; i < current_dim; i++ ) 
 		if (dimState[i] == ON) 
 		{
 			zeroCross[i] = 1;
 		}
+	isrStats.zeroCrossInterrupts++;
+	isrStats.busyMicros += micros() - start;
 }
 
 static int k;
 void IRAM_ATTR onTimerISR()
 {	
-	
+	unsigned long start = micros();
 	toggleCounter++;
 	for (k = 0; k < current_dim; k++)
 	{
@@ -211,7 +216,22 @@ void IRAM_ATTR onTimerISR()
 		}
 	}
 	if (toggleCounter >= toggleReload) toggleCounter = 1;
-	
+	isrStats.timerInterrupts++;
+	isrStats.busyMicros += micros() - start;
+}
+
+void getDimmerIsrStats(DIMMER_ISR_STATS_typedef *stats)
+{
+	stats->zeroCrossInterrupts = isrStats.zeroCrossInterrupts;
+	stats->timerInterrupts = isrStats.timerInterrupts;
+	stats->busyMicros = isrStats.busyMicros;
+}
+
+void resetDimmerIsrStats(void)
+{
+	isrStats.zeroCrossInterrupts = 0;
+	isrStats.timerInterrupts = 0;
+	isrStats.busyMicros = 0;
 }
 
 #endif
\ No newline at end of file
@@ -32,4 +32,20 @@ static const uint8_t powerBuf[] = {
 void IRAM_ATTR isr_ext();
 void IRAM_ATTR onTimerISR();
 
+/*
+ * Interrupt load counters, kept by both ESP32 backends:
+ *   default                      - timer fires every 30 ticks (~94 us) and polls every dimmer
+ *   RBDDIMMER_ESP32_EVENT_DRIVEN - one-shot alarms only at the fire/release instants
+ * Define RBDDIMMER_ESP32_EVENT_DRIVEN in the build flags to select the second one.
+ */
+typedef struct
+{
+    uint32_t zeroCrossInterrupts;
+    uint32_t timerInterrupts;
+    uint32_t busyMicros;    // Time spent inside both ISRs
+} DIMMER_ISR_STATS_typedef;
+
+void getDimmerIsrStats(DIMMER_ISR_STATS_typedef *stats);
+void resetDimmerIsrStats(void);
+
 #endif
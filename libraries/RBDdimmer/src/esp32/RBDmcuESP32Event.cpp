@@ -0,0 +1,289 @@
+#if defined(ARDUINO_ARCH_ESP32) && defined(RBDDIMMER_ESP32_EVENT_DRIVEN)
+
+#include "RBDmcuESP32.h"
+
+/*
+ * Event driven ESP32 backend (build with -DRBDDIMMER_ESP32_EVENT_DRIVEN)
+ *
+ * The default backend wakes up every ~94 us and polls every dimmer. Here the
+ * zero-cross interrupt works out when each gate has to go HIGH and LOW in this
+ * half-cycle, sorts those instants, and one-shot timer alarms fire only at
+ * them. Interrupt load no longer depends on the timer rate, only on the
+ * number of lamps that are ON. Timing matches the default backend: one power
+ * step is 30 ticks of its 320 kHz timer (93.75 us), pulses are pulseWidth steps.
+ */
+
+#define STEP_CENTIMICROS 9375     // One dimming step in 1/100 us
+#define MERGE_MICROS 3            // Events this close are handled in one interrupt
+#define MIN_HALF_CYCLE_MICROS 5000 // Zero-cross edges closer than this are bounces
+
+int pulseWidth = 1;
+volatile int current_dim = 0;
+int all_dim = 3;
+int rise_fall = true;
+char user_zero_cross = '0';
+
+static int toggleReload = 25;
+
+static dimmerLamp* dimmer[ALL_DIMMERS];
+volatile uint16_t dimPower[ALL_DIMMERS];
+volatile uint16_t dimOutPin[ALL_DIMMERS];
+volatile uint16_t dimZCPin[ALL_DIMMERS];
+volatile DIMMER_MODE_typedef dimMode[ALL_DIMMERS];
+volatile ON_OFF_typedef dimState[ALL_DIMMERS];
+static uint16_t dimPulseBegin[ALL_DIMMERS];
+volatile uint16_t togMax[ALL_DIMMERS];
+volatile uint16_t togMin[ALL_DIMMERS];
+volatile bool togDir[ALL_DIMMERS];
+volatile bool gateHigh[ALL_DIMMERS];
+
+typedef struct
+{
+	uint16_t time;	// Microseconds after the zero-cross
+	uint8_t dim;	// Index into the dimmer arrays
+	bool on;		// HIGH (fire) or LOW (release)
+} DIMMER_EVENT_typedef;
+
+static DIMMER_EVENT_typedef events[2 * ALL_DIMMERS];
+static volatile uint8_t eventCount = 0;
+static volatile uint8_t nextEvent = 0;
+static volatile unsigned long lastZeroCross = 0;
+static unsigned long toggleMicros = 0;
+
+static hw_timer_t * timer = NULL;
+static volatile DIMMER_ISR_STATS_typedef isrStats;
+
+dimmerLamp::dimmerLamp(int user_dimmer_pin, int zc_dimmer_pin):
+	dimmer_pin(user_dimmer_pin),
+	zc_pin(zc_dimmer_pin)
+{
+	current_dim++;
+	dimmer[current_dim-1] = this;
+	current_num = current_dim-1;
+	toggle_state = false;
+	
+	dimPulseBegin[current_dim-1] = 1;
+	dimOutPin[current_dim-1] = user_dimmer_pin;
+	dimZCPin[current_dim-1] = zc_dimmer_pin;
+	dimMode[current_dim-1] = NORMAL_MODE;
+	togMin[current_dim-1] = 0;
+	togMax[current_dim-1] = 1;
+	gateHigh[current_dim-1] = false;
+	pinMode(user_dimmer_pin, OUTPUT);
+}
+
+void dimmerLamp::timer_init(void)
+{
+	// One timer for all dimmers, counting microseconds since the last zero-cross
+	if (timer != NULL) return;
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+	timer = timerBegin(1000000);
+	timerAttachInterrupt(timer, &onTimerISR);
+#else
+	timer = timerBegin(0, 80, true);
+	timerAttachInterrupt(timer, &onTimerISR, true);
+#endif
+}
+
+void dimmerLamp::ext_int_init(void) 
+{
+	int inPin = dimZCPin[this->current_num];
+	pinMode(inPin, INPUT_PULLUP);
+    attachInterrupt(inPin, isr_ext, RISING);
+}
+
+void dimmerLamp::begin(DIMMER_MODE_typedef DIMMER_MODE, ON_OFF_typedef ON_OFF)
+{
+	dimMode[this->current_num] = DIMMER_MODE;
+	dimState[this->current_num] = ON_OFF;
+	timer_init();
+	ext_int_init();	
+}
+
+void dimmerLamp::setPower(int power)
+{	
+	if (power >= 99) 
+	{
+		power = 99;
+	}
+	dimPower[this->current_num] = power;
+	dimPulseBegin[this->current_num] = powerBuf[power];
+	
+	delay(1);
+}
+
+int dimmerLamp::getPower(void)
+{
+	if (dimState[this->current_num] == ON)
+		return dimPower[this->current_num];
+	else return 0;
+}
+
+void dimmerLamp::setState(ON_OFF_typedef ON_OFF)
+{
+	dimState[this->current_num] = ON_OFF;
+}
+
+bool dimmerLamp::getState(void)
+{
+	bool ret;
+	if (dimState[this->current_num] == ON) ret = true;
+	else ret = false;
+	return ret;
+}
+
+void dimmerLamp::changeState(void)
+{
+	if (dimState[this->current_num] == ON) dimState[this->current_num] = OFF;
+	else 
+		dimState[this->current_num] = ON;
+}
+
+DIMMER_MODE_typedef dimmerLamp::getMode(void)
+{
+	return dimMode[this->current_num];
+}
+
+void dimmerLamp::setMode(DIMMER_MODE_typedef DIMMER_MODE)
+{
+	dimMode[this->current_num] = DIMMER_MODE;
+}
+
+void dimmerLamp::toggleSettings(int minValue, int maxValue)
+{
+	if (maxValue > 99) 
+	{
+    	maxValue = 99;
+	}
+	if (minValue < 1) 
+	{
+    	minValue = 1;
+	}
+	dimMode[this->current_num] = TOGGLE_MODE;
+	togMin[this->current_num] = powerBuf[maxValue];
+	togMax[this->current_num] = powerBuf[minValue];
+
+	toggleReload = 50;
+}
+
+static void IRAM_ATTR armAlarm(uint64_t micros)
+{
+#if defined(ESP_ARDUINO_VERSION_MAJOR) && ESP_ARDUINO_VERSION_MAJOR >= 3
+	timerAlarm(timer, micros, false, 0);
+#else
+	timerAlarmWrite(timer, micros, false);
+	timerAlarmEnable(timer);
+#endif
+}
+
+// Insert into the event list, kept sorted by time
+static void IRAM_ATTR addEvent(uint8_t count, uint16_t time, uint8_t dim, bool on)
+{
+	int j = count;
+	while (j > 0 && events[j - 1].time > time)
+	{
+		events[j] = events[j - 1];
+		j--;
+	}
+	events[j].time = time;
+	events[j].dim = dim;
+	events[j].on = on;
+}
+
+void IRAM_ATTR isr_ext()
+{
+	unsigned long start = micros();
+	unsigned long since = start - lastZeroCross;
+	isrStats.zeroCrossInterrupts++;
+
+	if (since < MIN_HALF_CYCLE_MICROS)
+	{
+		isrStats.busyMicros += micros() - start;
+		return;
+	}
+	lastZeroCross = start;
+
+	/*****
+	 * TOGGLE DIMMING MODE
+	 * The default backend moves one step every toggleReload timer ticks,
+	 * take as many steps as fit in the time since the last zero-cross
+	 *****/
+	uint32_t toggleStep = (uint32_t)toggleReload * STEP_CENTIMICROS / 100;
+	toggleMicros += since < 100000 ? since : 100000;
+	int steps = toggleMicros / toggleStep;
+	toggleMicros -= steps * toggleStep;
+
+	uint8_t count = 0;
+	for (int k = 0; k < current_dim; k++)
+	{
+		// A gate left HIGH by a bounce must not stay on into this half-cycle
+		if (gateHigh[k])
+		{
+			digitalWrite(dimOutPin[k], LOW);
+			gateHigh[k] = false;
+		}
+
+		if (dimState[k] != ON) continue;
+
+		if (dimMode[k] == TOGGLE_MODE)
+		{
+			for (int s = 0; s < steps; s++)
+			{
+				if (dimPulseBegin[k] >= togMax[k]) togDir[k] = false;	// downcount
+				if (dimPulseBegin[k] <= togMin[k]) togDir[k] = true;	// upcount
+				if (togDir[k] == true) dimPulseBegin[k]++;
+				else dimPulseBegin[k]--;
+			}
+		}
+
+		/*****
+		 * FIRE AND RELEASE INSTANTS FOR THIS HALF-CYCLE
+		 *****/
+		uint16_t fire = (uint32_t)dimPulseBegin[k] * STEP_CENTIMICROS / 100;
+		uint16_t release = (uint32_t)(dimPulseBegin[k] + pulseWidth) * STEP_CENTIMICROS / 100;
+		addEvent(count++, fire, k, true);
+		addEvent(count++, release, k, false);
+	}
+
+	eventCount = count;
+	nextEvent = 0;
+	timerWrite(timer, 0);
+	if (count > 0) armAlarm(events[0].time);
+
+	isrStats.busyMicros += micros() - start;
+}
+
+void IRAM_ATTR onTimerISR()
+{
+	unsigned long start = micros();
+	uint64_t now = timerRead(timer);
+
+	uint8_t i = nextEvent;
+	while (i < eventCount && events[i].time <= now + MERGE_MICROS)
+	{
+		digitalWrite(dimOutPin[events[i].dim], events[i].on ? HIGH : LOW);
+		gateHigh[events[i].dim] = events[i].on;
+		i++;
+	}
+	nextEvent = i;
+	if (i < eventCount) armAlarm(events[i].time);
+
+	isrStats.timerInterrupts++;
+	isrStats.busyMicros += micros() - start;
+}
+
+void getDimmerIsrStats(DIMMER_ISR_STATS_typedef *stats)
+{
+	stats->zeroCrossInterrupts = isrStats.zeroCrossInterrupts;
+	stats->timerInterrupts = isrStats.timerInterrupts;
+	stats->busyMicros = isrStats.busyMicros;
+}
+
+void resetDimmerIsrStats(void)
+{
+	isrStats.zeroCrossInterrupts = 0;
+	isrStats.timerInterrupts = 0;
+	isrStats.busyMicros = 0;
+}
+
+#endif
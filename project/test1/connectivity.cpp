@@ -0,0 +1,155 @@
+#include "connectivity.h"
+#include "wifi_firebase.h"
+#include "log_sink.h"
+#include <WiFi.h>
+#include <esp_sntp.h>
+
+// --- EVENT SIDE ---
+// WiFi events arrive on the Arduino event task. The handler only records what
+// happened, all decisions are made in connectivityTick()
+volatile bool linkUp = false;
+volatile uint32_t linkFailures = 0;   // DISCONNECTED events, also fired by failed attempts
+volatile uint8_t disconnectReason = 0;
+
+// SNTP callback runs on the lwIP task
+volatile bool timeSynced = false;
+volatile uint32_t timeSyncCount = 0;
+volatile uint32_t firstTimeSyncMs = 0;
+
+// --- STATE MACHINE ---
+NetState netState = NET_IDLE;
+unsigned long stateSince = 0;
+unsigned long backoffMs = NET_BACKOFF_MIN_MS;
+uint32_t seenFailures = 0;
+bool sntpStarted = false;
+
+uint32_t netConnects = 0;
+uint32_t netDisconnects = 0;
+uint32_t netFailedAttempts = 0;
+uint32_t firstConnectMs = 0;
+
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    switch (event) {
+    case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+        linkUp = true;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        disconnectReason = info.wifi_sta_disconnected.reason;
+        linkFailures++;
+        linkUp = false;
+        break;
+    case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+        linkUp = false;
+        break;
+    default:
+        break;
+    }
+}
+
+static void onTimeSync(struct timeval *tv) {
+    if (!timeSynced) firstTimeSyncMs = millis();
+    timeSynced = true;
+    timeSyncCount++;
+}
+
+static void setState(NetState state) {
+    netState = state;
+    stateSince = millis();
+}
+
+static void startAttempt() {
+    seenFailures = linkFailures;
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    setState(NET_CONNECTING);
+}
+
+// Wait before the next attempt, longer after every failure in a row
+static void startBackoff() {
+    WiFi.disconnect();
+    setState(NET_BACKOFF);
+    LogRecord r;
+    logBegin(r, LOG_WARN);
+    logString(r, "wifi", "retry");
+    logUnsigned(r, "reason", disconnectReason);
+    logUnsigned(r, "backoff_ms", backoffMs);
+    logEnd(r);
+}
+
+// lwIP keeps SNTP running on its own after this, including the periodic re-sync
+static void startSntp() {
+    sntp_set_time_sync_notification_cb(onTimeSync);
+    sntp_set_sync_interval(NTP_SYNC_INTERVAL_MS);
+    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER, "time.nist.gov");
+    sntpStarted = true;
+}
+
+void initConnectivity() {
+    WiFi.persistent(false);       // Credentials come from the sketch, no flash writes
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false); // Retries are paced by the backoff below instead
+    WiFi.onEvent(onWiFiEvent);
+    startAttempt();
+}
+
+void connectivityTick() {
+    unsigned long now = millis();
+
+    switch (netState) {
+    case NET_IDLE:
+        break;
+
+    case NET_CONNECTING:
+        if (linkUp) {
+            netConnects++;
+            if (firstConnectMs == 0) firstConnectMs = now;
+            backoffMs = NET_BACKOFF_MIN_MS;
+            setState(NET_CONNECTED);
+            LogRecord r;
+            logBegin(r, LOG_INFO);
+            logString(r, "wifi", "connected");
+            logString(r, "ip", WiFi.localIP().toString().c_str());
+            logEnd(r);
+            if (!sntpStarted) startSntp();
+        } else if (linkFailures != seenFailures || now - stateSince >= NET_CONNECT_TIMEOUT_MS) {
+            netFailedAttempts++;
+            startBackoff();
+        }
+        break;
+
+    case NET_CONNECTED:
+        if (!linkUp) {
+            netDisconnects++;
+            startBackoff();
+        }
+        break;
+
+    case NET_BACKOFF:
+        if (now - stateSince >= backoffMs) {
+            backoffMs = min(backoffMs * 2, NET_BACKOFF_MAX_MS);
+            startAttempt();
+        }
+        break;
+    }
+}
+
+bool isWiFiConnected() {
+    return linkUp;
+}
+
+bool isTimeSynced() {
+    return timeSynced;
+}
+
+void getConnectivityStats(ConnectivityStats &stats) {
+    stats.state = netState;
+    stats.timeSynced = timeSynced;
+    stats.connects = netConnects;
+    stats.disconnects = netDisconnects;
+    stats.failedAttempts = netFailedAttempts;
+    stats.lastReason = disconnectReason;
+    stats.backoffMs = backoffMs;
+    stats.firstConnectMs = firstConnectMs;
+    stats.firstTimeSyncMs = firstTimeSyncMs;
+    stats.timeSyncs = timeSyncCount;
+    stats.rssi = linkUp ? WiFi.RSSI() : 0;
+}
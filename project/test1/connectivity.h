@@ -0,0 +1,59 @@
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <Arduino.h>
+
+// --- WIFI / NTP MANAGER ---
+// Nothing here waits for the network. initConnectivity() only starts the
+// first connection attempt, WiFi events and connectivityTick() do the rest:
+// reconnecting with an exponential backoff and starting SNTP once there is an
+// IP address. Sensors and dimmers run from boot whether or not WiFi ever comes up
+
+// Give up on a connection attempt after this long (ms)
+const unsigned long NET_CONNECT_TIMEOUT_MS = 15000;
+
+// Wait between failed attempts, doubled after each failure up to the maximum (ms)
+const unsigned long NET_BACKOFF_MIN_MS = 1000;
+const unsigned long NET_BACKOFF_MAX_MS = 60000;
+
+// SNTP re-sync interval once the clock is set (ms)
+const uint32_t NTP_SYNC_INTERVAL_MS = 3600000;
+
+enum NetState {
+    NET_IDLE,        // initConnectivity() not called yet
+    NET_CONNECTING,  // Attempt in progress
+    NET_CONNECTED,   // Associated and got an IP address
+    NET_BACKOFF      // Waiting before the next attempt
+};
+
+struct ConnectivityStats {
+    NetState state;
+    bool timeSynced;
+    uint32_t connects;        // Times an IP address was obtained
+    uint32_t disconnects;     // Connections lost after being up
+    uint32_t failedAttempts;  // Attempts that were rejected or timed out
+    uint8_t lastReason;       // WiFi disconnect reason of the last failure or loss
+    uint32_t backoffMs;       // Current wait between attempts
+    uint32_t firstConnectMs;  // millis() when WiFi first came up, 0 = not yet
+    uint32_t firstTimeSyncMs; // millis() when the clock was first set, 0 = not yet
+    uint32_t timeSyncs;
+    int rssi;                 // Only valid while connected
+};
+
+// Register the WiFi event handler and start the first connection attempt
+// Returns immediately
+void initConnectivity();
+
+// Advance the reconnect state machine, call it periodically (about every 100 ms)
+// from a task that may block for a few milliseconds
+void connectivityTick();
+
+// True while the station has an IP address
+bool isWiFiConnected();
+
+// True once SNTP has set the clock
+bool isTimeSynced();
+
+void getConnectivityStats(ConnectivityStats &stats);
+
+#endif
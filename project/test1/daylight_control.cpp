@@ -0,0 +1,89 @@
+#include "daylight_control.h"
+#include "dimmer_curves.h"
+
+// Longest time step the integrator accepts, a stalled caller must not cause a jump (s)
+const float MAX_DT = 1.0f;
+
+int daylightSetpoint = DAYLIGHT_SETPOINT;
+float daylightIntegral = 0;
+int daylightOutput = 0;
+int lastLightLevel = -1;
+unsigned long lastUpdateMs = 0;
+
+DaylightStats daylightStats = {DAYLIGHT_SETPOINT, 0, 0, 0, 0, 0, 0};
+
+void initDaylightControl() {
+    daylightIntegral = 0;
+    daylightOutput = 0;
+    lastLightLevel = -1;
+    lastUpdateMs = millis();
+}
+
+void setDaylightSetpoint(int value) {
+    daylightSetpoint = constrain(value, 0, 4095);
+    lastLightLevel = -1; // Force a recompute on the next update
+}
+
+int daylightControlUpdate(int lightLevel, unsigned long nowMs) {
+    float dt = (nowMs - lastUpdateMs) / 1000.0f;
+    if (dt > MAX_DT) dt = MAX_DT;
+    lastUpdateMs = nowMs;
+
+    // Positive error = darker than wanted = more lamp
+    int error = lightLevel - daylightSetpoint;
+    bool inBand = abs(error) <= DAYLIGHT_HYSTERESIS;
+    bool moved = lastLightLevel < 0 || abs(lightLevel - lastLightLevel) >= DAYLIGHT_CHANGE_THRESHOLD;
+
+    daylightStats.lightLevel = lightLevel;
+
+    // Inside the band with a steady input there is nothing to do
+    if (inBand && !moved) {
+        daylightStats.skipped++;
+        return -1;
+    }
+
+    // Saturated and pushed further the same way: integrating would only wind up
+    bool pushingHigh = daylightOutput >= DIMMER_LEVELS && error > 0;
+    bool pushingLow = daylightOutput <= 0 && error < 0;
+    if ((pushingHigh || pushingLow) && !moved) {
+        daylightStats.skipped++;
+        daylightStats.saturated++;
+        return -1;
+    }
+
+    lastLightLevel = lightLevel;
+    daylightStats.updates++;
+
+    // Integrate outside the band only, and never past the output range (anti-windup)
+    if (!inBand && !pushingHigh && !pushingLow) {
+        daylightIntegral += DAYLIGHT_KI * error * dt;
+        daylightIntegral = constrain(daylightIntegral, -(float)DIMMER_LEVELS, (float)DIMMER_LEVELS);
+    }
+
+    // Proportional term counts from the band edge, so it does not jump by
+    // KP * DAYLIGHT_HYSTERESIS each time the reading crosses it
+    int beyondBand = inBand ? 0 : error - (error > 0 ? DAYLIGHT_HYSTERESIS : -DAYLIGHT_HYSTERESIS);
+    float target = DAYLIGHT_KP * beyondBand + daylightIntegral;
+    target = constrain(target, 0.0f, (float)DIMMER_LEVELS);
+
+    // Rate limit so a passing cloud does not slam the lamps
+    float maxStep = DAYLIGHT_MAX_RATE * dt;
+    float step = constrain(target - daylightOutput, -maxStep, maxStep);
+    int next = daylightOutput + (int)(step + (step >= 0 ? 0.5f : -0.5f));
+    next = constrain(next, 0, DIMMER_LEVELS);
+
+    daylightStats.setpoint = daylightSetpoint;
+    daylightStats.integral = daylightIntegral;
+    if (next <= 0 || next >= DIMMER_LEVELS) daylightStats.saturated++;
+
+    if (next == daylightOutput) {
+        return -1;
+    }
+    daylightOutput = next;
+    daylightStats.output = daylightOutput;
+    return daylightOutput;
+}
+
+void getDaylightStats(DaylightStats &stats) {
+    stats = daylightStats;
+}
@@ -0,0 +1,52 @@
+#ifndef DAYLIGHT_CONTROL_H
+#define DAYLIGHT_CONTROL_H
+
+#include <Arduino.h>
+
+// Closed loop daylight harvesting: the lamps make up whatever the daylight
+// lacks so the light sensor settles at the setpoint. The sensor sees the
+// lamps too, the loop compensates for their light through its feedback.
+// Light levels are raw MDL-07 readings (0 = bright, 4095 = dark),
+// the output is a dimmer level (0 - DIMMER_LEVELS)
+
+// Light level to hold (ADC counts)
+const int DAYLIGHT_SETPOINT = 1500;
+
+// No correction while the error is inside this band (ADC counts), stops the
+// lamps hunting around the setpoint
+const int DAYLIGHT_HYSTERESIS = 80;
+
+// Smaller changes of the light level than this do not wake the controller up
+// while it is inside the band (ADC counts)
+const int DAYLIGHT_CHANGE_THRESHOLD = 20;
+
+// PI gains: output levels per ADC count, and per ADC count per second
+const float DAYLIGHT_KP = 0.2f;
+const float DAYLIGHT_KI = 0.4f;
+
+// Fastest output change, levels per second
+const float DAYLIGHT_MAX_RATE = 300.0f;
+
+struct DaylightStats {
+    int setpoint;
+    int lightLevel;       // Last input
+    int output;           // Current dimmer level
+    float integral;
+    uint32_t updates;     // Runs that recomputed the output
+    uint32_t skipped;     // Runs skipped because nothing changed significantly
+    uint32_t saturated;   // Runs with the output at 0 or full
+};
+
+// Reset the controller, output starts at 0
+void initDaylightControl();
+
+// Change the light level to hold
+void setDaylightSetpoint(int setpoint);
+
+// Feed a new filtered light level, nowMs = millis()
+// Returns the new dimmer level, or -1 if the output did not change
+int daylightControlUpdate(int lightLevel, unsigned long nowMs);
+
+void getDaylightStats(DaylightStats &stats);
+
+#endif
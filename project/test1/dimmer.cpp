@@ -1,115 +1,293 @@
 #include <Arduino.h> // <--- CRITICAL FIX: Must be at the top!
 #include "dimmer.h"
+#include "zero_cross.h"
+#include "dimmer_curves.h"
 
 // --- PIN DEFINITIONS ---
 // Make sure these match your physical wiring!
+// Add pins to DIMMER_PINS for more channels (up to DIMMER_MAX_CHANNELS)
 const int ZERO_CROSS_PIN = 14;
 const int DIMMER_1_PIN = 13;
 const int DIMMER_2_PIN = 12;
 
-// --- HARDWARE TIMER HANDLES ---
-hw_timer_t *timer1 = NULL;
-hw_timer_t *timer2 = NULL;
+const int DIMMER_PINS[] = {DIMMER_1_PIN, DIMMER_2_PIN};
+const int DIMMER_CHANNELS = sizeof(DIMMER_PINS) / sizeof(DIMMER_PINS[0]);
+
+// Pulse width for the TRIAC trigger (10 microseconds)
+const int TRIAC_PULSE_MICROS = 10;
+
+// Events closer than this to the one being handled are done in the same interrupt
+const int EVENT_MERGE_MICROS = 3;
+
+// --- SCHEDULE ---
+// Every half-cycle is a list of gate on/off events sorted by time after the
+// zero-cross. One hardware timer walks the list: each alarm handles the events
+// that are due and re-arms itself for the next one.
+// Firing points are kept for a nominal 10 ms (50 Hz) half-cycle and scaled
+// to the measured half-cycle at each zero-cross, the pulse width is not scaled
+struct DimmerEvent {
+    uint16_t time;    // Microseconds after this zero-cross (scaled phase, + pulse for off)
+    uint8_t channel;  // Index into DIMMER_PINS
+    bool on;          // true = start the gate pulse, false = end it
+};
+
+// Events of channels that are off sort to the end and are never armed
+const uint16_t EVENT_PARKED = 0xFFFF;
+
+// Every channel has its two events in the list, only the zero-cross ISR changes it
+DimmerEvent schedule[2 * DIMMER_MAX_CHANNELS];
+volatile uint8_t scheduleCount = 0;  // Events that are not parked
+volatile uint8_t nextEvent = 0;      // Next event to run this half-cycle
+
+// --- COMMANDS ---
+// setDimmerLevel() and fadeDimmerTo() leave a command per channel, the zero-cross
+// ISR takes them over at the start of a half-cycle. Double buffered through the
+// spinlock: the ISR copies the pending commands out and the tasks never touch
+// the ISR's working state
+struct DimmerCommand {
+    uint16_t target;       // Level 0 - DIMMER_LEVELS
+    uint32_t halfCycles;   // Fade length, 0 = jump straight to target
+    DimmerCurve curve;
+};
+
+DimmerCommand pendingCommand[DIMMER_MAX_CHANNELS];
+volatile uint32_t pendingMask = 0;   // Bit per channel with a new command
+portMUX_TYPE scheduleLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Working state of the zero-cross ISR, per channel
+int32_t levelQ16[DIMMER_MAX_CHANNELS];     // Current level << 16, fractional while fading
+int32_t fadeStepQ16[DIMMER_MAX_CHANNELS];  // Added every half-cycle
+uint32_t fadeRemaining[DIMMER_MAX_CHANNELS];
+uint16_t fadeTarget[DIMMER_MAX_CHANNELS];
+DimmerCurve isrCurve[DIMMER_MAX_CHANNELS];
+uint16_t channelPhase[DIMMER_MAX_CHANNELS]; // Nominal firing phase, 0 = off
+
+// --- HARDWARE TIMER HANDLE ---
+hw_timer_t *dimmerTimer = NULL;
 
 // --- STATE VARIABLES ---
-volatile int delayTime1 = 0;
-volatile int delayTime2 = 0;
-volatile bool ch1_active = false;
-volatile bool ch2_active = false;
+// Last commanded level and curve per channel, for the tasks
+int channelLevel[DIMMER_MAX_CHANNELS];
+DimmerCurve channelCurve[DIMMER_MAX_CHANNELS];
 
-// Noise Filter variable
-volatile unsigned long lastZCTime = 0;
+volatile uint32_t gatesHigh = 0;     // Bit per channel with its gate pin HIGH
 
-// Pulse width for the TRIAC trigger (10 microseconds)
-const int TRIAC_PULSE_MICROS = 10;
+DimmerStats stats = {0, 0, 0, 0};
 
 // --- INTERRUPT SERVICE ROUTINES (ISRs) ---
 
-// Timer 1 ISR: Turn on Channel 1
-void IRAM_ATTR onTimer1() {
-    if (ch1_active) {
-        digitalWrite(DIMMER_1_PIN, HIGH);
-        ets_delay_us(TRIAC_PULSE_MICROS);
-        digitalWrite(DIMMER_1_PIN, LOW);
+// Timer ISR: run every event that is due, then arm the alarm for the next one
+void IRAM_ATTR onDimmerTimer() {
+    unsigned long start = micros();
+
+    uint64_t now = timerRead(dimmerTimer);
+    uint8_t count = scheduleCount;
+
+    uint8_t i = nextEvent;
+    while (i < count && schedule[i].time <= now + EVENT_MERGE_MICROS) {
+        const DimmerEvent &e = schedule[i];
+        digitalWrite(DIMMER_PINS[e.channel], e.on ? HIGH : LOW);
+        if (e.on) gatesHigh |= 1UL << e.channel;
+        else gatesHigh &= ~(1UL << e.channel);
+        i++;
     }
+    nextEvent = i;
+
+    if (i < count) {
+        timerAlarm(dimmerTimer, schedule[i].time, false, 0);
+    }
+
+    uint32_t elapsed = micros() - start;
+    stats.timerInterrupts++;
+    stats.lastIsrMicros = elapsed;
+    if (elapsed > stats.maxIsrMicros) stats.maxIsrMicros = elapsed;
 }
 
-// Timer 2 ISR: Turn on Channel 2
-void IRAM_ATTR onTimer2() {
-    if (ch2_active) {
-        digitalWrite(DIMMER_2_PIN, HIGH);
-        ets_delay_us(TRIAC_PULSE_MICROS);
-        digitalWrite(DIMMER_2_PIN, LOW);
+// Advance one channel by a half-cycle: take a new command, step a fade
+// Returns true if the firing phase changed
+static bool IRAM_ATTR updateChannel(int ch, bool hasCommand, const DimmerCommand &cmd) {
+    bool changed = false;
+
+    if (hasCommand) {
+        isrCurve[ch] = cmd.curve;
+        fadeTarget[ch] = cmd.target;
+        if (cmd.halfCycles == 0) {
+            levelQ16[ch] = (int32_t)cmd.target << 16;
+            fadeRemaining[ch] = 0;
+        } else {
+            // The fade starts from wherever the previous one got to
+            fadeStepQ16[ch] = (((int32_t)cmd.target << 16) - levelQ16[ch]) / (int32_t)cmd.halfCycles;
+            fadeRemaining[ch] = cmd.halfCycles;
+        }
+        changed = true;
+    }
+
+    if (fadeRemaining[ch] > 0) {
+        fadeRemaining[ch]--;
+        if (fadeRemaining[ch] == 0) levelQ16[ch] = (int32_t)fadeTarget[ch] << 16; // No rounding drift
+        else levelQ16[ch] += fadeStepQ16[ch];
+        changed = true;
     }
+
+    if (!changed) return false;
+
+    uint16_t phase = dimmerCurvePhase(isrCurve[ch], (levelQ16[ch] + 0x8000) >> 16);
+    if (phase == channelPhase[ch]) return false;
+    channelPhase[ch] = phase;
+    return true;
 }
 
 // Zero-Cross ISR
 void IRAM_ATTR onZeroCross() {
-    unsigned long now = micros();
-
-    // Noise Filter: Ignore noise faster than 8.5ms (8500us)
-    if (now - lastZCTime > 8500) {
-        lastZCTime = now;
-
-        // Restart Timers
-        if (ch1_active) {
-            // New API: timerWrite sets counter value
-            timerWrite(timer1, 0);
-            // New API: timerAlarm sets target, autureload=false, enable=0
-            // For one-shot in v3.0, we usually re-arm or just use setAlarm
-            timerAlarm(timer1, delayTime1, false, 0); 
+    // Noise Filter: edges away from the predicted zero-cross are ignored
+    if (!zeroCrossUpdate(micros())) {
+        return;
+    }
+    stats.zeroCrosses++;
+
+    // A pulse cut short by the previous half-cycle must not stay on
+    uint32_t high = gatesHigh;
+    for (int ch = 0; high != 0; ch++, high >>= 1) {
+        if (high & 1) digitalWrite(DIMMER_PINS[ch], LOW);
+    }
+    gatesHigh = 0;
+
+    // Pick up the commands written since the last half-cycle
+    DimmerCommand commands[DIMMER_MAX_CHANNELS];
+    portENTER_CRITICAL_ISR(&scheduleLock);
+    uint32_t mask = pendingMask;
+    for (int ch = 0; ch < DIMMER_CHANNELS; ch++) {
+        if (mask & (1UL << ch)) commands[ch] = pendingCommand[ch];
+    }
+    pendingMask = 0;
+    portEXIT_CRITICAL_ISR(&scheduleLock);
+
+    for (int ch = 0; ch < DIMMER_CHANNELS; ch++) {
+        updateChannel(ch, mask & (1UL << ch), commands[ch]);
+    }
+
+    // Stretch the firing points to this half-cycle (Q16 fixed point, no floats in the ISR)
+    uint32_t scale = (zeroCrossHalfPeriod() << 16) / ZC_NOMINAL_HALF_PERIOD;
+    uint8_t count = 0;
+    for (int i = 0; i < 2 * DIMMER_CHANNELS; i++) {
+        DimmerEvent &e = schedule[i];
+        uint16_t phase = channelPhase[e.channel];
+        if (phase == 0) {
+            e.time = EVENT_PARKED;
+        } else {
+            e.time = (phase * scale) >> 16;
+            if (!e.on) e.time += TRIAC_PULSE_MICROS;
+            count++;
         }
-        
-        if (ch2_active) {
-            timerWrite(timer2, 0);
-            timerAlarm(timer2, delayTime2, false, 0);
+
+        // Insertion sort, the list barely changes between half-cycles so this is
+        // close to one pass
+        for (int j = i; j > 0 && schedule[j - 1].time > schedule[j].time; j--) {
+            DimmerEvent tmp = schedule[j];
+            schedule[j] = schedule[j - 1];
+            schedule[j - 1] = tmp;
         }
     }
+    scheduleCount = count;
+
+    // Timer counts microseconds since this zero-cross
+    nextEvent = 0;
+    timerWrite(dimmerTimer, 0);
+    if (count > 0) {
+        timerAlarm(dimmerTimer, schedule[0].time, false, 0);
+    }
+}
+
+// --- COMMAND QUEUE ---
+
+// Leave a command for the zero-cross ISR, replacing one it has not taken yet
+static void postCommand(int ch, int target, uint32_t halfCycles, DimmerCurve curve) {
+    portENTER_CRITICAL(&scheduleLock);
+    pendingCommand[ch].target = target;
+    pendingCommand[ch].halfCycles = halfCycles;
+    pendingCommand[ch].curve = curve;
+    pendingMask |= 1UL << ch;
+    portEXIT_CRITICAL(&scheduleLock);
 }
 
 // --- PUBLIC FUNCTIONS ---
 
 void initializeDimmers() {
     // 1. Setup Pins
-    pinMode(DIMMER_1_PIN, OUTPUT);
-    pinMode(DIMMER_2_PIN, OUTPUT);
+    for (int ch = 0; ch < DIMMER_CHANNELS; ch++) {
+        pinMode(DIMMER_PINS[ch], OUTPUT);
+        digitalWrite(DIMMER_PINS[ch], LOW);
+
+        channelLevel[ch] = 0;
+        channelCurve[ch] = DIMMER_CURVE_LINEAR_POWER;
+        levelQ16[ch] = 0;
+        fadeRemaining[ch] = 0;
+        isrCurve[ch] = DIMMER_CURVE_LINEAR_POWER;
+        channelPhase[ch] = 0;
+
+        // Two events per channel, parked until the channel is switched on
+        schedule[2 * ch] = {EVENT_PARKED, (uint8_t)ch, true};
+        schedule[2 * ch + 1] = {EVENT_PARKED, (uint8_t)ch, false};
+    }
     pinMode(ZERO_CROSS_PIN, INPUT_PULLUP);
-    
-    digitalWrite(DIMMER_1_PIN, LOW);
-    digitalWrite(DIMMER_2_PIN, LOW);
 
-    // 2. Setup Hardware Timers (ESP32 Core 3.0.x API)
+    // 2. Setup Hardware Timer (ESP32 Core 3.0.x API)
     // 1MHz frequency means 1 tick = 1 microsecond
-    timer1 = timerBegin(1000000); 
-    timerAttachInterrupt(timer1, &onTimer1);
-
-    timer2 = timerBegin(1000000);
-    timerAttachInterrupt(timer2, &onTimer2);
+    // One timer serves every channel
+    dimmerTimer = timerBegin(1000000);
+    timerAttachInterrupt(dimmerTimer, &onDimmerTimer);
 
     // 3. Setup Zero Cross Interrupt
     attachInterrupt(digitalPinToInterrupt(ZERO_CROSS_PIN), onZeroCross, RISING);
 }
 
+int dimmerChannelCount() {
+    return DIMMER_CHANNELS;
+}
+
 void setDimmerBrightness(int channel, int brightness) {
     if (brightness < 0) brightness = 0;
     if (brightness > 100) brightness = 100;
 
-    // Map 1-100 brightness to ~8600us - 500us delay
-    int delay = 0;
-    bool active = true;
+    setDimmerLevel(channel, brightness * (DIMMER_LEVELS / 100));
+}
+
+void setDimmerLevel(int channel, int level) {
+    if (channel < 1 || channel > DIMMER_CHANNELS) return;
+    fadeDimmerTo(channel, level, 0, channelCurve[channel - 1]);
+}
 
-    if (brightness == 0) {
-        active = false; 
-    } else {
-        // Map: High brightness = Short delay. Low brightness = Long delay.
-        delay = map(brightness, 1, 100, 8600, 500); 
-    }
+void fadeDimmerTo(int channel, int level, unsigned long durationMs, DimmerCurve curve) {
+    if (channel < 1 || channel > DIMMER_CHANNELS) return;
 
-    if (channel == 1) {
-        ch1_active = active;
-        delayTime1 = delay;
-    } else if (channel == 2) {
-        ch2_active = active;
-        delayTime2 = delay;
-    }
+    if (level < 0) level = 0;
+    if (level > DIMMER_LEVELS) level = DIMMER_LEVELS;
+
+    // Duration in half-cycles of the mains we are actually on
+    uint32_t halfCycles = (uint64_t)durationMs * 1000 / zeroCrossHalfPeriod();
+
+    channelLevel[channel - 1] = level;
+    channelCurve[channel - 1] = curve;
+    postCommand(channel - 1, level, halfCycles, curve);
+}
+
+void setDimmerCurve(int channel, DimmerCurve curve) {
+    if (channel < 1 || channel > DIMMER_CHANNELS) return;
+
+    channelCurve[channel - 1] = curve;
+    setDimmerLevel(channel, channelLevel[channel - 1]); // Re-map the current level
+}
+
+int getDimmerLevel(int channel) {
+    if (channel < 1 || channel > DIMMER_CHANNELS) return 0;
+    return (levelQ16[channel - 1] + 0x8000) >> 16;
+}
+
+bool dimmerFading(int channel) {
+    if (channel < 1 || channel > DIMMER_CHANNELS) return false;
+    return fadeRemaining[channel - 1] > 0;
+}
+
+void getDimmerStats(DimmerStats &out) {
+    out = stats;
 }
@@ -1,13 +1,51 @@
 #ifndef DIMMER_H
 #define DIMMER_H
 
-// Initialize both dimmer channels
+#include <Arduino.h>
+#include "dimmer_curves.h"
+
+// Channels the engine can drive from its one hardware timer
+const int DIMMER_MAX_CHANNELS = 8;
+
+struct DimmerStats {
+    uint32_t zeroCrosses;     // Accepted zero-cross edges (half-cycles), see zero_cross.h for the rest
+    uint32_t timerInterrupts; // Timer ISR runs, each handles every event due at that time
+    uint32_t lastIsrMicros;   // Time spent in the last timer ISR
+    uint32_t maxIsrMicros;
+};
+
+// Initialize all dimmer channels
 void initializeDimmers();
 
+// Number of channels wired up (see DIMMER_PINS in dimmer.cpp)
+int dimmerChannelCount();
+
 // Set the brightness for a specific channel
-// channel: 1 or 2
+// channel: 1 to dimmerChannelCount()
 // brightness: 0-100
+// Takes effect at the next zero-cross, never in the middle of a half-cycle
 void setDimmerBrightness(int channel, int brightness);
 
+// Same with fine resolution
+// level: 0 (off) to DIMMER_LEVELS
+void setDimmerLevel(int channel, int level);
+
+// How levels map to firing angles (default DIMMER_CURVE_LINEAR_POWER)
+void setDimmerCurve(int channel, DimmerCurve curve);
+
+// Ramp a channel from its current level to 'level' over durationMs
+// The steps are taken by the zero-cross ISR, one per half-cycle, evenly spaced
+// on the given curve (so a CIE L* fade looks even). Returns immediately; a new
+// setDimmerLevel() or fade replaces the running one from where it got to
+void fadeDimmerTo(int channel, int level, unsigned long durationMs, DimmerCurve curve);
+
+// Level the channel is at right now (follows a fade)
+int getDimmerLevel(int channel);
+
+// True while a fade is running
+bool dimmerFading(int channel);
+
+// Copy of the timing counters
+void getDimmerStats(DimmerStats &stats);
 
 #endif
@@ -0,0 +1,107 @@
+#include "dimmer_curves.h"
+
+// --- CURVE GENERATION ---
+// Everything here runs in the compiler: the tables end up as constant data
+// and the firmware never touches a float to pick a firing phase.
+//
+// A TRIAC fired at angle a (0 - pi) into a resistive load delivers this
+// fraction of the full half-cycle power:
+//     P(a) = 1 - a / pi + sin(2a) / (2 pi)
+// For each level we pick the power it should deliver, then search the angle
+// that gives it.
+
+namespace {
+
+constexpr double PI_D = 3.14159265358979323846;
+
+// sin() is not constexpr, Taylor series after reducing to [-pi, pi]
+constexpr double constSin(double x) {
+    while (x > PI_D) x -= 2 * PI_D;
+    while (x < -PI_D) x += 2 * PI_D;
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 20; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double powerAtAngle(double a) {
+    return 1 - a / PI_D + constSin(2 * a) / (2 * PI_D);
+}
+
+constexpr double phaseToAngle(uint16_t phase) {
+    return PI_D * phase / 10000.0;
+}
+
+// P(a) falls from 1 to 0 over 0 - pi, bisect for the angle delivering 'power'
+constexpr double angleForPower(double power) {
+    double lo = 0;
+    double hi = PI_D;
+    for (int i = 0; i < 40; i++) {
+        double mid = (lo + hi) / 2;
+        if (powerAtAngle(mid) > power) lo = mid;
+        else hi = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+// Relative luminance (0 - 1) for a CIE L* lightness (0 - 100)
+constexpr double cieLuminance(double lightness) {
+    if (lightness <= 8) return lightness / 903.3;
+    double t = (lightness + 16) / 116;
+    return t * t * t;
+}
+
+struct CurveTable {
+    uint16_t phase[DIMMER_LEVELS + 1];
+};
+
+constexpr CurveTable makeCurve(DimmerCurve curve) {
+    CurveTable table = {};
+
+    // Levels are spread over the power the firing window can actually deliver,
+    // so every step is a real change
+    const double minPower = powerAtAngle(phaseToAngle(DIMMER_MAX_PHASE));
+    const double maxPower = powerAtAngle(phaseToAngle(DIMMER_MIN_PHASE));
+
+    table.phase[0] = 0; // Off
+    for (int level = 1; level <= DIMMER_LEVELS; level++) {
+        double x = (double)level / DIMMER_LEVELS;
+        double fraction = curve == DIMMER_CURVE_CIE_LSTAR ? cieLuminance(x * 100) : x;
+        double power = minPower + (maxPower - minPower) * fraction;
+
+        double phase = angleForPower(power) / PI_D * 10000.0 + 0.5;
+        if (phase < DIMMER_MIN_PHASE) phase = DIMMER_MIN_PHASE;
+        if (phase > DIMMER_MAX_PHASE) phase = DIMMER_MAX_PHASE;
+        table.phase[level] = (uint16_t)phase;
+    }
+    return table;
+}
+
+} // namespace
+
+// In DRAM: the tables are read from the zero-cross ISR, which may run while flash is busy
+DRAM_ATTR constexpr CurveTable LINEAR_POWER_CURVE = makeCurve(DIMMER_CURVE_LINEAR_POWER);
+DRAM_ATTR constexpr CurveTable CIE_LSTAR_CURVE = makeCurve(DIMMER_CURVE_CIE_LSTAR);
+
+const uint16_t *customCurve = LINEAR_POWER_CURVE.phase;
+
+uint16_t IRAM_ATTR dimmerCurvePhase(DimmerCurve curve, int level) {
+    if (level <= 0) return 0;
+    if (level > DIMMER_LEVELS) level = DIMMER_LEVELS;
+
+    switch (curve) {
+    case DIMMER_CURVE_CIE_LSTAR:
+        return CIE_LSTAR_CURVE.phase[level];
+    case DIMMER_CURVE_CUSTOM:
+        return customCurve[level];
+    default:
+        return LINEAR_POWER_CURVE.phase[level];
+    }
+}
+
+void setDimmerCustomCurve(const uint16_t *phases) {
+    customCurve = phases != NULL ? phases : LINEAR_POWER_CURVE.phase;
+}
@@ -0,0 +1,31 @@
+#ifndef DIMMER_CURVES_H
+#define DIMMER_CURVES_H
+
+#include <Arduino.h>
+
+// Fine brightness resolution: 0 = off, DIMMER_LEVELS = full
+const int DIMMER_LEVELS = 1000;
+
+// Firing window inside a nominal 10 ms half-cycle (microseconds after the zero-cross)
+// Earlier than MIN_PHASE the zero-cross detector is not reliable yet, later than
+// MAX_PHASE the TRIAC may not latch before the current falls to zero
+const uint16_t DIMMER_MIN_PHASE = 500;
+const uint16_t DIMMER_MAX_PHASE = 8600;
+
+enum DimmerCurve {
+    DIMMER_CURVE_LINEAR_POWER, // Level is proportional to the RMS power delivered to the load
+    DIMMER_CURVE_CIE_LSTAR,    // Level is proportional to perceived lightness (CIE 1976 L*)
+    DIMMER_CURVE_CUSTOM        // Table set with setDimmerCustomCurve()
+};
+
+// Firing phase for a level (0 - DIMMER_LEVELS) on a curve, 0 for off
+// Table lookup only, safe to call from an ISR
+uint16_t dimmerCurvePhase(DimmerCurve curve, int level);
+
+// Use your own table for DIMMER_CURVE_CUSTOM: DIMMER_LEVELS + 1 firing phases,
+// entry 0 = 0 (off), then from DIMMER_MAX_PHASE down towards DIMMER_MIN_PHASE.
+// The table must stay valid and live in RAM (it is read from the zero-cross ISR).
+// Until this is called the custom curve is the linear power one
+void setDimmerCustomCurve(const uint16_t *phases);
+
+#endif
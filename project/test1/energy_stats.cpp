@@ -0,0 +1,223 @@
+#include "energy_stats.h"
+#include "timestamp.h"
+
+// Running aggregate of one window. Sums are value x milliseconds, so the
+// mean is time weighted and the power sum is the energy integral
+struct Accumulator {
+    uint32_t startMs;
+    uint32_t durationMs;
+    uint16_t samples;
+    uint16_t voltageMin, voltageMax;
+    uint32_t currentMin, currentMax;
+    uint32_t powerMin, powerMax;
+    uint8_t pfMin, pfMax;
+    uint64_t voltageSum;
+    uint64_t currentSum;
+    uint64_t powerSum;
+    uint64_t pfSum;
+};
+
+// One reading in fixed point
+struct Reading {
+    uint16_t voltage;  // 0.1 V
+    uint32_t current;  // mA
+    uint32_t power;    // 0.1 W
+    uint8_t pf;        // 0.01
+};
+
+static const uint32_t MINUTE_MS = 60000;
+static const uint32_t HOUR_MS = 3600000;
+
+// 0.1 W x ms to mWh: / 10 / 3600
+static const uint32_t POWER_SUM_PER_MWH = 36000;
+
+static Accumulator minuteAcc, hourAcc, reportAcc;
+static EnergyWindow minutes[ENERGY_MINUTES];
+static EnergyWindow hours[ENERGY_HOURS];
+static int minuteHead = 0, minuteCount = 0;
+static int hourHead = 0, hourCount = 0;
+
+static bool started = false;
+static unsigned long lastReadingMs = 0;
+static bool haveLastReading = false;
+
+// The bus task adds, the upload and stats tasks read
+static portMUX_TYPE energyLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t toFixed(float value, float scale, uint32_t hi) {
+    if (isnan(value) || value <= 0) return 0;
+    float scaled = value * scale + 0.5f;
+    return scaled >= hi ? hi : (uint32_t)scaled;
+}
+
+static void resetAcc(Accumulator &a, uint32_t startMs) {
+    memset(&a, 0, sizeof(a));
+    a.startMs = startMs;
+    a.voltageMin = UINT16_MAX;
+    a.currentMin = UINT32_MAX;
+    a.powerMin = UINT32_MAX;
+    a.pfMin = UINT8_MAX;
+}
+
+static void addReading(Accumulator &a, const Reading &r, uint32_t dtMs) {
+    a.samples++;
+    a.durationMs += dtMs;
+    a.voltageMin = min(a.voltageMin, r.voltage);
+    a.voltageMax = max(a.voltageMax, r.voltage);
+    a.currentMin = min(a.currentMin, r.current);
+    a.currentMax = max(a.currentMax, r.current);
+    a.powerMin = min(a.powerMin, r.power);
+    a.powerMax = max(a.powerMax, r.power);
+    a.pfMin = min(a.pfMin, r.pf);
+    a.pfMax = max(a.pfMax, r.pf);
+    a.voltageSum += (uint64_t)r.voltage * dtMs;
+    a.currentSum += (uint64_t)r.current * dtMs;
+    a.powerSum += (uint64_t)r.power * dtMs;
+    a.pfSum += (uint64_t)r.pf * dtMs;
+}
+
+// Fold a closed minute into the hour, same result as adding its readings one by one
+static void mergeAcc(Accumulator &into, const Accumulator &from) {
+    if (from.samples == 0) return;
+    into.samples += from.samples;
+    into.durationMs += from.durationMs;
+    into.voltageMin = min(into.voltageMin, from.voltageMin);
+    into.voltageMax = max(into.voltageMax, from.voltageMax);
+    into.currentMin = min(into.currentMin, from.currentMin);
+    into.currentMax = max(into.currentMax, from.currentMax);
+    into.powerMin = min(into.powerMin, from.powerMin);
+    into.powerMax = max(into.powerMax, from.powerMax);
+    into.pfMin = min(into.pfMin, from.pfMin);
+    into.pfMax = max(into.pfMax, from.pfMax);
+    into.voltageSum += from.voltageSum;
+    into.currentSum += from.currentSum;
+    into.powerSum += from.powerSum;
+    into.pfSum += from.pfSum;
+}
+
+static void closeAcc(const Accumulator &a, EnergyWindow &w, const TimePair &now) {
+    memset(&w, 0, sizeof(w));
+    w.unixTime = timeAtUptime(now, a.startMs);
+    w.uptimeSec = a.startMs / 1000;
+    w.durationMs = a.durationMs;
+    w.samples = a.samples;
+    if (a.samples == 0) return;
+
+    w.voltageMin = a.voltageMin;
+    w.voltageMax = a.voltageMax;
+    w.currentMin = a.currentMin;
+    w.currentMax = a.currentMax;
+    w.powerMin = a.powerMin;
+    w.powerMax = a.powerMax;
+    w.pfMin = a.pfMin;
+    w.pfMax = a.pfMax;
+
+    uint32_t d = max(a.durationMs, (uint32_t)1);
+    w.voltageMean = (a.voltageSum + d / 2) / d;
+    w.currentMean = (a.currentSum + d / 2) / d;
+    w.powerMean = (a.powerSum + d / 2) / d;
+    w.pfMean = (a.pfSum + d / 2) / d;
+    w.energy = (a.powerSum + POWER_SUM_PER_MWH / 2) / POWER_SUM_PER_MWH;
+}
+
+static void pushWindow(EnergyWindow *ring, int size, int &head, int &count, const EnergyWindow &w) {
+    ring[(head + count) % size] = w;
+    if (count < size) count++;
+    else head = (head + 1) % size;
+}
+
+// Close the minute (and hour) windows the clock has moved past
+static void rollWindows(uint32_t nowMs, const TimePair &now) {
+    if (nowMs / MINUTE_MS == minuteAcc.startMs / MINUTE_MS) return;
+
+    EnergyWindow w;
+    closeAcc(minuteAcc, w, now);
+    pushWindow(minutes, ENERGY_MINUTES, minuteHead, minuteCount, w);
+    mergeAcc(hourAcc, minuteAcc);
+    resetAcc(minuteAcc, nowMs - nowMs % MINUTE_MS);
+
+    if (nowMs / HOUR_MS == hourAcc.startMs / HOUR_MS) return;
+    closeAcc(hourAcc, w, now);
+    pushWindow(hours, ENERGY_HOURS, hourHead, hourCount, w);
+    resetAcc(hourAcc, nowMs - nowMs % HOUR_MS);
+}
+
+void energyStatsAdd(const PzemData &data, unsigned long nowMs) {
+    TimePair now = timeNow(); // Dates windows that close, read outside the lock
+
+    portENTER_CRITICAL(&energyLock);
+    if (!started) {
+        // Windows follow millis(), the first ones are partial
+        resetAcc(minuteAcc, nowMs - nowMs % MINUTE_MS);
+        resetAcc(hourAcc, nowMs - nowMs % HOUR_MS);
+        resetAcc(reportAcc, nowMs);
+        started = true;
+    }
+    rollWindows(nowMs, now);
+
+    if (!data.connected) {
+        haveLastReading = false;
+        portEXIT_CRITICAL(&energyLock);
+        return;
+    }
+
+    Reading r;
+    r.voltage = toFixed(data.voltage, 10, UINT16_MAX);
+    r.current = toFixed(data.current, 1000, UINT32_MAX);
+    r.power = toFixed(data.power, 10, UINT32_MAX);
+    r.pf = toFixed(data.pf, 100, UINT8_MAX);
+
+    // The first reading after a gap only sets the starting point
+    uint32_t dt = nowMs - lastReadingMs;
+    if (haveLastReading && dt <= ENERGY_MAX_GAP_MS) {
+        addReading(minuteAcc, r, dt);
+        addReading(reportAcc, r, dt);
+    }
+    lastReadingMs = nowMs;
+    haveLastReading = true;
+    portEXIT_CRITICAL(&energyLock);
+}
+
+static int copyWindows(const EnergyWindow *ring, int size, int head, int count, EnergyWindow *out, int max) {
+    int n = min(count, max);
+    // The newest n, oldest first
+    for (int i = 0; i < n; i++) out[i] = ring[(head + count - n + i) % size];
+    return n;
+}
+
+int energyStatsMinutes(EnergyWindow *out, int max) {
+    portENTER_CRITICAL(&energyLock);
+    int n = copyWindows(minutes, ENERGY_MINUTES, minuteHead, minuteCount, out, max);
+    portEXIT_CRITICAL(&energyLock);
+    return n;
+}
+
+int energyStatsHours(EnergyWindow *out, int max) {
+    portENTER_CRITICAL(&energyLock);
+    int n = copyWindows(hours, ENERGY_HOURS, hourHead, hourCount, out, max);
+    portEXIT_CRITICAL(&energyLock);
+    return n;
+}
+
+bool energyStatsTake(EnergyWindow &out) {
+    TimePair now = timeNow();
+
+    portENTER_CRITICAL(&energyLock);
+    bool any = started && reportAcc.samples > 0;
+    if (any) {
+        closeAcc(reportAcc, out, now);
+        resetAcc(reportAcc, now.uptimeMs);
+    }
+    portEXIT_CRITICAL(&energyLock);
+    return any;
+}
+
+void applyEnergyWindow(TelemetrySample &sample, const EnergyWindow &w) {
+    sample.voltage = w.voltageMean;
+    sample.current = w.currentMean;
+    sample.power = w.powerMean;
+    sample.pf = w.pfMean;
+    sample.powerMax = w.powerMax;
+    sample.intervalEnergy = w.energy;
+    sample.flags |= SAMPLE_POWER_AGGREGATED;
+}
@@ -0,0 +1,60 @@
+#ifndef ENERGY_STATS_H
+#define ENERGY_STATS_H
+
+#include <Arduino.h>
+#include "pzem.h"
+#include "telemetry_queue.h"
+
+// --- ENERGY ANALYTICS ---
+// Every PZEM reading is folded into running aggregates in O(1): min, max,
+// time-weighted mean and the energy integral of voltage, current, power and PF.
+// Closed windows are kept per minute for the last hour and per hour for the
+// last day. A third aggregate runs between uploads so each Firestore sample
+// carries the means and peak of its whole interval instead of one snapshot.
+// Each reading stands for the time since the previous one. Readings while the
+// meter is disconnected, and gaps longer than ENERGY_MAX_GAP_MS, add no time
+
+const int ENERGY_MINUTES = 60;   // Minute windows kept
+const int ENERGY_HOURS = 24;     // Hour windows kept
+
+// A longer gap between readings is not integrated (ms)
+const unsigned long ENERGY_MAX_GAP_MS = 4 * PZEM_READ_INTERVAL;
+
+// One closed window in the same fixed point units as TelemetrySample, 52 bytes
+struct EnergyWindow {
+    uint32_t unixTime;     // Window start, 0 if the clock was not set
+    uint32_t uptimeSec;    // Window start in seconds since boot
+    uint32_t durationMs;   // Time covered by readings (can be less than the window)
+    uint16_t samples;
+    uint16_t voltageMin;   // 0.1 V
+    uint16_t voltageMax;
+    uint16_t voltageMean;
+    uint32_t currentMin;   // mA
+    uint32_t currentMax;
+    uint32_t currentMean;
+    uint32_t powerMin;     // 0.1 W
+    uint32_t powerMax;
+    uint32_t powerMean;
+    uint8_t pfMin;         // 0.01
+    uint8_t pfMax;
+    uint8_t pfMean;
+    uint8_t reserved;
+    uint32_t energy;       // mWh, integral of the power over the window
+};
+
+// Fold one reading in, nowMs = millis(). Call it once per new PZEM reading
+void energyStatsAdd(const PzemData &data, unsigned long nowMs);
+
+// Copy up to max closed windows, oldest first. Returns the number copied
+int energyStatsMinutes(EnergyWindow *out, int max);
+int energyStatsHours(EnergyWindow *out, int max);
+
+// Aggregate since the previous call, then start a new one
+// Returns false if no readings were added in between
+bool energyStatsTake(EnergyWindow &out);
+
+// Replace the snapshot power values of a sample with the means of a window,
+// and add its peak power and energy (sets SAMPLE_POWER_AGGREGATED)
+void applyEnergyWindow(TelemetrySample &sample, const EnergyWindow &window);
+
+#endif
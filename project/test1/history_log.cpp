@@ -0,0 +1,467 @@
+#include "history_log.h"
+
+// --- FILE LAYOUT ---
+// HISTORY_DIR/meta          oldest and newest segment number
+// HISTORY_DIR/NNNNNNNN.dat  blocks: BlockHeader followed by the encoded columns
+// HISTORY_DIR/NNNNNNNN.idx  one IndexEntry per block, written after the block,
+//                           so an entry always points at a complete block
+
+enum Column {
+    COL_TIME,
+    COL_TEMPERATURE,
+    COL_HUMIDITY,
+    COL_POWER,
+    COL_LIGHT,
+    COL_BRIGHTNESS,
+    COLUMNS
+};
+
+// 1 = store deltas, 2 = store deltas of deltas
+static const uint8_t COLUMN_ORDER[COLUMNS] = {2, 1, 1, 1, 1, 1};
+
+struct BlockHeader {
+    uint16_t magic;
+    uint16_t count;
+    uint32_t firstTime;
+    uint32_t lastTime;
+    uint16_t columnBytes[COLUMNS];
+};
+
+struct IndexEntry {
+    uint32_t firstTime;
+    uint32_t lastTime;
+    uint32_t offset;     // Of the BlockHeader in the .dat file
+    uint16_t bytes;      // Header and columns
+    uint16_t count;
+};
+
+struct HistoryMeta {
+    uint32_t magic;
+    uint32_t firstSeq;
+    uint32_t lastSeq;
+};
+
+struct SegmentRange {
+    uint32_t firstTime;  // 0 = no blocks yet
+    uint32_t lastTime;
+};
+
+static const uint16_t BLOCK_MAGIC = 0x4842;        // "HB"
+static const uint32_t META_MAGIC = 0x48534C31;     // "HSL1"
+
+// A residual needs at most 33 bits plus the run flag, 5 varint bytes
+static const size_t MAX_VARINT = 5;
+static const size_t MAX_BLOCK_BYTES = sizeof(BlockHeader) + COLUMNS * HISTORY_BLOCK_SAMPLES * MAX_VARINT;
+
+static fs::FS *historyFs = NULL;
+static HistoryMeta meta = {META_MAGIC, 0, 0};
+static SegmentRange ranges[HISTORY_MAX_SEGMENTS]; // Indexed by segment number % HISTORY_MAX_SEGMENTS
+static uint32_t segmentLimit = 2;                 // Segments the budget allows
+static uint32_t segmentBytes = 0;                 // Size of the newest .dat file
+
+// Block being collected, one array per column
+static uint32_t columns[COLUMNS][HISTORY_BLOCK_SAMPLES];
+static int blockCount = 0;
+static uint32_t lastTime = 0;
+
+// Encoded block on its way to or from flash
+static uint8_t blockBuffer[MAX_BLOCK_BYTES];
+
+static HistoryStats historyStats = {};
+
+// --- COLUMN CODEC ---
+
+static size_t putVarint(uint8_t *out, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (v & 0x7F) | 0x80;
+        v >>= 7;
+    }
+    out[n++] = v;
+    return n;
+}
+
+// Residuals are sent as varint(zigzag << 1), a run of zero residuals as varint(run << 1 | 1)
+static size_t encodeColumn(const uint32_t *values, int count, uint8_t order, uint8_t *out) {
+    size_t n = 0;
+    uint32_t prev = 0, prevDelta = 0, zeros = 0;
+
+    for (int i = 0; i < count; i++) {
+        uint32_t delta = values[i] - prev;  // Wraps, decoding wraps back the same way
+        uint32_t residual = order == 2 ? delta - prevDelta : delta;
+        prev = values[i];
+        prevDelta = delta;
+
+        if (residual == 0) {
+            zeros++;
+            continue;
+        }
+        if (zeros > 0) {
+            n += putVarint(out + n, ((uint64_t)zeros << 1) | 1);
+            zeros = 0;
+        }
+        int32_t r = (int32_t)residual;
+        uint32_t zigzag = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+        n += putVarint(out + n, (uint64_t)zigzag << 1);
+    }
+    if (zeros > 0) n += putVarint(out + n, ((uint64_t)zeros << 1) | 1);
+    return n;
+}
+
+// Reads one column back a value at a time, so a block never has to be unpacked into arrays
+struct ColumnCursor {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t prev;
+    uint32_t prevDelta;
+    uint32_t zeros;      // Zero residuals still to hand out
+    uint8_t order;
+    bool error;
+};
+
+static void cursorBegin(ColumnCursor &c, const uint8_t *data, size_t length, uint8_t order) {
+    c.p = data;
+    c.end = data + length;
+    c.prev = 0;
+    c.prevDelta = 0;
+    c.zeros = 0;
+    c.order = order;
+    c.error = false;
+}
+
+static uint32_t cursorNext(ColumnCursor &c) {
+    uint32_t residual = 0;
+    if (c.zeros > 0) {
+        c.zeros--;
+    } else {
+        uint64_t token = 0;
+        int shift = 0;
+        while (true) {
+            if (c.p >= c.end || shift >= 35) {
+                c.error = true;
+                return 0;
+            }
+            uint8_t b = *c.p++;
+            token |= (uint64_t)(b & 0x7F) << shift;
+            shift += 7;
+            if (!(b & 0x80)) break;
+        }
+
+        if (token & 1) {
+            c.zeros = (uint32_t)(token >> 1) - 1;  // This value is the first of the run
+        } else {
+            uint32_t zigzag = token >> 1;
+            residual = (zigzag >> 1) ^ (0u - (zigzag & 1));
+        }
+    }
+
+    uint32_t delta = c.order == 2 ? c.prevDelta + residual : residual;
+    c.prev += delta;
+    c.prevDelta = delta;
+    return c.prev;
+}
+
+// --- FILES ---
+
+static void segmentPath(char *path, uint32_t seq, const char *ext) {
+    snprintf(path, 32, HISTORY_DIR "/%08lu.%s", (unsigned long)seq, ext);
+}
+
+static SegmentRange &rangeOf(uint32_t seq) {
+    return ranges[seq % HISTORY_MAX_SEGMENTS];
+}
+
+static bool writeMeta() {
+    File f = historyFs->open(HISTORY_DIR "/meta", "w");
+    if (!f) return false;
+    bool ok = f.write((const uint8_t *)&meta, sizeof(meta)) == sizeof(meta);
+    f.close();
+    return ok;
+}
+
+// Time range of a segment from the first and last entry of its index
+// Returns false if the index ends in a torn entry (power lost while writing it)
+static bool loadRange(uint32_t seq) {
+    char path[32];
+    segmentPath(path, seq, "idx");
+    SegmentRange &r = rangeOf(seq);
+    r.firstTime = 0;
+    r.lastTime = 0;
+
+    File f = historyFs->open(path, "r");
+    if (!f) return true;
+    size_t size = f.size();
+    size_t entries = size / sizeof(IndexEntry);
+
+    IndexEntry e;
+    if (entries > 0 && f.read((uint8_t *)&e, sizeof(e)) == sizeof(e)) {
+        r.firstTime = e.firstTime;
+        f.seek((entries - 1) * sizeof(IndexEntry));
+        if (f.read((uint8_t *)&e, sizeof(e)) == sizeof(e)) r.lastTime = e.lastTime;
+    }
+    f.close();
+    return size % sizeof(IndexEntry) == 0;
+}
+
+// Delete the oldest segments until no more than segmentLimit are left
+static void dropOldest() {
+    char path[32];
+    while (meta.lastSeq - meta.firstSeq >= segmentLimit) {
+        segmentPath(path, meta.firstSeq, "dat");
+        historyFs->remove(path);
+        segmentPath(path, meta.firstSeq, "idx");
+        historyFs->remove(path);
+        meta.firstSeq++;
+    }
+}
+
+// Open the next segment, deleting the oldest one past the budget
+static void startSegment() {
+    meta.lastSeq++;
+    rangeOf(meta.lastSeq) = {0, 0};
+    segmentBytes = 0;
+    dropOldest();
+    writeMeta();
+}
+
+bool historyBegin(fs::FS &fs, size_t budgetBytes) {
+    historyFs = &fs;
+    segmentLimit = constrain(budgetBytes / HISTORY_SEGMENT_BYTES, (size_t)2, (size_t)HISTORY_MAX_SEGMENTS);
+    if (!fs.exists(HISTORY_DIR)) fs.mkdir(HISTORY_DIR);
+
+    File f = fs.open(HISTORY_DIR "/meta", "r");
+    bool valid = f && f.read((uint8_t *)&meta, sizeof(meta)) == sizeof(meta) &&
+                 meta.magic == META_MAGIC && meta.lastSeq >= meta.firstSeq &&
+                 meta.lastSeq - meta.firstSeq < (uint32_t)HISTORY_MAX_SEGMENTS;
+    if (f) f.close();
+
+    if (!valid) {
+        meta.magic = META_MAGIC;
+        meta.firstSeq = 0;
+        meta.lastSeq = 0;
+        if (!writeMeta()) {
+            historyFs = NULL;
+            return false;
+        }
+    } else if (meta.lastSeq - meta.firstSeq >= segmentLimit) {
+        dropOldest();
+        writeMeta();
+    }
+
+    bool clean = true;
+    for (uint32_t seq = meta.firstSeq; seq <= meta.lastSeq; seq++) {
+        bool whole = loadRange(seq);
+        if (seq == meta.lastSeq) clean = whole;
+    }
+
+    char path[32];
+    segmentPath(path, meta.lastSeq, "dat");
+    f = fs.open(path, "r");
+    segmentBytes = f ? f.size() : 0;
+    if (f) f.close();
+
+    // Never append after a torn index entry, the next entries would be misaligned
+    if (!clean) startSegment();
+
+    lastTime = rangeOf(meta.lastSeq).lastTime;
+    for (uint32_t seq = meta.lastSeq; seq > meta.firstSeq && lastTime == 0; seq--) {
+        lastTime = rangeOf(seq - 1).lastTime;
+    }
+    return true;
+}
+
+// --- WRITING ---
+
+static bool writeBlock() {
+    if (blockCount == 0) return true;
+    if (historyFs == NULL) {
+        blockCount = 0;
+        return false;
+    }
+
+    BlockHeader header;
+    header.magic = BLOCK_MAGIC;
+    header.count = blockCount;
+    header.firstTime = columns[COL_TIME][0];
+    header.lastTime = columns[COL_TIME][blockCount - 1];
+
+    size_t length = sizeof(header);
+    for (int c = 0; c < COLUMNS; c++) {
+        header.columnBytes[c] = encodeColumn(columns[c], blockCount, COLUMN_ORDER[c], blockBuffer + length);
+        length += header.columnBytes[c];
+    }
+    memcpy(blockBuffer, &header, sizeof(header));
+    blockCount = 0;
+
+    if (segmentBytes > 0 && segmentBytes + length > HISTORY_SEGMENT_BYTES) startSegment();
+
+    char path[32];
+    segmentPath(path, meta.lastSeq, "dat");
+    File f = historyFs->open(path, "a");
+    if (!f) {
+        historyStats.writeErrors++;
+        return false;
+    }
+    // The offset is taken from the file, trailing bytes of a torn block are simply skipped
+    IndexEntry entry = {header.firstTime, header.lastTime, (uint32_t)f.size(), (uint16_t)length, header.count};
+    size_t written = f.write(blockBuffer, length);
+    f.close();
+    segmentBytes = entry.offset + written;
+    if (written != length) {
+        historyStats.writeErrors++;
+        return false;
+    }
+
+    segmentPath(path, meta.lastSeq, "idx");
+    f = historyFs->open(path, "a");
+    if (!f || f.write((const uint8_t *)&entry, sizeof(entry)) != sizeof(entry)) {
+        if (f) f.close();
+        historyStats.writeErrors++;
+        return false;
+    }
+    f.close();
+
+    SegmentRange &r = rangeOf(meta.lastSeq);
+    if (r.firstTime == 0) r.firstTime = entry.firstTime;
+    r.lastTime = entry.lastTime;
+
+    historyStats.blocks++;
+    historyStats.bytes += length + sizeof(entry);
+    return true;
+}
+
+void historyAppend(const TelemetrySample &s) {
+    // Range queries need wall-clock time, and it must not run backwards
+    if (s.unixTime == 0 || s.unixTime < lastTime) {
+        historyStats.skipped++;
+        return;
+    }
+
+    columns[COL_TIME][blockCount] = s.unixTime;
+    columns[COL_TEMPERATURE][blockCount] = (uint32_t)(int32_t)s.temperature;
+    columns[COL_HUMIDITY][blockCount] = s.humidity;
+    columns[COL_POWER][blockCount] = s.power;
+    columns[COL_LIGHT][blockCount] = s.lightLevel;
+    columns[COL_BRIGHTNESS][blockCount] = s.brightness;
+    blockCount++;
+    lastTime = s.unixTime;
+    historyStats.appended++;
+
+    if (blockCount == HISTORY_BLOCK_SAMPLES) writeBlock();
+}
+
+bool historyFlush() {
+    return writeBlock();
+}
+
+// --- READING ---
+
+static HistorySample rowOf(const uint32_t *values) {
+    HistorySample s;
+    s.unixTime = values[COL_TIME];
+    s.temperature = (int16_t)values[COL_TEMPERATURE];
+    s.humidity = values[COL_HUMIDITY];
+    s.power = values[COL_POWER];
+    s.lightLevel = values[COL_LIGHT];
+    s.brightness = values[COL_BRIGHTNESS];
+    return s;
+}
+
+// Decode the block in blockBuffer, passing the rows in range to cb
+// Returns 1 to go on, 0 if cb asked to stop, -1 if the block is corrupt
+static int scanBlock(size_t length, uint32_t from, uint32_t to, HistoryCallback cb, void *context, int &delivered) {
+    BlockHeader header;
+    memcpy(&header, blockBuffer, sizeof(header));
+    if (header.magic != BLOCK_MAGIC || header.count > HISTORY_BLOCK_SAMPLES) return -1;
+
+    ColumnCursor cursors[COLUMNS];
+    size_t offset = sizeof(header);
+    for (int c = 0; c < COLUMNS; c++) {
+        if (offset + header.columnBytes[c] > length) return -1;
+        cursorBegin(cursors[c], blockBuffer + offset, header.columnBytes[c], COLUMN_ORDER[c]);
+        offset += header.columnBytes[c];
+    }
+
+    uint32_t values[COLUMNS];
+    for (int i = 0; i < header.count; i++) {
+        for (int c = 0; c < COLUMNS; c++) {
+            values[c] = cursorNext(cursors[c]);
+            if (cursors[c].error) return -1;
+        }
+        if (values[COL_TIME] > to) return 1;
+        if (values[COL_TIME] < from) continue;
+
+        delivered++;
+        if (!cb(rowOf(values), context)) return 0;
+    }
+    return 1;
+}
+
+static int scanSegment(uint32_t seq, uint32_t from, uint32_t to, HistoryCallback cb, void *context, int &delivered) {
+    char path[32];
+    segmentPath(path, seq, "idx");
+    File index = historyFs->open(path, "r");
+    if (!index) return 1;
+    segmentPath(path, seq, "dat");
+    File data = historyFs->open(path, "r");
+    if (!data) {
+        index.close();
+        return -1;
+    }
+
+    int result = 1;
+    IndexEntry e;
+    while (result == 1 && index.read((uint8_t *)&e, sizeof(e)) == sizeof(e)) {
+        if (e.lastTime < from) continue;
+        if (e.firstTime > to) break;
+        if (e.bytes > MAX_BLOCK_BYTES || !data.seek(e.offset) ||
+            data.read(blockBuffer, e.bytes) != e.bytes) {
+            result = -1;
+            break;
+        }
+        result = scanBlock(e.bytes, from, to, cb, context, delivered);
+    }
+    index.close();
+    data.close();
+    return result;
+}
+
+int historyQuery(uint32_t from, uint32_t to, HistoryCallback cb, void *context) {
+    int delivered = 0;
+    if (historyFs != NULL) {
+        for (uint32_t seq = meta.firstSeq; seq <= meta.lastSeq; seq++) {
+            const SegmentRange &r = rangeOf(seq);
+            if (r.firstTime == 0 || r.lastTime < from || r.firstTime > to) continue;
+
+            int result = scanSegment(seq, from, to, cb, context, delivered);
+            if (result < 0) return -1;
+            if (result == 0) return delivered;
+        }
+    }
+
+    // Samples not written yet
+    for (int i = 0; i < blockCount; i++) {
+        uint32_t values[COLUMNS];
+        for (int c = 0; c < COLUMNS; c++) values[c] = columns[c][i];
+        if (values[COL_TIME] > to) break;
+        if (values[COL_TIME] < from) continue;
+
+        delivered++;
+        if (!cb(rowOf(values), context)) break;
+    }
+    return delivered;
+}
+
+void getHistoryStats(HistoryStats &stats) {
+    stats = historyStats;
+    stats.segments = meta.lastSeq - meta.firstSeq + 1;
+    stats.maxSegments = segmentLimit;
+    stats.firstTime = 0;
+    if (historyFs != NULL) {
+        for (uint32_t seq = meta.firstSeq; seq <= meta.lastSeq && stats.firstTime == 0; seq++) {
+            stats.firstTime = rangeOf(seq).firstTime;
+        }
+    }
+    if (stats.firstTime == 0 && blockCount > 0) stats.firstTime = columns[COL_TIME][0];
+    stats.lastTime = lastTime;
+}
@@ -0,0 +1,87 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "telemetry_queue.h"
+
+// --- LOCAL HISTORY ---
+// Append-only time series of the sensor samples on flash, readable even if
+// the cloud never saw them. Samples are collected in RAM one column per value
+// and written as one block when HISTORY_BLOCK_SAMPLES are in:
+//   time         delta of delta (1 s spacing costs nothing)
+//   temperature, humidity, power, light level, brightness   delta
+// Every residual is zigzag + varint, runs of zero residuals are one varint,
+// so a steady reading takes almost no space.
+// Blocks go into numbered segment files, each with a small index file
+// (time range + offset of every block). A range query only reads the blocks
+// it overlaps. Once the flash budget given to historyBegin() is full the
+// oldest segment is deleted, LittleFS spreads the writes over the flash.
+// A day of 1 s samples takes 110 KB with the load off and 200 KB with a
+// noisy load on (host/history_test.cpp), so every MB of budget keeps 5 - 9
+// days: about a week in 75 % of the 1.5 MB partition of the default 4 MB
+// layout, months need a LittleFS partition of 10 MB or more.
+// All file access goes through fs::FS, so the module also runs on a PC
+// against a stand-in FS backed by ordinary files.
+// Not locked: append and query from the same task.
+
+#define HISTORY_DIR "/hist"
+
+// Start a new segment file past this size
+#ifndef HISTORY_SEGMENT_BYTES
+#define HISTORY_SEGMENT_BYTES 65536
+#endif
+
+// Most segments kept whatever the budget, 8 bytes of RAM each (16 MB of data)
+#ifndef HISTORY_MAX_SEGMENTS
+#define HISTORY_MAX_SEGMENTS 256
+#endif
+
+const int HISTORY_BLOCK_SAMPLES = 256;          // Samples per block (about 4 minutes at 1 s)
+const int HISTORY_FLASH_PERCENT = 75;           // Of the LittleFS partition, the rest is for the telemetry spill file
+const unsigned long HISTORY_INTERVAL_MS = 1000; // How often the sketch appends a sample
+
+// One decoded history sample, units as in TelemetrySample
+struct HistorySample {
+    uint32_t unixTime;
+    int16_t temperature;  // 0.1 °C
+    uint16_t humidity;    // 0.1 %
+    uint32_t power;       // 0.1 W
+    uint16_t lightLevel;  // Raw ADC
+    uint8_t brightness;   // 0-100 %
+};
+
+struct HistoryStats {
+    uint32_t appended;    // Samples accepted since boot
+    uint32_t skipped;     // Samples without wall-clock time (clock not set yet)
+    uint32_t blocks;      // Blocks written since boot
+    uint32_t bytes;       // Bytes written since boot (data + index)
+    uint32_t writeErrors;
+    uint32_t segments;    // Segment files on flash
+    uint32_t maxSegments; // Segments the flash budget allows
+    uint32_t firstTime;   // Oldest sample on flash or in RAM, 0 = empty
+    uint32_t lastTime;    // Newest sample
+};
+
+// Return false to stop the query early
+typedef bool (*HistoryCallback)(const HistorySample &sample, void *context);
+
+// Pick up the segments already on the (mounted) file system. The history
+// keeps to budgetBytes of data (at least two segments), deleting the oldest
+// segments if an earlier boot was given more
+bool historyBegin(fs::FS &fs, size_t budgetBytes);
+
+// Add one sample. Samples taken before the clock was set are skipped,
+// the time of a sample must not go backwards
+void historyAppend(const TelemetrySample &sample);
+
+// Write the samples collected so far as a (short) block
+bool historyFlush();
+
+// Call cb for every sample with from <= unixTime <= to, oldest first
+// Returns the number of samples passed to cb, or -1 on a read error
+int historyQuery(uint32_t from, uint32_t to, HistoryCallback cb, void *context);
+
+void getHistoryStats(HistoryStats &stats);
+
+#endif
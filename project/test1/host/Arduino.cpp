@@ -0,0 +1,104 @@
+#include <Arduino.h>
+
+uint64_t hostMicros = 0;
+
+int hostPinLevel[HOST_PINS];
+void (*hostPinWritten)(int pin, int value) = NULL;
+int (*hostAnalogRead)(int pin) = NULL;
+
+static void (*pinIsr[HOST_PINS])() = {};
+
+// --- TIMER ---
+// Positions are kept in microseconds x frequency, so a tick that is not a
+// whole number of microseconds (320 kHz) does not drift over many reloads
+
+struct hw_timer_t {
+    uint64_t frequency;
+    uint64_t base;     // Position at which the count was 0
+    uint64_t alarm;    // Count at which the ISR runs
+    bool armed;
+    bool autoreload;   // Count back to 0 at the alarm, which stays armed
+    void (*isr)();
+};
+
+static hw_timer_t timer = {1000000, 0, 0, false, false, NULL};
+
+void (*hostIsrRunner)(void (*isr)()) = NULL;
+
+static void runIsr(void (*isr)()) {
+    if (hostIsrRunner != NULL) hostIsrRunner(isr);
+    else isr();
+}
+
+hw_timer_t *timerBegin(uint32_t frequency) {
+    timer.frequency = frequency;
+    timer.base = hostMicros * frequency;
+    timer.armed = false;
+    return &timer;
+}
+
+void timerAttachInterrupt(hw_timer_t *t, void (*isr)()) {
+    t->isr = isr;
+}
+
+void timerAlarm(hw_timer_t *t, uint64_t alarm, bool autoreload, uint64_t) {
+    t->alarm = alarm;
+    t->armed = true;
+    t->autoreload = autoreload;
+}
+
+void timerWrite(hw_timer_t *t, uint64_t value) {
+    t->base = hostMicros * t->frequency - value * 1000000;
+}
+
+uint64_t timerRead(hw_timer_t *t) {
+    return (hostMicros * t->frequency - t->base) / 1000000;
+}
+
+// First whole microsecond at which the count reaches the alarm
+static uint64_t alarmMicros(const hw_timer_t &t) {
+    return (t.base + t.alarm * 1000000 + t.frequency - 1) / t.frequency;
+}
+
+void hostAdvance(uint64_t us) {
+    uint64_t end = hostMicros + us;
+
+    // Each ISR run may arm the next one-shot alarm
+    while (timer.armed && timer.isr != NULL && alarmMicros(timer) <= end) {
+        uint64_t at = alarmMicros(timer);
+        if (at > hostMicros) hostMicros = at;
+        if (timer.autoreload) timer.base += timer.alarm * 1000000;
+        else timer.armed = false;
+        runIsr(timer.isr);
+    }
+    hostMicros = end;
+}
+
+// --- PINS ---
+
+void pinMode(int, int) {}
+
+void digitalWrite(int pin, int value) {
+    if (pin < 0 || pin >= HOST_PINS) return;
+    hostPinLevel[pin] = value;
+    if (hostPinWritten != NULL) hostPinWritten(pin, value);
+}
+
+int digitalRead(int pin) {
+    if (pin < 0 || pin >= HOST_PINS) return LOW;
+    return hostPinLevel[pin];
+}
+
+int analogRead(int pin) {
+    return hostAnalogRead != NULL ? hostAnalogRead(pin) : 0;
+}
+
+void attachInterrupt(int pin, void (*isr)(), int) {
+    if (pin >= 0 && pin < HOST_PINS) pinIsr[pin] = isr;
+}
+
+bool hostInterrupt(int pin) {
+    if (pin < 0 || pin >= HOST_PINS || pinIsr[pin] == NULL) return false;
+    runIsr(pinIsr[pin]);
+    return true;
+}
@@ -0,0 +1,128 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// --- HOST SHIM ---
+// Just enough of the ESP32 Arduino core to build the sketch's hardware-free
+// modules on Linux. Time only moves when a test calls hostAdvance(), so every
+// run is repeatable. Timer alarms and pin interrupts run from hostAdvance()
+// and hostInterrupt() on the test's thread, like ISRs on one core.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PROGMEM
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// --- TIME ---
+
+extern uint64_t hostMicros;
+
+inline unsigned long micros() { return (unsigned long)hostMicros; }
+inline unsigned long millis() { return (unsigned long)(hostMicros / 1000); }
+
+// Move the clock forward, running every timer alarm that falls due on the way
+void hostAdvance(uint64_t us);
+
+inline void delay(unsigned long ms) { hostAdvance((uint64_t)ms * 1000); }
+inline void delayMicroseconds(unsigned int us) { hostAdvance(us); }
+inline void yield() {}
+
+// --- STREAMS ---
+// What a library takes a port as. HardwareSerial.h has the UART behind it
+
+class Stream {
+public:
+    virtual ~Stream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+    virtual void flush() {}
+};
+
+// Console prints in library code (debug and search output) are dropped
+struct HostConsole {
+    template <typename T> void print(const T &) {}
+    template <typename T> void println(const T &) {}
+};
+
+inline HostConsole Serial;
+
+// --- PINS ---
+
+const int HOST_PINS = 64;
+extern int hostPinLevel[HOST_PINS];
+
+// Called on every digitalWrite(), NULL = only record the level
+extern void (*hostPinWritten)(int pin, int value);
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+
+// Every analogRead() returns what this gives for the pin, NULL = 0
+extern int (*hostAnalogRead)(int pin);
+
+int analogRead(int pin);
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+void attachInterrupt(int pin, void (*isr)(), int mode);
+
+// Run the ISR attached to a pin, false if there is none
+bool hostInterrupt(int pin);
+
+// Runs every pin and timer ISR when set, e.g. to time them. NULL = call them directly
+extern void (*hostIsrRunner)(void (*isr)());
+
+// --- TIMER ---
+// One general purpose timer at the frequency timerBegin() asks for, one-shot
+// or auto-reloading alarms (ESP32 core 3.x API)
+
+struct hw_timer_t;
+
+hw_timer_t *timerBegin(uint32_t frequency);
+void timerAttachInterrupt(hw_timer_t *timer, void (*isr)());
+void timerAlarm(hw_timer_t *timer, uint64_t alarm, bool autoreload, uint64_t reloadCount);
+void timerWrite(hw_timer_t *timer, uint64_t value);
+uint64_t timerRead(hw_timer_t *timer);
+
+// --- CRITICAL SECTIONS ---
+// The tests that run threads (sensor bus, light sensor) use lock-free code, the locks only have to compile
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+
+// Like the core, so a library that only includes Arduino.h sees the UART
+#include "HardwareSerial.h"
+
+#endif
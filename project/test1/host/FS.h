@@ -0,0 +1,77 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+// fs::FS and File on ordinary files, for modules that only take an fs::FS&.
+// Paths are taken relative to fs::root, a directory the test creates.
+// Only the calls the sketch's modules make are here
+
+#include <Arduino.h>
+#include <string>
+#include <sys/stat.h>
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// Directory the FS paths start in, e.g. "build/history_fs"
+extern std::string root;
+
+class File {
+public:
+    File() {}
+    explicit File(FILE *file) : file(file) {}
+
+    operator bool() const { return file != NULL; }
+
+    size_t write(const uint8_t *data, size_t length) { return fwrite(data, 1, length, file); }
+    size_t read(uint8_t *data, size_t length) { return fread(data, 1, length, file); }
+
+    bool seek(uint32_t position, SeekMode mode = SeekSet) {
+        int whence = mode == SeekCur ? SEEK_CUR : mode == SeekEnd ? SEEK_END : SEEK_SET;
+        return fseek(file, position, whence) == 0;
+    }
+
+    size_t position() const { return ftell(file); }
+
+    size_t size() const {
+        long at = ftell(file);
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, at, SEEK_SET);
+        return size;
+    }
+
+    void close() {
+        if (file != NULL) fclose(file);
+        file = NULL;
+    }
+
+private:
+    FILE *file = NULL;
+};
+
+class FS {
+public:
+    // LittleFS modes: "r", "w", "a", "r+", "w+", "a+"
+    File open(const char *path, const char *mode = "r", bool create = false) {
+        std::string m(mode);
+        if (m == "a") m = "a+";  // size() has to work on a file opened to append
+        m += "b";
+        return File(fopen((root + path).c_str(), m.c_str()));
+    }
+
+    bool exists(const char *path) {
+        struct stat st;
+        return stat((root + path).c_str(), &st) == 0;
+    }
+
+    bool remove(const char *path) { return ::remove((root + path).c_str()) == 0; }
+    bool mkdir(const char *path) { return ::mkdir((root + path).c_str(), 0755) == 0; }
+};
+
+}
+
+using fs::File;
+using fs::FS;
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include <Arduino.h>
+#include <deque>
+
+// --- HOST UART ---
+// Bytes written go to the transmitted hook at once, like a frame handed to
+// the TX FIFO. Received bytes are queued with the time their last bit
+// arrives and only become available() once the clock has reached it.
+
+class HardwareSerial : public Stream {
+public:
+    // Called from write(), a simulated device answers through receive()
+    void (*transmitted)(HardwareSerial &port, const uint8_t *data, size_t length, void *context) = NULL;
+    void *context = NULL;
+
+    void begin(unsigned long) {}
+    void setRxFIFOFull(uint8_t) {}
+
+    size_t write(const uint8_t *data, size_t length) override {
+        if (transmitted != NULL) transmitted(*this, data, length, context);
+        return length;
+    }
+
+    int available() override {
+        int n = 0;
+        for (const Byte &b : rx) {
+            if (b.at > hostMicros) break;
+            n++;
+        }
+        return n;
+    }
+
+    int read() override {
+        if (rx.empty() || rx.front().at > hostMicros) return -1;
+        int c = rx.front().value;
+        rx.pop_front();
+        return c;
+    }
+
+    void flush() override {}
+
+    // Queue bytes arriving back to back, the first one complete at 'at' (micros)
+    void receive(const uint8_t *data, size_t length, uint64_t at, uint64_t charMicros) {
+        for (size_t i = 0; i < length; i++) {
+            rx.push_back({at + i * charMicros, data[i]});
+        }
+    }
+
+private:
+    struct Byte {
+        uint64_t at;
+        uint8_t value;
+    };
+    std::deque<Byte> rx;
+};
+
+#endif
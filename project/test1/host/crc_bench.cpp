@@ -0,0 +1,121 @@
+// CRC-16/Modbus variants: bitwise, table, slice-by-4 and slice-by-8 agree on
+// every length and alignment, then time per byte for Modbus, PZEM and bulk sizes
+
+#include <CRC16Modbus.h>
+#include "host_test.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef uint16_t (*CrcFunction)(uint16_t crc, const uint8_t *data, size_t len);
+
+struct Variant {
+    const char *name;
+    CrcFunction fn;
+};
+
+static const Variant variants[] = {
+    {"bitwise", crc16ModbusBitwise},
+    {"table", crc16ModbusTable},
+    {"slice4", crc16ModbusSlice4},
+    {"slice8", crc16ModbusSlice8},
+};
+
+const size_t BUFFER = 4096 + 8;
+static uint8_t buffer[BUFFER];
+
+static void fill(uint32_t seed) {
+    uint32_t x = seed;
+    for (size_t i = 0; i < BUFFER; i++) {
+        x = x * 1664525 + 1013904223;
+        buffer[i] = x >> 24;
+    }
+}
+
+// --- CHECKS ---
+
+static void testKnownValues() {
+    const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    for (const Variant &v : variants) {
+        CHECK(v.fn(CRC16_MODBUS_INIT, check, sizeof(check)) == 0x4B37);
+        CHECK(v.fn(CRC16_MODBUS_INIT, check, 0) == CRC16_MODBUS_INIT);
+    }
+    CHECK(crc16Modbus(check, sizeof(check)) == 0x4B37);
+
+    // Read input registers 1-2 of slave 1, as the XY-MD02 is polled
+    const uint8_t request[] = {0x01, 0x04, 0x00, 0x01, 0x00, 0x02, 0x20, 0x0B};
+    CHECK(crc16Modbus(request, 6) == 0x0B20);
+    CHECK(crc16Modbus(request, sizeof(request)) == CRC16_MODBUS_RESIDUE);
+}
+
+// Every length up to 300 at every alignment within 8 bytes, on several buffers
+static void testAgreement() {
+    int bad = 0;
+    for (uint32_t seed = 1; seed <= 8; seed++) {
+        fill(seed);
+        for (size_t offset = 0; offset < 8; offset++) {
+            for (size_t len = 0; len <= 300; len++) {
+                const uint8_t *data = buffer + offset;
+                uint16_t expected = crc16ModbusBitwise(CRC16_MODBUS_INIT, data, len);
+                for (const Variant &v : variants) {
+                    if (v.fn(CRC16_MODBUS_INIT, data, len) != expected) {
+                        if (bad++ < 10) printf("%s: len %zu offset %zu differs\n", v.name, len, offset);
+                    }
+                }
+
+                // Byte by byte, as the receive paths fold it in
+                uint16_t crc = CRC16_MODBUS_INIT;
+                for (size_t i = 0; i < len; i++) crc = crc16ModbusUpdate(crc, data[i]);
+                if (crc != expected || crc16Modbus(data, len) != expected) bad++;
+
+                // A frame with its CRC appended checks to the residue
+                uint8_t frame[310];
+                memcpy(frame, data, len);
+                frame[len] = expected & 0xFF;
+                frame[len + 1] = expected >> 8;
+                if (crc16Modbus(frame, len + 2) != CRC16_MODBUS_RESIDUE) bad++;
+            }
+        }
+    }
+    CHECK(bad == 0);
+
+    // Continuing a CRC across a split gives the same result as one call
+    fill(99);
+    bad = 0;
+    uint16_t whole = crc16ModbusBitwise(CRC16_MODBUS_INIT, buffer, 1000);
+    for (size_t split = 0; split <= 1000; split += 7) {
+        for (const Variant &v : variants) {
+            if (v.fn(v.fn(CRC16_MODBUS_INIT, buffer, split), buffer + split, 1000 - split) != whole) bad++;
+        }
+    }
+    CHECK(bad == 0);
+}
+
+// --- BENCHMARK ---
+// A Modbus request (8 bytes), a PZEM reply (25 bytes) and bulk data, about
+// 16 MB through each variant per size. Calls are independent, so a PC overlaps
+// short ones and the per-byte chain of the table variant shows at the long sizes
+
+static void benchmark() {
+    const size_t sizes[] = {8, 25, 256, 4096};
+    fill(7);
+    for (size_t len : sizes) {
+        size_t iterations = (16u << 20) / len;
+        for (const Variant &v : variants) {
+            uint16_t sink = 0;
+            double t = wallNanos();
+            for (size_t i = 0; i < iterations; i++) {
+                sink ^= v.fn(CRC16_MODBUS_INIT, buffer + (i & 7), len);
+                keep(sink);
+            }
+            double ns = (wallNanos() - t) / ((double)iterations * len);
+            printf("bench: %4zu bytes %-8s %6.2f ns/byte %7.1f MB/s\n", len, v.name, ns, 1e3 / ns);
+        }
+    }
+}
+
+int main() {
+    testKnownValues();
+    testAgreement();
+    benchmark();
+    return hostTestResult("crc_bench");
+}
@@ -0,0 +1,178 @@
+// Daylight controller against a simulated room: daylight plus lamp light seen
+// through the sensor filter. Reports settle times for the shipped gains and
+// checks the hysteresis, anti-windup and skip behaviour
+
+#include "daylight_control.h"
+#include "dimmer_curves.h"
+#include "host_test.h"
+
+// controlTask period
+const uint32_t CONTROL_MS = 100;
+
+// Plant step (ms)
+const uint32_t PLANT_MS = 10;
+
+// --- ROOM ---
+// Readings are ADC counts, 0 = bright. The lamps at full power pull the reading
+// down by LAMP_SPAN. The lamp output follows the dimmer with a first order lag
+// (the 100 ms fade plus the driver), the sensor reading follows the light with
+// another one (the light sensor's running mean). Noise is a fixed pseudo random
+// sequence so every run is the same.
+
+const float LAMP_SPAN = 2000;
+const float LAMP_TAU_MS = 150;
+const float SENSOR_TAU_MS = 250;
+const int NOISE = 12;
+
+struct Room {
+    float daylight;  // Reading with the lamps off
+    float lamp;      // Lamp light, 0 - 1
+    float reading;   // Filtered sensor reading
+    int level;       // Dimmer level commanded
+    uint32_t noise;
+};
+
+static Room room;
+
+static int sensorReading() {
+    room.noise = room.noise * 1103515245 + 12345;
+    int n = (int)((room.noise >> 16) % (2 * NOISE + 1)) - NOISE;
+    return constrain((int)(room.reading + 0.5f) + n, 0, 4095);
+}
+
+static void plantStep() {
+    float target = (float)room.level / DIMMER_LEVELS;
+    room.lamp += (target - room.lamp) * PLANT_MS / LAMP_TAU_MS;
+    float light = room.daylight - LAMP_SPAN * room.lamp;
+    room.reading += (light - room.reading) * PLANT_MS / SENSOR_TAU_MS;
+    hostAdvance(PLANT_MS * 1000);
+}
+
+// --- RUN ---
+
+struct Run {
+    uint32_t settleMs;   // Last time the reading was outside the band, from the start
+    int reversals;       // Output direction changes after settling (hunting)
+};
+
+static Run simulate(uint32_t durationMs) {
+    Run r = {0, 0};
+    bool entered = false;
+    int lastStep = 0;
+    uint32_t start = millis();
+
+    for (uint32_t t = 0; t < durationMs; t += CONTROL_MS) {
+        for (uint32_t p = 0; p < CONTROL_MS; p += PLANT_MS) plantStep();
+
+        int reading = sensorReading();
+        int level = daylightControlUpdate(reading, millis());
+        if (level >= 0) {
+            int step = level - room.level;
+            if (entered && step != 0 && lastStep != 0 && (step > 0) != (lastStep > 0)) r.reversals++;
+            if (step != 0) lastStep = step;
+            room.level = level;
+        }
+
+        int error = abs((int)room.reading - DAYLIGHT_SETPOINT);
+        if (error > DAYLIGHT_HYSTERESIS) {
+            r.settleMs = millis() - start;
+            r.reversals = 0;
+        } else {
+            entered = true;
+        }
+    }
+    return r;
+}
+
+static void reset(float daylight) {
+    initDaylightControl();
+    room = {daylight, 0, daylight, 0, 1};
+}
+
+static void report(const char *what, const Run &r) {
+    printf("sim: %-28s settled after %5.1f s, %d reversals since\n", what, r.settleMs / 1000.0, r.reversals);
+}
+
+// Dark room, lamps start off: they have to supply most of the light
+static void testFromDark() {
+    reset(3400);
+    Run r = simulate(60000);
+    report("dark room from off", r);
+    CHECK(r.settleMs < 15000);
+    CHECK(r.reversals <= 2);
+    CHECK(abs((int)room.reading - DAYLIGHT_SETPOINT) <= DAYLIGHT_HYSTERESIS);
+}
+
+// A cloud darkens the room, then clears
+static void testCloud() {
+    reset(2600);
+    simulate(60000);
+
+    room.daylight = 3300;
+    Run r = simulate(60000);
+    report("cloud (+700 counts)", r);
+    CHECK(r.settleMs < 10000);
+
+    room.daylight = 2600;
+    r = simulate(60000);
+    report("cloud clears (-700 counts)", r);
+    CHECK(r.settleMs < 10000);
+}
+
+// Bright sun holds the output at 0 for minutes. Without anti-windup the
+// integral would run away and the lamps would come on late at dusk
+static void testWindup() {
+    reset(600);
+    simulate(600000);
+    CHECK(room.level == 0);
+
+    DaylightStats stats;
+    getDaylightStats(stats);
+    CHECK(stats.integral <= 0 && stats.integral >= -DIMMER_LEVELS);
+
+    room.daylight = 3200;
+    Run r = simulate(60000);
+    report("sun to dusk after 10 min", r);
+    CHECK(r.settleMs < 15000);
+}
+
+// Once settled, most control periods should not recompute anything
+static void testSkips() {
+    reset(2800);
+    simulate(60000);
+
+    DaylightStats before;
+    getDaylightStats(before);
+    simulate(600000);
+    DaylightStats after;
+    getDaylightStats(after);
+
+    uint32_t updates = after.updates - before.updates;
+    uint32_t skipped = after.skipped - before.skipped;
+    printf("sim: steady 10 min: %u updates, %u skipped (%.0f %%)\n",
+           updates, skipped, 100.0 * skipped / (updates + skipped));
+    CHECK(skipped > 9 * updates);
+}
+
+// The output never moves faster than the rate limit
+static void testRateLimit() {
+    reset(4000);
+    int last = 0;
+    int maxStep = 0;
+    for (int i = 0; i < 100; i++) {
+        simulate(CONTROL_MS);
+        maxStep = max(maxStep, abs(room.level - last));
+        last = room.level;
+    }
+    CHECK(maxStep <= (int)(DAYLIGHT_MAX_RATE * CONTROL_MS / 1000) + 1);
+}
+
+int main() {
+    testFromDark();
+    testCloud();
+    testWindup();
+    testSkips();
+    testRateLimit();
+
+    return hostTestResult("daylight_sim");
+}
@@ -0,0 +1,204 @@
+// Dimmer engine on simulated mains: zero-cross edges run the ISRs and every
+// gate pulse is checked against the firing phase the curves give
+
+#include "dimmer.h"
+#include "zero_cross.h"
+#include "host_test.h"
+
+// Wiring in dimmer.cpp
+const int ZERO_CROSS_PIN = 14;
+const int GATE_PINS[] = {13, 12};
+const int CHANNELS = 2;
+
+const int PULSE_MICROS = 10;   // TRIAC_PULSE_MICROS
+const int MERGE_MICROS = 3;    // EVENT_MERGE_MICROS, events this close fire together
+
+// --- GATE RECORDER ---
+// Pulses of the last half-cycle, times relative to its zero-cross
+
+struct Pulse {
+    int count;        // Rising edges
+    int64_t on;       // Of the last pulse, -1 = none
+    int64_t off;
+};
+
+static Pulse pulses[CHANNELS];
+static uint64_t edgeAt = 0;
+static bool highAtEdge = false;  // A gate was still HIGH when the half-cycle ended
+
+static void onPinWritten(int pin, int value) {
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        if (pin != GATE_PINS[ch]) continue;
+        int64_t t = (int64_t)(hostMicros - edgeAt);
+        if (value == HIGH) {
+            pulses[ch].count++;
+            pulses[ch].on = t;
+            pulses[ch].off = -1;
+        } else if (pulses[ch].on >= 0 && pulses[ch].off < 0) {
+            pulses[ch].off = t;
+        }
+    }
+}
+
+// One half-cycle of 'period' microseconds starting with its zero-cross edge
+static void halfCycle(uint64_t period) {
+    highAtEdge = false;
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        if (hostPinLevel[GATE_PINS[ch]] == HIGH) highAtEdge = true;
+        pulses[ch] = {0, -1, -1};
+    }
+    edgeAt = hostMicros;
+    hostInterrupt(ZERO_CROSS_PIN);
+    hostAdvance(period);
+}
+
+static void run(int halfCycles, uint64_t period) {
+    for (int i = 0; i < halfCycles; i++) halfCycle(period);
+}
+
+// Expected firing time of a level on this half-cycle length
+static int64_t firingTime(int level, uint64_t period) {
+    return (int64_t)dimmerCurvePhase(DIMMER_CURVE_LINEAR_POWER, level) * period / ZC_NOMINAL_HALF_PERIOD;
+}
+
+static bool firedAt(int ch, int64_t expected) {
+    const Pulse &p = pulses[ch];
+    return p.count == 1 && p.on >= expected - MERGE_MICROS && p.on <= expected + MERGE_MICROS &&
+           p.off - p.on >= PULSE_MICROS - MERGE_MICROS && p.off - p.on <= PULSE_MICROS + MERGE_MICROS;
+}
+
+static void testLock() {
+    run(ZC_LOCK_EDGES + 4, 10000);
+    ZeroCrossStats zc;
+    getZeroCrossStats(zc);
+    CHECK(zc.locked);
+    CHECK(zc.halfPeriodMicros == 10000);
+    CHECK(pulses[0].count == 0 && pulses[1].count == 0);
+}
+
+static void testFiring() {
+    // Commands take effect at the next zero-cross
+    setDimmerLevel(1, 500);
+    setDimmerLevel(2, DIMMER_LEVELS);
+    CHECK(pulses[0].count == 0);
+    halfCycle(10000);
+    CHECK(firedAt(0, firingTime(500, 10000)));
+    CHECK(firedAt(1, firingTime(DIMMER_LEVELS, 10000)));
+
+    // The schedule repeats every half-cycle without new commands
+    for (int i = 0; i < 5; i++) {
+        halfCycle(10000);
+        CHECK(firedAt(0, firingTime(500, 10000)));
+        CHECK(firedAt(1, firingTime(DIMMER_LEVELS, 10000)));
+        CHECK(!highAtEdge);
+    }
+
+    // Both channels at the same level: both fire, from one timer
+    setDimmerLevel(2, 500);
+    halfCycle(10000);
+    CHECK(firedAt(0, firingTime(500, 10000)));
+    CHECK(firedAt(1, firingTime(500, 10000)));
+
+    // Off means no pulse at all
+    setDimmerLevel(1, 0);
+    halfCycle(10000);
+    CHECK(pulses[0].count == 0);
+    CHECK(firedAt(1, firingTime(500, 10000)));
+
+    // Every level lands where the curve puts it
+    for (int level = 1; level <= DIMMER_LEVELS; level += 37) {
+        setDimmerLevel(1, level);
+        halfCycle(10000);
+        CHECK(firedAt(0, firingTime(level, 10000)));
+    }
+}
+
+static void testNoise() {
+    setDimmerLevel(1, 300);
+    halfCycle(10000);
+
+    // A spike a third into the half-cycle must not restart the schedule
+    edgeAt = hostMicros;
+    pulses[0] = {0, -1, -1};
+    hostInterrupt(ZERO_CROSS_PIN);
+    hostAdvance(3000);
+    hostInterrupt(ZERO_CROSS_PIN);
+    hostAdvance(7000);
+    CHECK(firedAt(0, firingTime(300, 10000)));
+
+    ZeroCrossStats zc;
+    getZeroCrossStats(zc);
+    CHECK(zc.glitches > 0);
+    CHECK(zc.locked);
+}
+
+static void testSixtyHertz() {
+    // Firing points stretch with the measured half-cycle
+    const uint64_t period = 8333;
+    run(60, period);
+    ZeroCrossStats zc;
+    getZeroCrossStats(zc);
+    CHECK(zc.locked);
+
+    setDimmerLevel(1, 400);
+    setDimmerLevel(2, 900);
+    halfCycle(period);
+    CHECK(firedAt(0, firingTime(400, zc.halfPeriodMicros)));
+    CHECK(firedAt(1, firingTime(900, zc.halfPeriodMicros)));
+    CHECK(pulses[0].off < (int64_t)period);
+
+    run(60, 10000);
+}
+
+static void testFade() {
+    setDimmerLevel(2, DIMMER_LEVELS);
+    halfCycle(10000);
+
+    // 50 ms at 50 Hz is 5 half-cycles, each firing later than the one before
+    fadeDimmerTo(2, 0, 50, DIMMER_CURVE_LINEAR_POWER);
+    int64_t last = -1;
+    for (int i = 0; i < 4; i++) {
+        halfCycle(10000);
+        CHECK(dimmerFading(2));
+        CHECK(pulses[1].count == 1);
+        CHECK(pulses[1].on > last);
+        last = pulses[1].on;
+    }
+    halfCycle(10000);
+    CHECK(!dimmerFading(2));
+    CHECK(getDimmerLevel(2) == 0);
+    CHECK(pulses[1].count == 0);
+
+    // A new level replaces a running fade from where it got to
+    fadeDimmerTo(2, DIMMER_LEVELS, 100, DIMMER_CURVE_LINEAR_POWER);
+    run(3, 10000);
+    int midway = getDimmerLevel(2);
+    CHECK(midway > 0 && midway < DIMMER_LEVELS);
+    setDimmerLevel(2, 250);
+    halfCycle(10000);
+    CHECK(!dimmerFading(2));
+    CHECK(firedAt(1, firingTime(250, 10000)));
+}
+
+static void printStats() {
+    DimmerStats stats;
+    getDimmerStats(stats);
+    ZeroCrossStats zc;
+    getZeroCrossStats(zc);
+    printf("sim: %u half-cycles, %u timer interrupts, %u glitches, %u relocks\n",
+           stats.zeroCrosses, stats.timerInterrupts, zc.glitches, zc.relocks);
+}
+
+int main() {
+    hostPinWritten = onPinWritten;
+    initializeDimmers();
+
+    testLock();
+    testFiring();
+    testNoise();
+    testSixtyHertz();
+    testFade();
+    printStats();
+
+    return hostTestResult("dimmer_sim");
+}
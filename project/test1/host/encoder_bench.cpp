@@ -0,0 +1,303 @@
+// Fixed-buffer telemetry encoder against the JsonDocument + String path the
+// uploaders used before it: same documents, then bytes, allocations and time
+
+#include "telemetry_encoder.h"
+#include "timestamp.h"
+#include "host_test.h"
+#include <ArduinoJson.h>
+#include <string>
+#include <new>
+
+// telemetry_queue.cpp needs WiFi and LittleFS, the encoder only wants this from it
+uint32_t telemetrySampleTime(const TelemetrySample &sample) {
+    return sample.unixTime;
+}
+
+// --- ALLOCATION COUNTING ---
+// Everything the old path allocated went through new (String) or the JsonDocument allocator
+
+static uint64_t allocations = 0;
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size);
+    if (p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+struct CountingAllocator : ArduinoJson::Allocator {
+    void *allocate(size_t size) override {
+        allocations++;
+        return malloc(size);
+    }
+    void deallocate(void *p) override {
+        free(p);
+    }
+    void *reallocate(void *p, size_t size) override {
+        allocations++;
+        return realloc(p, size);
+    }
+};
+
+static CountingAllocator allocator;
+
+const char *DEVICE = "ESP32S3_IoT";
+const char *PROJECT = "e-smarthome-62391";
+
+// --- OLD PATH ---
+// sendDataToFirebase() and addSampleWrite() as they were, with std::string for String
+
+static std::string formatTime(uint32_t unixTime, const char *format, bool local) {
+    time_t t = unixTime + (local ? 25200 : 0);
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), format, gmtime(&t));
+    return std::string(buffer);
+}
+
+static std::string jsonRtdb(const TelemetrySample &s) {
+    float temperature = s.temperature / 10.0f;
+    float humidity = s.humidity / 10.0f;
+    float voltage = s.voltage / 10.0f;
+    float current = s.current / 1000.0f;
+    float power = s.power / 10.0f;
+    float energy = s.energy / 1000.0f;
+    float frequency = s.frequency / 10.0f;
+    float pf = s.pf / 100.0f;
+
+    JsonDocument doc(&allocator);
+    doc["timestamp"] = formatTime(s.unixTime, "%Y-%m-%d %H:%M:%S", true);
+    doc["unix_time"] = (unsigned long)s.unixTime;
+
+    JsonObject environment = doc["environment"].to<JsonObject>();
+    environment["temperature"] = round(temperature * 10) / 10.0;
+    environment["humidity"] = round(humidity * 10) / 10.0;
+    environment["connected"] = (bool)(s.flags & SAMPLE_ENV_CONNECTED);
+
+    JsonObject p = doc["power"].to<JsonObject>();
+    p["voltage"] = round(voltage * 10) / 10.0;
+    p["current"] = round(current * 100) / 100.0;
+    p["power"] = round(power * 10) / 10.0;
+    p["energy"] = round(energy * 1000) / 1000.0;
+    p["frequency"] = round(frequency * 10) / 10.0;
+    p["pf"] = round(pf * 100) / 100.0;
+    p["connected"] = (bool)(s.flags & SAMPLE_PZEM_CONNECTED);
+
+    JsonObject lighting = doc["lighting"].to<JsonObject>();
+    lighting["light_level"] = s.lightLevel;
+    lighting["auto_brightness"] = s.brightness;
+    lighting["dimmer1"] = s.brightness;
+    lighting["dimmer2"] = s.brightness;
+
+    JsonObject system = doc["system"].to<JsonObject>();
+    system["device"] = DEVICE;
+    system["free_heap"] = s.freeHeap;
+    system["wifi_rssi"] = s.rssi;
+
+    std::string json;
+    serializeJson(doc, json);
+    return json;
+}
+
+static void addDouble(JsonObject fields, const char *name, double value) {
+    fields[name].to<JsonObject>()["doubleValue"] = value;
+}
+
+static void addInteger(JsonObject fields, const char *name, long value) {
+    fields[name].to<JsonObject>()["integerValue"] = std::to_string(value);
+}
+
+static void addBoolean(JsonObject fields, const char *name, bool value) {
+    fields[name].to<JsonObject>()["booleanValue"] = value;
+}
+
+static JsonObject addMap(JsonObject fields, const char *name) {
+    return fields[name].to<JsonObject>()["mapValue"].to<JsonObject>()["fields"].to<JsonObject>();
+}
+
+static void addSampleWrite(JsonArray writes, const TelemetrySample &s) {
+    char name[160];
+    snprintf(name, sizeof(name), "projects/%s/databases/(default)/documents/sensorLogs/%s-%lu",
+             PROJECT, DEVICE, (unsigned long)s.unixTime);
+
+    JsonObject update = writes.add<JsonObject>()["update"].to<JsonObject>();
+    update["name"] = name;
+    JsonObject fields = update["fields"].to<JsonObject>();
+    fields["timestamp"].to<JsonObject>()["timestampValue"] = formatTime(s.unixTime, "%Y-%m-%dT%H:%M:%SZ", false);
+    fields["local_time"].to<JsonObject>()["stringValue"] = formatTime(s.unixTime, "%Y-%m-%d %H:%M:%S", true);
+
+    JsonObject env = addMap(fields, "environment");
+    addDouble(env, "temperature", s.temperature / 10.0);
+    addDouble(env, "humidity", s.humidity / 10.0);
+    addBoolean(env, "connected", s.flags & SAMPLE_ENV_CONNECTED);
+
+    JsonObject power = addMap(fields, "power");
+    addDouble(power, "voltage", s.voltage / 10.0);
+    addDouble(power, "current", round(s.current / 10.0) / 100.0);
+    addDouble(power, "power", s.power / 10.0);
+    addDouble(power, "energy", s.energy / 1000.0);
+    addDouble(power, "frequency", s.frequency / 10.0);
+    addDouble(power, "pf", s.pf / 100.0);
+    addBoolean(power, "connected", s.flags & SAMPLE_PZEM_CONNECTED);
+
+    JsonObject lighting = addMap(fields, "lighting");
+    addInteger(lighting, "light_level", s.lightLevel);
+    addInteger(lighting, "auto_brightness", s.brightness);
+    addInteger(lighting, "dimmer1", s.brightness);
+    addInteger(lighting, "dimmer2", s.brightness);
+
+    JsonObject system = addMap(fields, "system");
+    system["device"].to<JsonObject>()["stringValue"] = DEVICE;
+    addInteger(system, "free_heap", s.freeHeap);
+    addInteger(system, "wifi_rssi", s.rssi);
+    addInteger(system, "uptime_s", s.uptimeSec);
+}
+
+static std::string jsonCommit(const TelemetrySample *samples, int count) {
+    JsonDocument doc(&allocator);
+    JsonArray writes = doc["writes"].to<JsonArray>();
+    for (int i = 0; i < count; i++) {
+        addSampleWrite(writes, samples[i]);
+    }
+    std::string json;
+    serializeJson(doc, json);
+    return json;
+}
+
+// --- CHECKS ---
+
+static TelemetrySample makeSample(int i) {
+    TelemetrySample s;
+    memset(&s, 0, sizeof(s));
+    s.unixTime = 1760000000 + 300 * i;
+    s.uptimeSec = 3600 + 300 * i;
+    s.temperature = 231 + i % 40;
+    s.humidity = 552 + i % 100;
+    s.voltage = 2298 + i % 30;
+    s.frequency = 500;
+    // No half-centiamp ties: the float path rounded those either way (2.235 A -> 2.23)
+    s.current = 1234 + 10 * i;
+    s.power = 2755 + i;
+    s.energy = 123456 + i;
+    s.lightLevel = 1500 + i % 900;
+    s.brightness = i % 101;
+    s.pf = 96;
+    s.flags = SAMPLE_ENV_CONNECTED | SAMPLE_PZEM_CONNECTED;
+    s.rssi = -61;
+    s.freeHeap = 201344;
+    return s;
+}
+
+// Same structure and values. Numbers are compared with a tolerance, the parser
+// keeps some as float, so "1.30" and "1.3" need not come out identical
+static bool sameValue(JsonVariantConst a, JsonVariantConst b) {
+    if (a.is<JsonObjectConst>()) {
+        JsonObjectConst x = a, y = b;
+        if (y.isNull() || x.size() != y.size()) return false;
+        for (JsonPairConst kv : x) {
+            if (!y[kv.key()].isUnbound() && sameValue(kv.value(), y[kv.key()])) continue;
+            return false;
+        }
+        return true;
+    }
+    if (a.is<JsonArrayConst>()) {
+        JsonArrayConst x = a, y = b;
+        if (y.isNull() || x.size() != y.size()) return false;
+        for (size_t i = 0; i < x.size(); i++) {
+            if (!sameValue(x[i], y[i])) return false;
+        }
+        return true;
+    }
+    if (a.is<double>() && b.is<double>() && !a.is<bool>()) {
+        double x = a.as<double>(), y = b.as<double>();
+        return fabs(x - y) <= 1e-6 * fmax(1.0, fabs(x));
+    }
+    return a == b;
+}
+
+static bool sameJson(const char *a, const std::string &b) {
+    JsonDocument x, y;
+    if (deserializeJson(x, a) || deserializeJson(y, b)) return false;
+    return sameValue(x.as<JsonVariantConst>(), y.as<JsonVariantConst>());
+}
+
+static void testSameDocuments() {
+    char buffer[TELEMETRY_FIRESTORE_COMMIT_OVERHEAD + 4 * TELEMETRY_FIRESTORE_WRITE_MAX];
+    for (int i = 0; i < 200; i++) {
+        TelemetrySample s = makeSample(i);
+        CHECK(encodeRtdbPayload(buffer, TELEMETRY_RTDB_MAX, s, DEVICE) > 0);
+        CHECK(sameJson(buffer, jsonRtdb(s)));
+    }
+
+    TelemetrySample batch[4];
+    for (int i = 0; i < 4; i++) batch[i] = makeSample(i);
+    CHECK(encodeFirestoreCommit(buffer, sizeof(buffer), batch, 4, PROJECT, DEVICE) > 0);
+    CHECK(sameJson(buffer, jsonCommit(batch, 4)));
+
+    // Too small a buffer is refused, never truncated
+    CHECK(encodeRtdbPayload(buffer, 64, makeSample(0), DEVICE) == 0);
+}
+
+// --- BENCHMARK ---
+
+const int ROUNDS = 20000;
+const int BATCH = 10;  // FIRESTORE_BATCH_SIZE
+
+static void report(const char *what, double nanos, uint64_t allocs, size_t bytes) {
+    printf("bench: %-26s %8.0f ns %6.1f allocs %5zu bytes\n", what, nanos / ROUNDS, (double)allocs / ROUNDS, bytes);
+}
+
+static void benchmark() {
+    static TelemetrySample samples[BATCH];
+    for (int i = 0; i < BATCH; i++) samples[i] = makeSample(i);
+
+    static char buffer[TELEMETRY_FIRESTORE_COMMIT_OVERHEAD + BATCH * TELEMETRY_FIRESTORE_WRITE_MAX];
+    size_t bytes = 0;
+
+    uint64_t a = allocations;
+    double t = wallNanos();
+    for (int i = 0; i < ROUNDS; i++) {
+        bytes = encodeRtdbPayload(buffer, TELEMETRY_RTDB_MAX, samples[i % BATCH], DEVICE);
+        keep(buffer[0]);
+    }
+    report("RTDB encoder", wallNanos() - t, allocations - a, bytes);
+    uint64_t encoderAllocs = allocations - a;
+
+    a = allocations;
+    t = wallNanos();
+    for (int i = 0; i < ROUNDS; i++) {
+        bytes = jsonRtdb(samples[i % BATCH]).size();
+    }
+    report("RTDB JsonDocument", wallNanos() - t, allocations - a, bytes);
+
+    a = allocations;
+    t = wallNanos();
+    for (int i = 0; i < ROUNDS; i++) {
+        bytes = encodeFirestoreCommit(buffer, sizeof(buffer), samples, BATCH, PROJECT, DEVICE);
+        keep(buffer[0]);
+    }
+    report("Firestore x10 encoder", wallNanos() - t, allocations - a, bytes);
+    encoderAllocs += allocations - a;
+
+    a = allocations;
+    t = wallNanos();
+    for (int i = 0; i < ROUNDS; i++) {
+        bytes = jsonCommit(samples, BATCH).size();
+    }
+    report("Firestore x10 JsonDocument", wallNanos() - t, allocations - a, bytes);
+
+    CHECK(encoderAllocs == 0);
+}
+
+int main() {
+    testSameDocuments();
+    benchmark();
+    return hostTestResult("encoder_bench");
+}
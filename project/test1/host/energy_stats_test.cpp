@@ -0,0 +1,221 @@
+// Energy aggregates: hand-worked windows for a steady load, then a long
+// random run against a double precision reference, then add() throughput
+
+#include "energy_stats.h"
+#include "host_test.h"
+#include <map>
+
+const unsigned long STEP_MS = PZEM_READ_INTERVAL;
+
+static PzemData reading(float voltage, float current, float power, float pf, bool connected = true) {
+    PzemData d = {voltage, current, power, 0, 50, pf, connected};
+    return d;
+}
+
+// One reading every step for durationMs, the first one step from now
+static void feed(const PzemData &d, unsigned long durationMs, unsigned long stepMs = STEP_MS) {
+    for (unsigned long t = 0; t < durationMs; t += stepMs) {
+        hostAdvance(stepMs * 1000);
+        energyStatsAdd(d, millis());
+    }
+}
+
+static EnergyWindow lastMinute() {
+    EnergyWindow w[1];
+    memset(w, 0, sizeof(w));
+    energyStatsMinutes(w, 1);
+    return w[0];
+}
+
+// --- STEADY LOAD ---
+// Readings sit 250 ms off the minute boundaries, so each one falls wholly
+// inside a window. A window closes with the first reading after it
+
+// 500 W for three minutes: 8333 mWh a minute
+static void testSteadyLoad() {
+    hostAdvance(59750 * 1000ULL);
+    PzemData load = reading(230.0f, 2.174f, 500.0f, 0.95f);
+    energyStatsAdd(load, millis());  // Only sets the starting point
+
+    feed(load, 3 * 60000);
+    EnergyWindow w[2];
+    CHECK(energyStatsMinutes(w, 2) == 2);
+    for (int i = 0; i < 2; i++) {
+        CHECK(w[i].uptimeSec == (uint32_t)(60 + 60 * i));
+        CHECK(w[i].samples == 120);
+        CHECK(w[i].durationMs == 60000);
+        CHECK(w[i].voltageMin == 2300 && w[i].voltageMax == 2300 && w[i].voltageMean == 2300);
+        CHECK(w[i].currentMin == 2174 && w[i].currentMax == 2174 && w[i].currentMean == 2174);
+        CHECK(w[i].powerMin == 5000 && w[i].powerMax == 5000 && w[i].powerMean == 5000);
+        CHECK(w[i].pfMin == 95 && w[i].pfMax == 95 && w[i].pfMean == 95);
+        CHECK(w[i].energy == 8333);
+    }
+
+    // The upload interval covers all three minutes, and starts over when taken
+    EnergyWindow interval;
+    CHECK(energyStatsTake(interval));
+    CHECK(interval.samples == 360);
+    CHECK(interval.durationMs == 180000);
+    CHECK(interval.powerMean == 5000);
+    CHECK(interval.energy == 25000);
+    CHECK(!energyStatsTake(interval));
+
+    TelemetrySample sample;
+    memset(&sample, 0, sizeof(sample));
+    applyEnergyWindow(sample, interval);
+    CHECK(sample.flags & SAMPLE_POWER_AGGREGATED);
+    CHECK(sample.power == 5000 && sample.powerMax == 5000 && sample.intervalEnergy == 25000);
+    CHECK(sample.voltage == 2300 && sample.current == 2174 && sample.pf == 95);
+}
+
+// 100 W for half a minute, 900 W for the other half
+static void testMinMax() {
+    feed(reading(230.0f, 0.5f, 100.0f, 0.5f), 30000);
+    feed(reading(230.0f, 4.0f, 900.0f, 0.99f), 30000);
+    feed(reading(0, 0, 0, 0, false), STEP_MS);  // Closes the minute, adds nothing
+
+    EnergyWindow w = lastMinute();
+    CHECK(w.uptimeSec == 240);
+    CHECK(w.samples == 120);
+    CHECK(w.powerMin == 1000 && w.powerMax == 9000);
+    CHECK(w.powerMean == 5000);
+    CHECK(w.currentMin == 500 && w.currentMax == 4000);
+    CHECK(w.pfMin == 50 && w.pfMax == 99);
+    CHECK(w.energy == 8333);
+}
+
+// Disconnected readings and long silences add no time. The first reading
+// after either only sets the starting point
+static void testGaps() {
+    PzemData load = reading(230.0f, 1.0f, 200.0f, 0.9f);
+    feed(reading(0, 0, 0, 0, false), 10000 - STEP_MS);
+    feed(load, 30000);
+    hostAdvance((ENERGY_MAX_GAP_MS + 1000) * 1000);
+    feed(load, 15000);
+    feed(reading(0, 0, 0, 0, false), 2500);
+
+    EnergyWindow w = lastMinute();
+    CHECK(w.uptimeSec == 300);
+    CHECK(w.samples == 59 + 29);
+    CHECK(w.durationMs == 29500 + 14500);
+    CHECK(w.powerMean == 2000);
+    CHECK(w.energy == 2444);  // 200 W for 44 s
+}
+
+// --- REFERENCE ---
+// The same windows worked out with doubles from the raw readings
+
+struct Reference {
+    uint32_t samples;
+    uint32_t durationMs;
+    double energy;      // mWh
+    double power;       // W x ms
+    float powerMin, powerMax;
+};
+
+static std::map<uint32_t, Reference> refMinutes, refHours;
+
+static void refAdd(std::map<uint32_t, Reference> &ref, uint32_t start, float power, uint32_t dt) {
+    Reference &r = ref[start];
+    if (r.samples == 0) {
+        r.powerMin = power;
+        r.powerMax = power;
+    }
+    r.samples++;
+    r.durationMs += dt;
+    r.energy += power * dt / 3600.0;
+    r.power += power * dt;
+    r.powerMin = fmin(r.powerMin, power);
+    r.powerMax = fmax(r.powerMax, power);
+}
+
+static bool matches(const EnergyWindow &w, const Reference &r) {
+    return w.samples == r.samples && w.durationMs == r.durationMs &&
+           fabs(w.energy - r.energy) <= 1.0 &&
+           fabs(w.powerMean - r.power / r.durationMs * 10) <= 1.0 &&
+           w.powerMin == (uint32_t)lroundf(r.powerMin * 10) && w.powerMax == (uint32_t)lroundf(r.powerMax * 10);
+}
+
+// Six hours of a load that changes every few seconds, with dropouts and stalls
+static void testAgainstReference() {
+    // Start clean on an hour boundary so every window is compared whole
+    uint32_t start = (millis() / 3600000 + 1) * 3600000;
+    feed(reading(0, 0, 0, 0, false), start - millis());
+
+    uint32_t x = 12345;
+    float power = 300;
+    bool connected = true;
+    bool haveLast = false;
+    uint32_t lastMs = 0;
+    while (millis() < start + 6 * 3600000) {
+        x = x * 1664525 + 1013904223;
+        uint32_t step = STEP_MS;
+        if ((x >> 8) % 500 == 0) step += 2000 + (x >> 20) % 4000;     // Bus stalls
+        if ((x >> 12) % 40 == 0) power = ((x >> 16) % 25000) / 10.0f; // New load, 0.1 W steps
+        if ((x >> 4) % 300 == 0) connected = !connected;              // Meter drops out
+
+        hostAdvance(step * 1000ULL);
+        uint32_t now = millis();
+        energyStatsAdd(reading(230.0f, power / 230.0f, power, 0.9f, connected), now);
+
+        if (!connected) {
+            haveLast = false;
+            continue;
+        }
+        if (haveLast && now - lastMs <= ENERGY_MAX_GAP_MS) {
+            refAdd(refMinutes, now - now % 60000, power, now - lastMs);
+            refAdd(refHours, now - now % 3600000, power, now - lastMs);
+        }
+        haveLast = true;
+        lastMs = now;
+    }
+    feed(reading(230.0f, 1.0f, 230.0f, 0.9f), STEP_MS);  // Closes the last hour
+
+    EnergyWindow minutes[ENERGY_MINUTES];
+    int n = energyStatsMinutes(minutes, ENERGY_MINUTES);
+    CHECK(n == ENERGY_MINUTES);
+    int bad = 0;
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && minutes[i].uptimeSec != minutes[i - 1].uptimeSec + 60) bad++;
+        auto r = refMinutes.find(minutes[i].uptimeSec * 1000);
+        if (r == refMinutes.end() ? minutes[i].samples != 0 : !matches(minutes[i], r->second)) bad++;
+    }
+    CHECK(bad == 0);
+
+    EnergyWindow hours[ENERGY_HOURS];
+    int h = energyStatsHours(hours, ENERGY_HOURS);
+    bad = 0;
+    int compared = 0;
+    for (int i = 0; i < h; i++) {
+        if (hours[i].uptimeSec * 1000 < start) continue;
+        auto r = refHours.find(hours[i].uptimeSec * 1000);
+        if (r == refHours.end() || !matches(hours[i], r->second)) bad++;
+        compared++;
+    }
+    CHECK(compared == 6);
+    CHECK(bad == 0);
+}
+
+// --- BENCHMARK ---
+
+static void benchmark() {
+    const int ADDS = 5000000;
+    PzemData d = reading(230.0f, 1.0f, 230.0f, 0.9f);
+    double t = wallNanos();
+    for (int i = 0; i < ADDS; i++) {
+        hostMicros += STEP_MS * 1000;
+        d.power = 200.0f + (i & 127);
+        energyStatsAdd(d, millis());
+    }
+    double ns = (wallNanos() - t) / ADDS;
+    printf("bench: energyStatsAdd() %.1f ns per reading, %.1f M readings/s\n", ns, 1000.0 / ns);
+}
+
+int main() {
+    testSteadyLoad();
+    testMinMax();
+    testGaps();
+    testAgainstReference();
+    benchmark();
+    return hostTestResult("energy_stats_test");
+}
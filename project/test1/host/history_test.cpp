@@ -0,0 +1,253 @@
+// Flash history on ordinary files: samples read back exactly after a reboot,
+// a torn index entry and segment rotation, then bytes per sample and timings
+
+#include "history_log.h"
+#include "host_test.h"
+#include <filesystem>
+#include <vector>
+
+std::string fs::root;
+static fs::FS disk;
+
+const uint32_t START = 1760000000;
+const size_t BUDGET = 64 * HISTORY_SEGMENT_BYTES;
+const uint32_t AFTER_REBOOT = 1000;  // Samples appended after the reboot
+
+// --- SAMPLES ---
+// Every value follows from the time, so a query result can be checked
+// without keeping what was appended. 'metered' adds a running load with
+// the PZEM's reading to reading noise, otherwise the load is off
+
+static TelemetrySample sampleAt(uint32_t t, bool metered) {
+    uint32_t h = t * 2654435761u;
+    TelemetrySample s;
+    memset(&s, 0, sizeof(s));
+    s.unixTime = t;
+    s.temperature = (int16_t)lround(200 + 400 * sin(t * 2 * M_PI / 86400));  // -20 to 60 °C over a day
+    s.humidity = 550 + (t / 1800) % 40;
+    s.power = metered ? 9000 + (h >> 24) % 40 : 0;
+    s.lightLevel = 1500 + (t / 60) % 600 + (h >> 30);
+    s.brightness = (t / 300) % 101;
+    return s;
+}
+
+static bool sameSample(const HistorySample &h, bool metered) {
+    TelemetrySample s = sampleAt(h.unixTime, metered);
+    return h.temperature == s.temperature && h.humidity == s.humidity && h.power == s.power &&
+           h.lightLevel == s.lightLevel && h.brightness == s.brightness;
+}
+
+// Times appended so far, oldest first
+static std::vector<uint32_t> appended;
+
+static void append(uint32_t from, uint32_t count, bool metered = false) {
+    for (uint32_t t = from; t < from + count; t++) {
+        historyAppend(sampleAt(t, metered));
+        appended.push_back(t);
+    }
+}
+
+static int expectedCount(uint32_t from, uint32_t to) {
+    int n = 0;
+    for (uint32_t t : appended) n += t >= from && t <= to;
+    return n;
+}
+
+// --- QUERIES ---
+
+struct Scan {
+    bool metered;
+    int seen;
+    int limit;        // Stop after this many, 0 = all
+    int bad;          // Wrong values or out of order
+    uint32_t first;
+    uint32_t last;
+};
+
+static bool checkSample(const HistorySample &sample, void *context) {
+    Scan &scan = *(Scan *)context;
+    if (!sameSample(sample, scan.metered) || (scan.seen > 0 && sample.unixTime <= scan.last)) scan.bad++;
+    if (scan.seen == 0) scan.first = sample.unixTime;
+    scan.last = sample.unixTime;
+    scan.seen++;
+    return scan.limit == 0 || scan.seen < scan.limit;
+}
+
+static Scan query(uint32_t from, uint32_t to, int &delivered, bool metered = false, int limit = 0) {
+    Scan scan = {metered, 0, limit, 0, 0, 0};
+    delivered = historyQuery(from, to, checkSample, &scan);
+    return scan;
+}
+
+// The range matches what was appended, value for value
+static bool queryMatches(uint32_t from, uint32_t to) {
+    int delivered;
+    Scan scan = query(from, to, delivered);
+    int expected = expectedCount(from, to);
+    bool ok = delivered == expected && scan.seen == expected && scan.bad == 0;
+    if (!ok) printf("query %u - %u: %d of %d, %d bad\n", from, to, delivered, expected, scan.bad);
+    return ok;
+}
+
+static void useDirectory(const char *name) {
+    fs::root = std::string("build/") + name;
+    std::filesystem::remove_all(fs::root);
+    std::filesystem::create_directories(fs::root);
+}
+
+static int segmentFiles() {
+    int n = 0;
+    for (auto &entry : std::filesystem::directory_iterator(fs::root + HISTORY_DIR)) {
+        n += entry.path().extension() == ".dat";
+    }
+    return n;
+}
+
+// --- TESTS ---
+
+// A day of samples, with a clock step and samples the clock was not set for
+static void testRoundTrip() {
+    useDirectory("history_fs");
+    CHECK(historyBegin(disk, BUDGET));
+
+    TelemetrySample unsynced = sampleAt(0, false);
+    historyAppend(unsynced);
+    append(START, 40000);
+    append(START + 40005, 46000);          // NTP stepped the clock 5 s forward
+    historyAppend(sampleAt(START, false));  // Behind the newest sample
+
+    HistoryStats stats;
+    getHistoryStats(stats);
+    CHECK(stats.appended == appended.size());
+    CHECK(stats.skipped == 2);
+    CHECK(stats.writeErrors == 0);
+    CHECK(stats.firstTime == START && stats.lastTime == appended.back());
+    CHECK(stats.segments > 1 && stats.segments < stats.maxSegments);
+
+    // Whole history, ranges inside one block, across blocks and segments,
+    // over the clock step, and the tail that is still in RAM
+    CHECK(queryMatches(0, UINT32_MAX));
+    CHECK(queryMatches(START + 100, START + 110));
+    CHECK(queryMatches(START + 1000, START + 5000));
+    CHECK(queryMatches(START + 39990, START + 40020));
+    CHECK(queryMatches(appended.back() - 100, appended.back()));
+    CHECK(queryMatches(START - 100, START - 1));
+
+    // The callback can stop the query
+    int delivered;
+    Scan scan = query(START + 500, UINT32_MAX, delivered, false, 10);
+    CHECK(delivered == 10 && scan.seen == 10 && scan.first == START + 500);
+}
+
+// A reboot picks the history up from the files
+static void testReboot() {
+    CHECK(historyFlush());
+    CHECK(historyBegin(disk, BUDGET));
+    CHECK(queryMatches(0, UINT32_MAX));
+
+    append(appended.back() + 1, AFTER_REBOOT);
+    CHECK(queryMatches(appended.back() - 2000, UINT32_MAX));
+}
+
+// Power lost while the index entry was written: the block it pointed at is
+// lost, the rest stays readable and appending goes on in a new segment
+static void testTornIndex() {
+    CHECK(historyFlush());
+    HistoryStats before;
+    getHistoryStats(before);
+    uint32_t lost = AFTER_REBOOT % HISTORY_BLOCK_SAMPLES;  // The short block the flush wrote
+    CHECK(lost > 0);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s" HISTORY_DIR "/%08lu.idx", fs::root.c_str(), (unsigned long)before.segments - 1);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+    appended.resize(appended.size() - lost);
+
+    CHECK(historyBegin(disk, BUDGET));
+    HistoryStats after;
+    getHistoryStats(after);
+    CHECK(after.segments == before.segments + 1);
+    CHECK(queryMatches(0, UINT32_MAX));
+
+    append(appended.back() + 1000, 3000);
+    CHECK(historyFlush());
+    CHECK(queryMatches(0, UINT32_MAX));
+}
+
+// Past the budget the oldest segments go, and a smaller budget at the next
+// boot trims the history down to it
+static void testRotation() {
+    useDirectory("history_rotation");
+    appended.clear();
+    CHECK(historyBegin(disk, 4 * HISTORY_SEGMENT_BYTES));
+
+    append(START, 600000, true);
+    CHECK(historyFlush());
+    HistoryStats stats;
+    getHistoryStats(stats);
+    CHECK(stats.maxSegments == 4);
+    CHECK(stats.segments == 4);
+    CHECK(segmentFiles() == 4);
+    CHECK(stats.firstTime > START);
+
+    // What is left runs without a hole from the oldest sample to the newest
+    int delivered;
+    Scan scan = query(0, UINT32_MAX, delivered, true);
+    CHECK(scan.bad == 0 && scan.first == stats.firstTime && scan.last == stats.lastTime);
+    CHECK(delivered == (int)(stats.lastTime - stats.firstTime + 1));
+
+    CHECK(historyBegin(disk, 2 * HISTORY_SEGMENT_BYTES));
+    getHistoryStats(stats);
+    CHECK(stats.segments == 2);
+    CHECK(segmentFiles() == 2);
+    scan = query(0, UINT32_MAX, delivered, true);
+    CHECK(scan.bad == 0 && scan.first == stats.firstTime && scan.last == stats.lastTime);
+
+    // Budgets are rounded to whole segments, two at least, HISTORY_MAX_SEGMENTS at most
+    CHECK(historyBegin(disk, 0));
+    getHistoryStats(stats);
+    CHECK(stats.maxSegments == 2);
+    CHECK(historyBegin(disk, (size_t)4 << 30));
+    getHistoryStats(stats);
+    CHECK(stats.maxSegments == HISTORY_MAX_SEGMENTS);
+}
+
+// --- BENCHMARK ---
+// A day of each profile in a fresh directory: flash per day, append and query time
+
+static void benchmark(const char *what, bool metered) {
+    historyFlush();
+    useDirectory("history_bench");
+    CHECK(historyBegin(disk, BUDGET));
+    HistoryStats before;
+    getHistoryStats(before);
+
+    const uint32_t DAY = 86400;
+    double t = wallNanos();
+    for (uint32_t i = 0; i < DAY; i++) historyAppend(sampleAt(START + i, metered));
+    double appendNs = (wallNanos() - t) / DAY;
+    historyFlush();
+
+    HistoryStats after;
+    getHistoryStats(after);
+    uint32_t bytes = after.bytes - before.bytes;
+
+    int delivered;
+    t = wallNanos();
+    query(START + DAY / 2, START + DAY / 2 + 3599, delivered, metered);
+    double hourMs = (wallNanos() - t) / 1e6;
+    CHECK(delivered == 3600);
+
+    printf("bench: %-12s %5.2f B/sample %4u KB/day, %.1f days per MB, append %5.0f ns, hour query %.2f ms\n",
+           what, (double)bytes / DAY, bytes / 1024, 1048576.0 / bytes, appendNs, hourMs);
+}
+
+int main() {
+    testRoundTrip();
+    testReboot();
+    testTornIndex();
+    testRotation();
+    benchmark("load off", false);
+    benchmark("load metered", true);
+    return hostTestResult("history_test");
+}
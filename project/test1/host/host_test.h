@@ -0,0 +1,40 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <time.h>
+
+// --- CHECKS ---
+// A failed CHECK prints where and carries on, main() returns hostTestResult()
+
+inline int hostFailures = 0;
+
+#define CHECK(cond)                                                          \
+    do {                                                                     \
+        if (!(cond)) {                                                       \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);  \
+            hostFailures++;                                                  \
+        }                                                                    \
+    } while (0)
+
+inline int hostTestResult(const char *name) {
+    printf("%s: %s\n", name, hostFailures == 0 ? "ok" : "FAILED");
+    return hostFailures == 0 ? 0 : 1;
+}
+
+// --- BENCHMARKS ---
+
+// Wall clock nanoseconds, for timing the code under test (not the simulated clock)
+inline double wallNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Keeps the optimizer from dropping a result nobody reads
+template <typename T>
+inline void keep(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif
@@ -0,0 +1,239 @@
+// Light sensor filters on a scripted ADC: the median window while it fills and
+// after it wraps, the running mean, the EMA seed, and the seqlock reader on a thread
+
+#include "light_sensor.h"
+#include "host_test.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// --- SCRIPTED ADC ---
+
+static std::vector<uint16_t> script;
+static size_t scriptAt = 0;
+static bool scriptRepeats = false;
+
+static int scriptedRead(int pin) {
+    CHECK(pin == LIGHT_SENSOR_PIN);
+    if (scriptRepeats && scriptAt == script.size()) scriptAt = 0;
+    return scriptAt < script.size() ? script[scriptAt++] : 0;
+}
+
+// The next analogRead() calls return these, then 0 or the same again
+static void play(const std::vector<uint16_t> &samples, bool repeat = false) {
+    script = samples;
+    scriptAt = 0;
+    scriptRepeats = repeat;
+}
+
+static LightReading tick() {
+    lightSensorTick();
+    LightReading reading;
+    getLightReading(reading);
+    return reading;
+}
+
+// --- REFERENCE ---
+// The filters written out the slow way: sort the window, sum the ring
+
+struct Reference {
+    std::vector<uint16_t> raws;
+    std::vector<uint16_t> medians;
+    double ema = 0;
+
+    LightReading add(uint16_t raw) {
+        raws.push_back(raw);
+        size_t n = std::min(raws.size(), (size_t)LIGHT_MEDIAN_WINDOW);
+        std::vector<uint16_t> window(raws.end() - n, raws.end());
+        std::sort(window.begin(), window.end());
+        uint16_t median = window[n / 2];
+        medians.push_back(median);
+
+        size_t m = std::min(medians.size(), (size_t)LIGHT_RING_SIZE);
+        uint32_t sum = 0;
+        for (size_t i = medians.size() - m; i < medians.size(); i++) sum += medians[i];
+
+        ema = medians.size() == 1 ? median : ema + (median - ema) / (1 << LIGHT_EMA_SHIFT);
+
+        LightReading r = {raw, median, (uint16_t)(sum / m), (uint16_t)lround(ema), (uint32_t)raws.size()};
+        return r;
+    }
+};
+
+static bool same(const LightReading &a, const LightReading &b, int emaSlack) {
+    return a.raw == b.raw && a.median == b.median && a.mean == b.mean && a.samples == b.samples &&
+           abs((int)a.ema - (int)b.ema) <= emaSlack;
+}
+
+// --- TESTS ---
+
+// A spike while the window fills is already voted out. Once it is full two
+// spikes in five are rejected, three are not
+static void testFill() {
+    initLightSensor();
+    play({1000, 1000, 4095, 1000, 1000, 4095, 4095, 4095});
+
+    const uint16_t medians[] = {1000, 1000, 1000, 1000, 1000, 1000, 4095, 4095};
+    for (int i = 0; i < 8; i++) {
+        LightReading r = tick();
+        CHECK(r.raw == script[i]);
+        CHECK(r.median == medians[i]);
+        CHECK(r.samples == (uint32_t)i + 1);
+    }
+
+    // The mean averages medians, not raw samples
+    LightReading r;
+    getLightReading(r);
+    CHECK(r.mean == (6 * 1000 + 2 * 4095) / 8);
+}
+
+// A long random run against the reference: the median window and the mean
+// ring wrap many times, and repeated values exercise the window's search
+static void testWrap() {
+    initLightSensor();
+    std::vector<uint16_t> samples;
+    uint32_t x = 12345;
+    for (int i = 0; i < 20000; i++) {
+        x = x * 1664525 + 1013904223;
+        uint16_t level = i < 10000 ? 2000 + (x >> 28) : (x >> 20) % 4096;  // Few values, then all of them
+        if ((x & 0xFF) == 7) level = 4095;                                   // Spikes
+        samples.push_back(level);
+    }
+    play(samples);
+
+    Reference ref;
+    int bad = 0;
+    for (uint16_t sample : samples) {
+        LightReading expected = ref.add(sample);
+        LightReading r = tick();
+        if (!same(r, expected, 1)) {
+            if (bad++ < 5) {
+                printf("sample %u: got %u/%u/%u/%u, want %u/%u/%u/%u\n", r.samples, r.raw, r.median, r.mean,
+                       r.ema, expected.raw, expected.median, expected.mean, expected.ema);
+            }
+        }
+    }
+    CHECK(bad == 0);
+}
+
+// The EMA starts at the first sample instead of climbing from 0, also after a re-init
+static void testEmaSeed() {
+    for (int round = 0; round < 2; round++) {
+        initLightSensor();
+        play({3000, 3000, 3000, 3000, 3000, 1000, 1000, 1000, 1000, 1000, 1000});
+        LightReading r = tick();
+        CHECK(r.ema == 3000 && r.mean == 3000 && r.samples == 1);
+
+        for (int i = 0; i < 4; i++) r = tick();
+        CHECK(r.ema == 3000);
+
+        // A step down moves it 1/8 of the way per sample once the median follows
+        for (int i = 0; i < 3; i++) r = tick();
+        CHECK(r.median == 1000);
+        CHECK(r.ema == 2750);
+        r = tick();
+        CHECK(r.ema == 2531);
+    }
+}
+
+// readLightLevel() is the running mean
+static void testLevel() {
+    initLightSensor();
+    play(std::vector<uint16_t>(LIGHT_RING_SIZE, 1234));
+    for (int i = 0; i < LIGHT_RING_SIZE; i++) tick();
+    CHECK(readLightLevel() == 1234);
+}
+
+// A reader thread never sees a half written reading. The ADC repeats a
+// 64 sample pattern, so once the filters have filled every sample count maps
+// to one expected reading and a mix of two updates does not match it. Neither
+// side yields: on one core the reader only gets in when the scheduler
+// preempts the sampler, at any instruction, so the run goes on for a second
+const int PATTERN = 64;
+const uint32_t SETTLED = 2 * PATTERN + LIGHT_RING_SIZE;
+
+static std::vector<LightReading> expectedAt;
+static std::atomic<bool> sampling(true);
+
+static bool consistent(const LightReading &r) {
+    if (r.samples == 0) return true;
+    uint32_t n = r.samples < SETTLED ? r.samples : SETTLED + (r.samples - SETTLED) % PATTERN;
+    LightReading expected = expectedAt[n];
+    expected.samples = r.samples;
+    expected.ema = r.ema;  // Not periodic, testEmaSeed and testWrap cover it
+    return same(r, expected, 0);
+}
+
+static void testSeqlock() {
+    initLightSensor();
+    std::vector<uint16_t> pattern;
+    for (uint32_t i = 0; i < PATTERN; i++) pattern.push_back((i * 2654435761u) >> 20);
+
+    // expectedAt[n] is the reading after n samples
+    Reference ref;
+    expectedAt.assign(1, LightReading());
+    for (uint32_t i = 0; i < SETTLED + 2 * PATTERN; i++) expectedAt.push_back(ref.add(pattern[i % PATTERN]));
+    for (uint32_t n = SETTLED; n < SETTLED + PATTERN; n++) CHECK(consistent(expectedAt[n + PATTERN]));
+    play(pattern, true);
+    lightSensorTick();  // initLightSensor() leaves the last test's reading published
+
+    uint32_t reads = 0, torn = 0, backwards = 0;
+    std::thread reader([&] {
+        uint32_t last = 0;
+        while (sampling.load(std::memory_order_relaxed)) {
+            LightReading r;
+            getLightReading(r);
+            if (!consistent(r)) torn++;
+            if (r.samples < last) backwards++;
+            last = r.samples;
+            reads++;
+        }
+    });
+
+    double end = wallNanos() + 1e9;
+    uint32_t ticks = 0;
+    while (wallNanos() < end) {
+        for (int i = 0; i < 1000; i++) lightSensorTick();
+        ticks += 1000;
+    }
+    sampling.store(false, std::memory_order_relaxed);
+    reader.join();
+
+    CHECK(torn == 0);
+    CHECK(backwards == 0);
+    CHECK(reads > 0);
+    printf("bench: %u samples, %u concurrent reads\n", ticks, reads);
+}
+
+// --- BENCHMARK ---
+// What the sampling task pays per sample and a reader per call
+
+static void benchmark() {
+    initLightSensor();
+    const int SAMPLES = 5000000;
+    std::vector<uint16_t> samples;
+    for (uint32_t i = 0; i < 4096; i++) samples.push_back((i * 2654435761u) >> 20);
+    play(samples, true);
+
+    double t = wallNanos();
+    for (int i = 0; i < SAMPLES; i++) lightSensorTick();
+    double tickNs = (wallNanos() - t) / SAMPLES;
+
+    t = wallNanos();
+    for (int i = 0; i < SAMPLES; i++) keep(readLightLevel());
+    double readNs = (wallNanos() - t) / SAMPLES;
+
+    printf("bench: lightSensorTick() %.1f ns, readLightLevel() %.1f ns\n", tickNs, readNs);
+}
+
+int main() {
+    hostAnalogRead = scriptedRead;
+    testFill();
+    testWrap();
+    testEmaSeed();
+    testLevel();
+    testSeqlock();
+    benchmark();
+    return hostTestResult("light_sensor_test");
+}
@@ -0,0 +1,263 @@
+// Modbus RTU master and register map against a simulated XY-MD02 slave: replies,
+// errors, and the throughput and latency the bus reaches when loop() ticks it
+
+#include "modbus.h"
+#include "modbus_map.h"
+#include "host_test.h"
+#include <CRC16Modbus.h>
+
+const unsigned long BAUD = 9600;
+const uint64_t CHAR_MICROS = 11000000ULL / BAUD;
+const uint8_t SLAVE = 1;
+
+// How often the simulated loop() calls modbusTick() (us)
+const uint64_t TICK_MICROS = 100;
+
+// --- SIMULATED SLAVE ---
+// XY-MD02: input registers 1 (temperature x10) and 2 (humidity x10)
+
+enum Fault {
+    FAULT_NONE,
+    FAULT_SILENT,    // Never answers
+    FAULT_CORRUPT    // Flips a bit in the reply
+};
+
+struct Slave {
+    uint16_t registers[3];
+    uint64_t responseMicros;  // Time from the end of the request to the first reply byte
+    Fault fault;
+};
+
+static Slave slave = {{0, 253, 612}, 5000, FAULT_NONE};
+
+static void reply(HardwareSerial &port, uint8_t *frame, int length) {
+    uint16_t crc = crc16Modbus(frame, length);
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    if (slave.fault == FAULT_CORRUPT) frame[3] ^= 0x01;
+
+    // The request leaves the wire 8 characters after write(), the reply starts after the turnaround
+    uint64_t start = hostMicros + 8 * CHAR_MICROS + slave.responseMicros;
+    port.receive(frame, length, start + CHAR_MICROS, CHAR_MICROS);
+}
+
+static void onRequest(HardwareSerial &port, const uint8_t *data, size_t length, void *) {
+    if (length != 8 || crc16Modbus(data, 8) != 0 || data[0] != SLAVE || slave.fault == FAULT_SILENT) {
+        return;
+    }
+
+    uint8_t frame[5 + 2 * MODBUS_MAX_REGISTERS];
+    uint16_t reg = (data[2] << 8) | data[3];
+    uint8_t count = data[5];
+    frame[0] = SLAVE;
+
+    if (data[1] != MODBUS_READ_INPUT_REGISTERS) {
+        frame[1] = data[1] | 0x80;
+        frame[2] = 0x01; // Illegal function
+        reply(port, frame, 3);
+        return;
+    }
+    if (reg < 1 || reg + count > 3) {
+        frame[1] = data[1] | 0x80;
+        frame[2] = 0x02; // Illegal data address
+        reply(port, frame, 3);
+        return;
+    }
+
+    frame[1] = data[1];
+    frame[2] = 2 * count;
+    for (int i = 0; i < count; i++) {
+        frame[3 + 2 * i] = slave.registers[reg + i] >> 8;
+        frame[4 + 2 * i] = slave.registers[reg + i] & 0xFF;
+    }
+    reply(port, frame, 3 + 2 * count);
+}
+
+// --- MASTER SIDE ---
+
+static HardwareSerial port;
+static ModbusResult last;
+static int completed = 0;
+
+static void onResult(const ModbusResult &result, void *) {
+    last = result;
+    completed++;
+}
+
+// Tick like loop() until the request completes, returns the simulated time it took (us)
+static uint64_t runOne() {
+    int before = completed;
+    uint64_t start = hostMicros;
+    while (completed == before && hostMicros - start < 2000000) {
+        modbusTick();
+        hostAdvance(TICK_MICROS);
+    }
+    return hostMicros - start;
+}
+
+static void testRead() {
+    slave.fault = FAULT_NONE;
+    CHECK(modbusReadInputRegisters(SLAVE, 1, 2, onResult, NULL));
+    runOne();
+    CHECK(last.status == MODBUS_OK);
+    CHECK(last.values[0] == 253);
+    CHECK(last.values[1] == 612);
+
+    // Request (8 chars), turnaround, reply (9 chars), plus at most a tick and a T3.5 of slack
+    uint64_t wire = 17 * CHAR_MICROS + slave.responseMicros;
+    CHECK(last.durationMicros >= wire);
+    CHECK(last.durationMicros <= wire + 2 * TICK_MICROS + 4 * CHAR_MICROS);
+}
+
+static void testException() {
+    slave.fault = FAULT_NONE;
+    CHECK(modbusReadInputRegisters(SLAVE, 0x100, 1, onResult, NULL));
+    runOne();
+    CHECK(last.status == MODBUS_EXCEPTION);
+    CHECK(last.exceptionCode == 0x02);
+
+    CHECK(modbusRead(SLAVE, MODBUS_READ_HOLDING_REGISTERS, 1, 1, onResult, NULL));
+    runOne();
+    CHECK(last.status == MODBUS_EXCEPTION);
+    CHECK(last.exceptionCode == 0x01);
+}
+
+static void testTimeout() {
+    slave.fault = FAULT_SILENT;
+    CHECK(modbusReadInputRegisters(SLAVE, 1, 2, onResult, NULL));
+    uint64_t took = runOne();
+    CHECK(last.status == MODBUS_TIMEOUT);
+    CHECK(took >= MODBUS_RESPONSE_TIMEOUT_MS * 1000);
+    // The timeout counts from the end of the request, after T3.5 and 8 characters
+    CHECK(took <= MODBUS_RESPONSE_TIMEOUT_MS * 1000 + 12 * CHAR_MICROS + 2 * TICK_MICROS);
+}
+
+static void testCorrupt() {
+    slave.fault = FAULT_CORRUPT;
+    CHECK(modbusReadInputRegisters(SLAVE, 1, 2, onResult, NULL));
+    runOne();
+    CHECK(last.status == MODBUS_CRC_ERROR);
+}
+
+static void testQueue() {
+    slave.fault = FAULT_NONE;
+    for (int i = 0; i < MODBUS_QUEUE_SIZE; i++) {
+        CHECK(modbusReadInputRegisters(SLAVE, 1, 2, onResult, NULL));
+    }
+    CHECK(!modbusReadInputRegisters(SLAVE, 1, 2, onResult, NULL));
+    CHECK(!modbusReadInputRegisters(SLAVE, 1, 0, onResult, NULL));
+    CHECK(!modbusReadInputRegisters(SLAVE, 1, MODBUS_MAX_REGISTERS + 1, onResult, NULL));
+
+    int before = completed;
+    while (!modbusIdle()) {
+        modbusTick();
+        hostAdvance(TICK_MICROS);
+    }
+    CHECK(completed - before == MODBUS_QUEUE_SIZE);
+    CHECK(last.status == MODBUS_OK);
+}
+
+// --- REGISTER MAP ---
+
+static float temperature = 0;
+static float humidity = 0;
+
+static ModbusField fields[] = {
+    {SLAVE, MODBUS_READ_INPUT_REGISTERS, 0x0001, FIELD_S16, 0.1f, &temperature},
+    {SLAVE, MODBUS_READ_INPUT_REGISTERS, 0x0002, FIELD_U16, 0.1f, &humidity},
+};
+
+static void pollMap(ModbusMap &map) {
+    CHECK(modbusMapPoll(map));
+    uint64_t start = hostMicros;
+    while (modbusMapBusy(map) && hostMicros - start < 2000000) {
+        modbusTick();
+        hostAdvance(TICK_MICROS);
+    }
+}
+
+// -1.0 °C is a reading like any other, a failed poll keeps the last good values
+static void testMap() {
+    ModbusMap map;
+    CHECK(modbusMapBuild(map, fields, 2));
+    CHECK(map.blockCount == 1);
+    CHECK(!modbusMapOk(map));
+
+    slave.fault = FAULT_NONE;
+    slave.registers[1] = (uint16_t)-10;
+    pollMap(map);
+    CHECK(modbusMapOk(map));
+    CHECK(modbusMapValueOk(map, &temperature));
+    CHECK(fabsf(temperature - -1.0f) < 1e-6f);
+    CHECK(fabsf(humidity - 61.2f) < 1e-4f);
+
+    slave.fault = FAULT_SILENT;
+    pollMap(map);
+    CHECK(map.polls == 2);
+    CHECK(!modbusMapOk(map));
+    CHECK(!modbusMapValueOk(map, &humidity));
+    CHECK(fabsf(temperature - -1.0f) < 1e-6f);
+    CHECK(fabsf(humidity - 61.2f) < 1e-4f);
+
+    float other;
+    CHECK(!modbusMapValueOk(map, &other));
+
+    slave.fault = FAULT_NONE;
+    slave.registers[1] = 253;
+}
+
+// --- BENCHMARK ---
+// Keep the queue full for a simulated minute and report what the bus delivers
+// and what loop() pays for it. The old readModBus() blocked loop() for 210 ms
+// of delay() plus the reply for every register it read.
+
+static uint32_t benchCount = 0;
+static uint64_t benchLatency = 0;
+static uint32_t benchMaxLatency = 0;
+
+static void onBenchResult(const ModbusResult &result, void *) {
+    if (result.status != MODBUS_OK) return;
+    benchCount++;
+    benchLatency += result.durationMicros;
+    if (result.durationMicros > benchMaxLatency) benchMaxLatency = result.durationMicros;
+    modbusReadInputRegisters(SLAVE, 1, 2, onBenchResult, NULL);
+}
+
+static void benchmark() {
+    slave.fault = FAULT_NONE;
+    modbusReadInputRegisters(SLAVE, 1, 2, onBenchResult, NULL);
+
+    const uint64_t SECONDS = 60;
+    uint64_t end = hostMicros + SECONDS * 1000000;
+    uint64_t ticks = 0;
+    double tickNanos = 0;
+    while (hostMicros < end) {
+        double start = wallNanos();
+        modbusTick();
+        tickNanos += wallNanos() - start;
+        ticks++;
+        hostAdvance(TICK_MICROS);
+    }
+
+    printf("bench: %u transactions in %llu s at %lu baud, %.1f/s\n", benchCount,
+           (unsigned long long)SECONDS, BAUD, (double)benchCount / SECONDS);
+    printf("bench: latency mean %.2f ms, max %.2f ms (slave turnaround %.1f ms)\n",
+           benchLatency / 1000.0 / benchCount, benchMaxLatency / 1000.0, slave.responseMicros / 1000.0);
+    printf("bench: modbusTick() mean %.0f ns over %llu ticks\n", tickNanos / ticks, (unsigned long long)ticks);
+    CHECK(benchCount > 0);
+}
+
+int main() {
+    port.transmitted = onRequest;
+    modbusBegin(port, RS485_DIR, BAUD);
+
+    testRead();
+    testException();
+    testTimeout();
+    testCorrupt();
+    testQueue();
+    testMap();
+    benchmark();
+
+    return hostTestResult("modbus_test");
+}
@@ -0,0 +1,242 @@
+// PZEM-004T readers against simulated meters on one RS-485 line: good
+// replies, exceptions, stray frames and noise, and no request ever sent
+// while a meter is still talking
+
+#include <PZEMBus.h>
+#include <CRC16Modbus.h>
+#include "host_test.h"
+
+const uint64_t CHAR_MICROS = 11000000ULL / PZEM_BAUD_RATE;
+const uint64_t TURNAROUND_MICROS = 5000;  // End of the request to the first reply byte
+const uint64_t TICK_MICROS = 100;         // How often loop() / poll() runs
+
+// --- SIMULATED LINE ---
+
+enum Behaviour {
+    METER_OK,
+    METER_EXCEPTION,      // Answers every read with exception 0x02
+    METER_BAD_EXCEPTION,  // Exception with a broken CRC
+    METER_STRAY,          // A whole 25 byte reply with another slave's address
+    METER_NOISE           // Its address and 0x84, like the start of an exception, then nothing
+};
+
+struct Meter {
+    uint8_t addr;
+    Behaviour behaviour;
+};
+
+static Meter meters[8];
+static int meterCount = 0;
+
+static HardwareSerial line;
+static uint64_t lineBusyUntil = 0;  // Last reply byte complete
+static int requests = 0;
+static int collisions = 0;           // Requests sent while a reply was still on the wire
+
+static void addMeter(uint8_t addr, Behaviour behaviour) {
+    meters[meterCount++] = {addr, behaviour};
+}
+
+static void reply(const uint8_t *frame, size_t length) {
+    uint64_t start = hostMicros + 8 * CHAR_MICROS + TURNAROUND_MICROS;
+    line.receive(frame, length, start + CHAR_MICROS, CHAR_MICROS);
+    lineBusyUntil = start + length * CHAR_MICROS;
+}
+
+static size_t withCrc(uint8_t *frame, size_t length) {
+    uint16_t crc = crc16Modbus(frame, length);
+    frame[length++] = crc & 0xFF;
+    frame[length++] = crc >> 8;
+    return length;
+}
+
+// Register values: voltage 230.0 + address V, current 1.5 A, power 345.6 W,
+// energy 12.345 kWh, 50.0 Hz, pf 0.96
+static size_t registerReply(uint8_t *frame, uint8_t addr, uint8_t registers) {
+    const uint16_t values[10] = {(uint16_t)(2300 + addr), 1500, 0, 3456, 0, 12345, 0, 500, 96, 0};
+    frame[0] = addr;
+    frame[1] = 0x04;
+    frame[2] = 2 * registers;
+    for (int i = 0; i < registers; i++) {
+        frame[3 + 2 * i] = values[i] >> 8;
+        frame[4 + 2 * i] = values[i] & 0xFF;
+    }
+    return withCrc(frame, 3 + 2 * registers);
+}
+
+static void onRequest(HardwareSerial &, const uint8_t *data, size_t length, void *) {
+    requests++;
+    if (hostMicros < lineBusyUntil) collisions++;
+    if (length != 8 || crc16Modbus(data, 8) != 0) return;
+
+    for (int i = 0; i < meterCount; i++) {
+        const Meter &m = meters[i];
+        if (m.addr != data[0]) continue;
+
+        uint8_t frame[32];
+        size_t n = 0;
+        switch (m.behaviour) {
+        case METER_OK:
+            n = registerReply(frame, m.addr, data[5]);
+            break;
+        case METER_EXCEPTION:
+        case METER_BAD_EXCEPTION:
+            frame[0] = m.addr;
+            frame[1] = 0x84;
+            frame[2] = 0x02;
+            n = withCrc(frame, 3);
+            if (m.behaviour == METER_BAD_EXCEPTION) frame[4] ^= 0x55;
+            break;
+        case METER_STRAY:
+            n = registerReply(frame, m.addr + 0x40, 10);
+            break;
+        case METER_NOISE:
+            frame[0] = m.addr;
+            frame[1] = 0x84;
+            n = 2;
+            break;
+        }
+        reply(frame, n);
+        return;
+    }
+}
+
+static void reset() {
+    meterCount = 0;
+    requests = 0;
+    collisions = 0;
+    lineBusyUntil = 0;
+    hostAdvance(100000);
+    while (line.available() > 0) line.read();
+}
+
+static void runBus(PZEMBus &bus, unsigned long ms) {
+    for (uint64_t t = 0; t < ms * 1000; t += TICK_MICROS) {
+        bus.loop();
+        hostAdvance(TICK_MICROS);
+    }
+}
+
+// --- PZEMBus ---
+
+static void testBusReads() {
+    reset();
+    addMeter(1, METER_OK);
+    addMeter(2, METER_OK);
+    PZEMBus bus(line);
+    bus.addMeter(1);
+    bus.addMeter(2);
+    runBus(bus, 1000);
+
+    for (int i = 0; i < 2; i++) {
+        PZEMValues v;
+        CHECK(bus.getValues(i, v));
+        CHECK(fabs(v.voltage - (230.1f + i * 0.1f)) < 0.01f);
+        CHECK(fabs(v.power - 345.6f) < 0.01f && fabs(v.pf - 0.96f) < 0.001f);
+        CHECK(bus.meter(i)->reads > 10 && bus.meter(i)->errors == 0);
+    }
+    CHECK(collisions == 0);
+}
+
+// An exception is counted once its 5 bytes are in, the next request waits for them
+static void testBusException() {
+    reset();
+    addMeter(1, METER_OK);
+    addMeter(3, METER_EXCEPTION);
+    PZEMBus bus(line);
+    bus.addMeter(1);
+    bus.addMeter(3);
+    runBus(bus, 1000);
+
+    const PZEMMeter *m = bus.meter(1);
+    CHECK(m->exceptions > 10 && m->errors == m->exceptions && !m->valid);
+    CHECK(bus.meter(0)->reads > 10);
+    CHECK(collisions == 0);
+}
+
+// A stray frame and a broken exception are waited out, neither counts as an exception
+static void testBusBadReplies() {
+    reset();
+    addMeter(4, METER_STRAY);
+    addMeter(5, METER_BAD_EXCEPTION);
+    PZEMBus bus(line);
+    bus.addMeter(4);
+    bus.addMeter(5);
+    runBus(bus, 1000);
+
+    for (int i = 0; i < 2; i++) {
+        const PZEMMeter *m = bus.meter(i);
+        CHECK(m->errors > 5 && m->exceptions == 0 && !m->valid);
+    }
+    CHECK(collisions == 0);
+}
+
+// Only addresses that sent a complete, checked frame are found
+static void testDiscovery() {
+    reset();
+    addMeter(1, METER_OK);
+    addMeter(3, METER_EXCEPTION);
+    addMeter(5, METER_BAD_EXCEPTION);
+    addMeter(7, METER_NOISE);
+    addMeter(9, METER_STRAY);
+    PZEMBus bus(line);
+    bus.beginDiscovery(1, 12);
+    for (int i = 0; i < 10000 && bus.discovering(); i++) runBus(bus, 1);
+
+    uint8_t found[PZEM_BUS_MAX_METERS];
+    uint8_t n = bus.discovered(found, PZEM_BUS_MAX_METERS);
+    CHECK(!bus.discovering());
+    CHECK(n == 2 && found[0] == 1 && found[1] == 3);
+    CHECK(requests == 12);
+    CHECK(collisions == 0);
+}
+
+// --- PZEM004Tv30 ---
+
+static PZEMReadState readOnce(PZEM004Tv30 &pzem) {
+    CHECK(pzem.beginRead());
+    PZEMReadState state;
+    while ((state = pzem.poll()) == PZEM_READ_BUSY) hostAdvance(TICK_MICROS);
+    return state;
+}
+
+static void testAsyncRead() {
+    reset();
+    addMeter(1, METER_OK);
+    addMeter(3, METER_EXCEPTION);
+    addMeter(4, METER_STRAY);
+    addMeter(5, METER_BAD_EXCEPTION);
+
+    PZEM004Tv30 good(line, 1);
+    CHECK(readOnce(good) == PZEM_READ_DONE);
+    PZEMValues v;
+    CHECK(good.getValues(v) && fabs(v.voltage - 230.1f) < 0.01f);
+
+    // Every read ends after the reply has left the wire, so reading again right away is safe
+    PZEM004Tv30 exception(line, 3);
+    PZEM004Tv30 stray(line, 4);
+    PZEM004Tv30 broken(line, 5);
+    for (int i = 0; i < 5; i++) {
+        CHECK(readOnce(exception) == PZEM_READ_ERROR);
+        CHECK(hostMicros >= lineBusyUntil);
+        CHECK(readOnce(stray) == PZEM_READ_ERROR);
+        CHECK(hostMicros >= lineBusyUntil + PZEM_SILENCE_MICROS);
+        CHECK(readOnce(broken) == PZEM_READ_ERROR);
+        CHECK(hostMicros >= lineBusyUntil + PZEM_SILENCE_MICROS);
+        CHECK(readOnce(good) == PZEM_READ_DONE);
+    }
+    CHECK(!exception.getValues(v) && !stray.getValues(v));
+    CHECK(collisions == 0);
+}
+
+int main() {
+    line.transmitted = onRequest;
+
+    testBusReads();
+    testBusException();
+    testBusBadReplies();
+    testDiscovery();
+    testAsyncRead();
+
+    return hostTestResult("pzem_test");
+}
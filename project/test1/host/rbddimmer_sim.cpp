@@ -0,0 +1,130 @@
+// RBDdimmer's ESP32 backends on simulated 50 Hz mains with 1 to 4 lamps ON:
+// interrupts per second, host time spent in isr_ext()/onTimerISR(), gate timing.
+// Built once per backend, they define the same ISRs (see the Makefile)
+
+#include <RBDdimmer.h>
+#include "host_test.h"
+
+#if defined(RBDDIMMER_ESP32_EVENT_DRIVEN)
+const char *BACKEND = "event";
+const char *NAME = "rbddimmer_event";
+#else
+const char *BACKEND = "polling";
+const char *NAME = "rbddimmer_polling";
+#endif
+
+// Wiring and levels of the ESP32IsrLoad example
+const int ZERO_CROSS_PIN = 14;
+const int LAMPS = 4;
+const int GATE_PINS[LAMPS] = {13, 12, 27, 26};
+const int POWERS[LAMPS] = {20, 45, 70, 95};
+
+const uint64_t HALF_CYCLE_MICROS = 10000;
+const int SECONDS = 20;
+const double STEP_MICROS = 93.75;  // One power step, 30 ticks of 320 kHz
+
+// --- GATE RECORDER ---
+// Rising edges of every lamp in the current half-cycle, and when the first one
+// came after the zero-cross. The polling backend writes HIGH on every tick of a pulse
+
+static int lampCount = 0;
+static uint64_t edgeAt = 0;
+static int64_t fireAt[LAMPS];
+static int pulseCount[LAMPS];
+static bool gateHigh[LAMPS];
+
+static void onPinWritten(int pin, int value) {
+    for (int i = 0; i < lampCount; i++) {
+        if (pin != GATE_PINS[i]) continue;
+        if (value == HIGH && !gateHigh[i] && pulseCount[i]++ == 0) fireAt[i] = (int64_t)(hostMicros - edgeAt);
+        gateHigh[i] = value == HIGH;
+    }
+}
+
+// --- ISR TIMING ---
+// Host wall time, minus what timing an empty call costs
+
+static double isrNanos = 0;
+static double overheadNanos = 0;
+
+static void timedIsr(void (*isr)()) {
+    double t = wallNanos();
+    isr();
+    isrNanos += wallNanos() - t - overheadNanos;
+}
+
+static void emptyIsr() {}
+
+static void calibrate() {
+    const int CALLS = 1000000;
+    isrNanos = 0;
+    for (int i = 0; i < CALLS; i++) timedIsr(emptyIsr);
+    overheadNanos = isrNanos / CALLS;
+}
+
+// --- SIMULATION ---
+
+static dimmerLamp *lamps[LAMPS];
+
+// One more lamp ON, then SECONDS of mains with every gate checked each half-cycle
+static void runWith(int count) {
+    while (lampCount < count) {
+        int i = lampCount;
+        lamps[i] = new dimmerLamp(GATE_PINS[i], ZERO_CROSS_PIN);
+        lamps[i]->begin(NORMAL_MODE, ON);
+        lamps[i]->setPower(POWERS[i]);
+        lampCount++;
+    }
+
+    // Settle: the event backend ignores a first edge closer than a bounce
+    for (int h = 0; h < 2; h++) {
+        hostInterrupt(ZERO_CROSS_PIN);
+        hostAdvance(HALF_CYCLE_MICROS);
+    }
+
+    resetDimmerIsrStats();
+    isrNanos = 0;
+    int late = 0, missed = 0;
+    for (int h = 0; h < SECONDS * 100; h++) {
+        edgeAt = hostMicros;
+        for (int i = 0; i < lampCount; i++) pulseCount[i] = 0;
+        hostInterrupt(ZERO_CROSS_PIN);
+        hostAdvance(HALF_CYCLE_MICROS);
+
+        // One pulse per lamp, within one step of its phase (the polling timer
+        // is not synchronised to the zero-cross)
+        for (int i = 0; i < lampCount; i++) {
+            double expected = (100 - POWERS[i]) * STEP_MICROS;
+            if (pulseCount[i] != 1) missed++;
+            else if (fabs(fireAt[i] - expected) > STEP_MICROS + 1) late++;
+        }
+    }
+    CHECK(missed == 0);
+    CHECK(late == 0);
+
+    DIMMER_ISR_STATS_typedef stats;
+    getDimmerIsrStats(&stats);
+    double zeroCross = (double)stats.zeroCrossInterrupts / SECONDS;
+    double timer = (double)stats.timerInterrupts / SECONDS;
+    CHECK(stats.zeroCrossInterrupts == (uint32_t)SECONDS * 100);
+#if defined(RBDDIMMER_ESP32_EVENT_DRIVEN)
+    // A fire and a release per lamp and half-cycle, the levels are too far apart to merge
+    CHECK(stats.timerInterrupts == (uint32_t)(SECONDS * 100 * 2 * count));
+#else
+    // Every 30 ticks of 320 kHz whatever the lamps do
+    CHECK(fabs(timer - 320000.0 / 30) < 1);
+#endif
+
+    uint32_t interrupts = stats.zeroCrossInterrupts + stats.timerInterrupts;
+    printf("sim: %-7s %d lamp%s  zero-cross %3.0f/s  timer %7.1f/s  isr %8.1f us/s on the host, %5.1f ns each\n",
+           BACKEND, count, count > 1 ? "s" : " ", zeroCross, timer, isrNanos / 1000 / SECONDS, isrNanos / interrupts);
+}
+
+int main() {
+    hostPinWritten = onPinWritten;
+    calibrate();
+    hostIsrRunner = timedIsr;
+
+    for (int count = 1; count <= LAMPS; count++) runWith(count);
+    return hostTestResult(NAME);
+}
@@ -0,0 +1,209 @@
+// Plain-HTTP stand-in for the Realtime Database, to watch the uploader's
+// keep-alive connection and latency from a PC on the same network.
+//
+//   make -C project/test1/host rtdb_server
+//   project/test1/host/build/rtdb_server [-p port] [-d delay_ms] [-n requests] [-i idle_s]
+//
+// Build the sketch with FIREBASE_REALTIME_HOST set to the PC's address,
+// FIREBASE_REALTIME_TLS 0 and FIREBASE_REALTIME_PORT 8080 (wifi_firebase.h).
+// Every PUT or PATCH is answered 200 with the body echoed back, as the RTDB
+// does, and printed with its connection, the request number on that
+// connection and the time since the one before. The options make the server
+// slow (-d), close connections after so many requests (-n) or after being
+// idle (-i), to check the histogram, the timeout and the reconnect path.
+// Ctrl-C prints the totals. One thread: a delay holds up every connection
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+static int port = 8080;
+static int delayMs = 0;
+static int closeAfter = 0;    // Requests per connection, 0 = keep it open
+static int idleSeconds = 0;   // Close a connection idle this long, 0 = never
+
+static double nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// --- CONNECTIONS ---
+
+struct Connection {
+    int fd;
+    int id;
+    int requests;
+    double lastMs;    // Last request (or the accept)
+    std::string in;   // Received, not handled yet
+};
+
+static std::vector<Connection> connections;
+static int connectionCount = 0;
+static int requestCount = 0;
+static int errorCount = 0;
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int) {
+    stopping = 1;
+}
+
+static void closeConnection(size_t i, const char *why) {
+    Connection &c = connections[i];
+    printf("conn %d closed (%s) after %d requests\n", c.id, why, c.requests);
+    close(c.fd);
+    connections.erase(connections.begin() + i);
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Value of a header in the request head, case insensitive name, "" if missing
+static std::string header(const std::string &head, const char *name) {
+    std::string lower = head;
+    for (char &ch : lower) ch = tolower(ch);
+    std::string key = std::string("\r\n") + name + ":";
+    size_t at = lower.find(key);
+    if (at == std::string::npos) return "";
+    at += key.size();
+    while (at < head.size() && head[at] == ' ') at++;
+    return head.substr(at, head.find("\r\n", at) - at);
+}
+
+// --- REQUESTS ---
+
+// Handle every complete request buffered on a connection
+// Returns false if the connection has to be closed
+static bool serve(Connection &c) {
+    while (true) {
+        size_t headEnd = c.in.find("\r\n\r\n");
+        if (headEnd == std::string::npos) return c.in.size() < 16384;
+        std::string head = c.in.substr(0, headEnd);
+        size_t length = strtoul(header(head, "content-length").c_str(), NULL, 10);
+        if (c.in.size() < headEnd + 4 + length) return true;
+
+        std::string body = c.in.substr(headEnd + 4, length);
+        c.in.erase(0, headEnd + 4 + length);
+
+        std::string method = head.substr(0, head.find(' '));
+        std::string path = head.substr(method.size() + 1, head.find(' ', method.size() + 1) - method.size() - 1);
+        double now = nowMs();
+        c.requests++;
+        requestCount++;
+
+        bool ok = method == "PUT" || method == "PATCH";
+        if (!ok) errorCount++;
+        printf("conn %d req %d %-5s %s %4zu B  +%.0f ms\n", c.id, c.requests, method.c_str(), path.c_str(),
+               length, now - c.lastMs);
+        fflush(stdout);
+        c.lastMs = now;
+
+        if (delayMs > 0) usleep(delayMs * 1000);
+
+        bool closing = strcasecmp(header(head, "connection").c_str(), "close") == 0 ||
+                       (closeAfter > 0 && c.requests >= closeAfter);
+        std::string reply = ok ? body : "{\"error\":\"method not allowed\"}";
+        std::string response = std::string(ok ? "HTTP/1.1 200 OK" : "HTTP/1.1 405 Method Not Allowed") +
+                               "\r\nContent-Type: application/json; charset=utf-8" +
+                               "\r\nContent-Length: " + std::to_string(reply.size()) +
+                               "\r\nConnection: " + (closing ? "close" : "keep-alive") +
+                               "\r\n\r\n" + reply;
+        if (!sendAll(c.fd, response) || closing) return false;
+    }
+}
+
+static int listenOn(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        perror("rtdb_server");
+        exit(1);
+    }
+    return fd;
+}
+
+static void acceptConnection(int listener) {
+    struct sockaddr_in peer;
+    socklen_t size = sizeof(peer);
+    int fd = accept(listener, (struct sockaddr *)&peer, &size);
+    if (fd < 0) return;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    Connection c = {fd, ++connectionCount, 0, nowMs(), ""};
+    connections.push_back(c);
+    printf("conn %d from %s\n", c.id, inet_ntoa(peer.sin_addr));
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:n:i:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'd': delayMs = atoi(optarg); break;
+        case 'n': closeAfter = atoi(optarg); break;
+        case 'i': idleSeconds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-d delay_ms] [-n requests] [-i idle_s]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    int listener = listenOn(port);
+    signal(SIGINT, onSignal);
+    printf("rtdb_server: listening on port %d\n", port);
+
+    while (!stopping) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({listener, POLLIN, 0});
+        for (const Connection &c : connections) fds.push_back({c.fd, POLLIN, 0});
+        if (poll(fds.data(), fds.size(), 1000) < 0) continue;
+
+        // Back to front, closing a connection shifts the ones after it
+        for (size_t i = connections.size(); i-- > 0;) {
+            Connection &c = connections[i];
+            short events = fds[i + 1].revents;
+            if (events & (POLLIN | POLLHUP | POLLERR)) {
+                char buffer[4096];
+                ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    closeConnection(i, "by client");
+                    continue;
+                }
+                c.in.append(buffer, n);
+                if (!serve(c)) closeConnection(i, "by server");
+            } else if (idleSeconds > 0 && nowMs() - c.lastMs > idleSeconds * 1000.0) {
+                closeConnection(i, "idle");
+            }
+        }
+        if (fds[0].revents & POLLIN) acceptConnection(listener);
+    }
+
+    printf("\n%d connections, %d requests (%.1f per connection), %d refused\n", connectionCount, requestCount,
+           connectionCount > 0 ? (double)requestCount / connectionCount : 0.0, errorCount);
+    return 0;
+}
@@ -0,0 +1,157 @@
+// Sample bus under real threads: 4M samples from one producer to a fast and a
+// slow consumer and a sensorLatest() reader, checking order, slot reuse and drops
+
+#include "sensor_bus.h"
+#include "host_test.h"
+#include <atomic>
+#include <thread>
+
+const uint32_t SAMPLES = 4000000;
+
+// --- DRIVERS ---
+// Every sample carries its own seq in the payload, so a consumer can tell a
+// sample that was overwritten under it. Both drivers read on every tick
+
+static uint32_t readCount = 0;      // Equals the seq the bus gives the next sample
+static uint32_t lightCount = 0;
+
+static bool meterRead(SensorSample &sample) {
+    sample.power.voltage = 230.0f;
+    sample.power.energy = (float)readCount++;  // Exact below 2^24
+    return true;
+}
+
+static bool lightRead(SensorSample &sample) {
+    sample.light.level = readCount & 0xFFFF;
+    sample.light.raw = readCount >> 16;
+    readCount++;
+    lightCount++;
+    return true;
+}
+
+static const SensorDriver meter = {"meter", SENSOR_POWER, 0, 0, 1000, NULL, NULL, meterRead};
+static const SensorDriver light = {"light", SENSOR_LIGHT, 0, 0, 1000, NULL, NULL, lightRead};
+
+static bool intact(const SensorSample &s) {
+    switch (s.type) {
+    case SENSOR_POWER:
+        return s.power.voltage == 230.0f && s.power.energy == (float)s.seq;
+    case SENSOR_LIGHT:
+        return s.light.level == (s.seq & 0xFFFF) && s.light.raw == s.seq >> 16;
+    }
+    return false;
+}
+
+// --- CONSUMERS ---
+
+static std::atomic<bool> producing(true);
+
+struct Consumer {
+    int id;
+    uint32_t mask;
+    bool yields;        // Gives up the CPU after every sample, falls behind and drops
+    uint32_t received;
+    uint32_t lastSeq;
+    uint32_t bad;       // Wrong type or payload, or out of order
+    uint32_t reused;    // Slot overwritten before it was released
+};
+
+static void consume(Consumer &c) {
+    while (true) {
+        const SensorSample *s = sensorPeek(c.id);
+        if (s == NULL) {
+            if (!producing.load(std::memory_order_acquire) && sensorPeek(c.id) == NULL) return;
+            std::this_thread::yield();
+            continue;
+        }
+
+        SensorSample copy = *s;
+        if (!intact(copy) || !(c.mask & SENSOR_MASK(copy.type))) c.bad++;
+        if (c.received > 0 && copy.seq <= c.lastSeq) c.bad++;
+        if (c.yields) std::this_thread::yield();
+        if (memcmp(s, &copy, sizeof(copy)) != 0) c.reused++;
+
+        c.lastSeq = copy.seq;
+        c.received++;
+        sensorRelease(c.id);
+    }
+}
+
+// The sequence lock never hands out a torn sample, and never goes backwards
+static uint32_t latestReads = 0;
+static uint32_t latestBad = 0;
+
+static void readLatest() {
+    uint32_t last = 0;
+    while (producing.load(std::memory_order_acquire)) {
+        SensorSample s;
+        if (!sensorLatest(SENSOR_LIGHT, s)) continue;
+        if (s.type != SENSOR_LIGHT || !intact(s) || s.seq < last) latestBad++;
+        last = s.seq;
+        latestReads++;
+        std::this_thread::yield();
+    }
+}
+
+// --- TEST ---
+
+static void testThreaded() {
+    CHECK(sensorAdd(meter) == 0);
+    CHECK(sensorAdd(light) == 1);
+    Consumer fast = {sensorSubscribe("fast", SENSOR_ALL), SENSOR_ALL, false, 0, 0, 0, 0};
+    Consumer slow = {sensorSubscribe("slow", SENSOR_MASK(SENSOR_LIGHT)), SENSOR_MASK(SENSOR_LIGHT), true, 0, 0, 0, 0};
+    CHECK(fast.id == 0 && slow.id == 1);
+    sensorsBegin();
+
+    std::thread fastThread(consume, std::ref(fast));
+    std::thread slowThread(consume, std::ref(slow));
+    std::thread latestThread(readLatest);
+
+    double start = wallNanos();
+    // A turn for the others every SENSOR_QUEUE_DEPTH samples, as the sensor task
+    // sleeps between ticks. Without it one core runs the producer alone
+    for (uint32_t ticks = 1; readCount < SAMPLES; ticks++) {
+        sensorsTick();
+        if (ticks % (SENSOR_QUEUE_DEPTH / 2) == 0) std::this_thread::yield();
+    }
+    double publishNs = (wallNanos() - start) / readCount;
+    producing.store(false, std::memory_order_release);
+
+    fastThread.join();
+    slowThread.join();
+    latestThread.join();
+
+    SensorBusStats bus;
+    getSensorBusStats(bus);
+    SensorSubscriberStats fastStats, slowStats;
+    CHECK(getSensorSubscriberStats(fast.id, fastStats));
+    CHECK(getSensorSubscriberStats(slow.id, slowStats));
+
+    CHECK(bus.published == SAMPLES);
+    CHECK(fast.bad == 0 && fast.reused == 0);
+    CHECK(slow.bad == 0 && slow.reused == 0);
+    CHECK(latestBad == 0);
+
+    // Every sample is either delivered and received or dropped for that subscriber
+    CHECK(fast.received == fastStats.delivered);
+    CHECK(slow.received == slowStats.delivered);
+    CHECK(fastStats.delivered + fastStats.dropped == SAMPLES);
+    CHECK(slowStats.delivered + slowStats.dropped == lightCount);
+    CHECK(slowStats.dropped > 0);
+    CHECK(fastStats.maxQueued <= (uint32_t)SENSOR_QUEUE_DEPTH && slowStats.maxQueued <= (uint32_t)SENSOR_QUEUE_DEPTH);
+
+    // The queues hold at most 2 x SENSOR_QUEUE_DEPTH slots, fewer than the pool.
+    // A slot that was never given back would show up here over 4M samples
+    CHECK(bus.poolFull == 0);
+
+    printf("bench: %u samples, publish %.0f ns, %u sensorLatest() reads\n", SAMPLES, publishNs, latestReads);
+    printf("bench: fast got %u dropped %u max queued %u\n", fastStats.delivered, fastStats.dropped,
+           fastStats.maxQueued);
+    printf("bench: slow got %u dropped %u max queued %u\n", slowStats.delivered, slowStats.dropped,
+           slowStats.maxQueued);
+}
+
+int main() {
+    testThreaded();
+    return hostTestResult("sensor_bus_test");
+}
@@ -0,0 +1,145 @@
+// Cached timestamp formatter against gmtime() + strftime(), the path
+// getTimestamp() and getISOTimestamp() used: same text, then time per call
+
+#include "timestamp.h"
+#include "wifi_firebase.h"
+#include "host_test.h"
+#include <time.h>
+#include <string>
+
+const uint32_t ZONE_OFFSET = GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC;
+
+// --- OLD PATH ---
+// configTime() sets a fixed offset, so localtime() is gmtime() of the shifted time
+
+static std::string strftimeLocal(uint32_t unixTime) {
+    time_t t = (time_t)unixTime + ZONE_OFFSET;
+    char buffer[25];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    return std::string(buffer);
+}
+
+static std::string strftimeIso(uint32_t unixTime) {
+    time_t t = unixTime;
+    char buffer[32];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+    return std::string(buffer);
+}
+
+// --- CHECKS ---
+
+static bool matches(uint32_t unixTime) {
+    char local[TIMESTAMP_LOCAL_SIZE];
+    char iso[TIMESTAMP_ISO_SIZE];
+    bool ok = formatLocalTime(local, unixTime) == TIMESTAMP_LOCAL_SIZE - 1 &&
+              formatIsoTime(iso, unixTime) == TIMESTAMP_ISO_SIZE - 1 &&
+              strftimeLocal(unixTime) == local && strftimeIso(unixTime) == iso;
+    if (!ok) printf("%u: %s / %s\n", unixTime, local, iso);
+    return ok;
+}
+
+static void testFormats() {
+    // Not synced yet: the local form stays at the epoch, like the old getTimestamp()
+    char buffer[TIMESTAMP_ISO_SIZE];
+    formatLocalTime(buffer, 0);
+    CHECK(strcmp(buffer, "1970-01-01 00:00:00") == 0);
+    formatIsoTime(buffer, 0);
+    CHECK(strcmp(buffer, "1970-01-01T00:00:00Z") == 0);
+
+    // Every second of two days, across midnight local and UTC
+    int bad = 0;
+    for (uint32_t t = 1760000000; t < 1760000000 + 2 * 86400; t++) {
+        if (!matches(t)) bad++;
+    }
+    CHECK(bad == 0);
+
+    // Month ends, leap days and century years
+    const uint32_t edges[] = {
+        951782399, 951782400, 951868799, 951868800,     // 2000-02-28/29/03-01 (leap century)
+        1709164799, 1709251199, 1709251200,             // 2024-02-28, 02-29, 03-01
+        1735689599, 1735689600,                         // New year 2025
+        4102444799, 4102444800,                         // 2100-01-01 (not a leap year)
+        4107542399, 4107542400,                         // 2100-02-28/03-01
+    };
+    for (uint32_t t : edges) {
+        CHECK(matches(t - ZONE_OFFSET));
+        CHECK(matches(t));
+    }
+
+    // Going back in time works as well as forward
+    bad = 0;
+    for (uint32_t t = 1760100000; t > 1760100000 - 86400; t -= 7) {
+        if (!matches(t)) bad++;
+    }
+    CHECK(bad == 0);
+
+    // Random times up to where the local form would overflow 32 bits
+    uint32_t x = 1;
+    bad = 0;
+    for (int i = 0; i < 200000; i++) {
+        x = x * 1664525 + 1013904223;
+        if (!matches(x % (UINT32_MAX - ZONE_OFFSET))) bad++;
+    }
+    CHECK(bad == 0);
+}
+
+static void testTimePairs() {
+    TimePair now = {1760000000, 50000};
+    CHECK(timeAtUptime(now, 20000) == 1760000000 - 30);
+    CHECK(timeAtUptime(now, 50000) == 1760000000);
+    CHECK(timeAtUptime(now, 53500) == 1760000000 + 3);
+
+    TimePair unsynced = {0, 50000};
+    CHECK(timeAtUptime(unsynced, 20000) == 0);
+
+    hostAdvance(1234000);
+    TimePair t = timeNow();
+    CHECK(t.uptimeMs == millis());
+    CHECK(t.unixTime > 1000000000);  // The host clock is set
+}
+
+// --- BENCHMARK ---
+// An upload formats the same second several times, a log line the current
+// second, a Firestore batch a run of samples a few minutes apart
+
+const int CALLS = 1000000;
+
+static void report(const char *what, double cached, double old) {
+    printf("bench: %-22s cache %6.1f ns   strftime %6.1f ns\n", what, cached / CALLS, old / CALLS);
+}
+
+template <typename Next>
+static void compare(const char *what, Next next) {
+    char buffer[TIMESTAMP_ISO_SIZE];
+    double t = wallNanos();
+    for (int i = 0; i < CALLS; i++) {
+        uint32_t u = next(i);
+        formatLocalTime(buffer, u);
+        formatIsoTime(buffer, u);
+        keep(buffer[0]);
+    }
+    double cached = wallNanos() - t;
+
+    t = wallNanos();
+    for (int i = 0; i < CALLS; i++) {
+        uint32_t u = next(i);
+        std::string local = strftimeLocal(u);
+        std::string iso = strftimeIso(u);
+        keep(local[0]);
+        keep(iso[0]);
+    }
+    report(what, cached, wallNanos() - t);
+}
+
+static void benchmark() {
+    compare("same second", [](int) { return (uint32_t)1760000000; });
+    compare("every second", [](int i) { return (uint32_t)(1760000000 + i); });
+    compare("every 5 minutes", [](int i) { return (uint32_t)(1760000000 + 300 * i); });
+}
+
+int main() {
+    testFormats();
+    testTimePairs();
+    benchmark();
+    return hostTestResult("timestamp_bench");
+}
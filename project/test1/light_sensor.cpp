@@ -1,62 +1,119 @@
 #include "light_sensor.h"
 
-// Smoothing variables to prevent flickering
-const int NUM_SAMPLES = 10;
-int samples[NUM_SAMPLES];
-int sampleIndex = 0;
-bool samplesReady = false;
+// --- SAMPLE RING ---
+// Written only by lightSensorTick(), the filters are updated per sample in O(1)
+// (O(window) for the median), so reading a value costs nothing
+uint16_t lightRing[LIGHT_RING_SIZE];
+int lightRingIndex = 0;
+int lightRingFilled = 0;
+uint32_t lightRingSum = 0;
+
+// Last LIGHT_MEDIAN_WINDOW raw samples, in arrival order and sorted
+uint16_t medianHistory[LIGHT_MEDIAN_WINDOW];
+uint16_t medianSorted[LIGHT_MEDIAN_WINDOW];
+int medianIndex = 0;
+int medianFilled = 0;
+
+uint32_t emaQ8 = 0;  // EMA << 8
+uint32_t sampleCount = 0;
+
+// --- PUBLISHED READING ---
+// Sequence lock: odd while the sampler is writing, readers retry until they
+// see the same even value before and after copying
+LightReading published = {0, 0, 0, 0, 0};
+volatile uint32_t publishSeq = 0;
 
 void initLightSensor() {
     pinMode(LIGHT_SENSOR_PIN, INPUT);
-    
-    // Initialize samples array
-    for (int i = 0; i < NUM_SAMPLES; i++) {
-        samples[i] = 0;
-    }
-    
+
+    lightRingIndex = 0;
+    lightRingFilled = 0;
+    lightRingSum = 0;
+    medianIndex = 0;
+    medianFilled = 0;
+    sampleCount = 0;
+
     Serial.println("Light sensor initialized on GPIO 5");
 }
 
-int readLightLevel() {
-    // Read new sample
-    int rawValue = analogRead(LIGHT_SENSOR_PIN);
-    
-    // Add to rolling average for smoothing
-    samples[sampleIndex] = rawValue;
-    sampleIndex = (sampleIndex + 1) % NUM_SAMPLES;
-    
-    if (sampleIndex == 0) {
-        samplesReady = true;
-    }
-    
-    // Calculate average
-    long sum = 0;
-    int count = samplesReady ? NUM_SAMPLES : sampleIndex;
-    
-    if (count == 0) {
-        return rawValue;
+// Replace the oldest sample in the sorted median window with a new one
+static uint16_t updateMedian(uint16_t sample) {
+    if (medianFilled < LIGHT_MEDIAN_WINDOW) {
+        // Still filling: plain insertion
+        int j = medianFilled++;
+        while (j > 0 && medianSorted[j - 1] > sample) {
+            medianSorted[j] = medianSorted[j - 1];
+            j--;
+        }
+        medianSorted[j] = sample;
+    } else {
+        uint16_t old = medianHistory[medianIndex];
+
+        // Find the outgoing value and slide the new one into its place
+        int j = 0;
+        while (medianSorted[j] != old) j++;
+        while (j > 0 && medianSorted[j - 1] > sample) {
+            medianSorted[j] = medianSorted[j - 1];
+            j--;
+        }
+        while (j < LIGHT_MEDIAN_WINDOW - 1 && medianSorted[j + 1] < sample) {
+            medianSorted[j] = medianSorted[j + 1];
+            j++;
+        }
+        medianSorted[j] = sample;
     }
-    
-    for (int i = 0; i < count; i++) {
-        sum += samples[i];
+
+    medianHistory[medianIndex] = sample;
+    medianIndex = (medianIndex + 1) % LIGHT_MEDIAN_WINDOW;
+    return medianSorted[medianFilled / 2];
+}
+
+void lightSensorTick() {
+    uint16_t raw = analogRead(LIGHT_SENSOR_PIN);
+    uint16_t median = updateMedian(raw);
+
+    // Running mean: swap the oldest sample out of the sum
+    if (lightRingFilled == LIGHT_RING_SIZE) {
+        lightRingSum -= lightRing[lightRingIndex];
+    } else {
+        lightRingFilled++;
     }
-    
-    return sum / count;
+    lightRing[lightRingIndex] = median;
+    lightRingSum += median;
+    lightRingIndex = (lightRingIndex + 1) % LIGHT_RING_SIZE;
+
+    // EMA, seeded with the first sample so it does not ramp up from 0
+    if (sampleCount == 0) emaQ8 = (uint32_t)median << 8;
+    else emaQ8 += (((int32_t)median << 8) - (int32_t)emaQ8) >> LIGHT_EMA_SHIFT;
+    sampleCount++;
+
+    publishSeq++;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    published.raw = raw;
+    published.median = median;
+    published.mean = lightRingSum / lightRingFilled;
+    published.ema = (emaQ8 + 128) >> 8;
+    published.samples = sampleCount;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    publishSeq++;
+}
+
+void getLightReading(LightReading &reading) {
+    uint32_t seq;
+    do {
+        seq = publishSeq;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        reading.raw = published.raw;
+        reading.median = published.median;
+        reading.mean = published.mean;
+        reading.ema = published.ema;
+        reading.samples = published.samples;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != publishSeq);
 }
 
-int calculateBrightness() {
-    int lightLevel = readLightLevel();
-    
-    // MDL-07 behavior (photoresistor module):
-    // - Bright environment: Low ADC value (close to 0) - more light = lower resistance
-    // - Dark environment: High ADC value (close to 4095) - less light = higher resistance
-    
-    // Dimmer control logic:
-    // - Bright (low ADC ~0) -> Dimmer OFF (0%) - don't need artificial light
-    // - Dark (high ADC ~4095) -> Dimmer ON (100%) - need artificial light
-    
-    int brightness = map(lightLevel, 0, 4095, 0, 100);
-    
-    // Constrain to valid range
-    return constrain(brightness, 0, 100);
+int readLightLevel() {
+    LightReading reading;
+    getLightReading(reading);
+    return reading.mean;
 }
@@ -6,16 +6,38 @@
 // MDL-07 Light Sensor Pin (Analog Output)
 #define LIGHT_SENSOR_PIN 5  // GPIO 5 (ADC1_CH4) - Changed from GPIO 4 to avoid conflict with RS485_DIR
 
+// Sampling: lightSensorTick() takes one ADC reading, call it every LIGHT_SAMPLE_PERIOD_MS
+const uint32_t LIGHT_SAMPLE_PERIOD_MS = 10;
+
+// Samples in the running mean (power of two, 32 = 320 ms at 100 Hz)
+const int LIGHT_RING_SIZE = 32;
+
+// Sliding median in front of the mean to reject spikes (odd, 1 = off)
+const int LIGHT_MEDIAN_WINDOW = 5;
+
+// EMA smoothing: each sample moves the average by 1/2^LIGHT_EMA_SHIFT of the difference
+const int LIGHT_EMA_SHIFT = 3;
+
+// Filtered views of the same sample stream, all 0-4095
+struct LightReading {
+    uint16_t raw;       // Last ADC reading
+    uint16_t median;    // Median of the last LIGHT_MEDIAN_WINDOW readings
+    uint16_t mean;      // Running mean of the last LIGHT_RING_SIZE medians
+    uint16_t ema;       // Exponential moving average of the medians
+    uint32_t samples;   // Readings taken so far
+};
+
 // Initialize the light sensor
 void initLightSensor();
 
-// Read raw light level from sensor
-// Returns: 0 (dark) to 4095 (bright light)
-int readLightLevel();
+// Take one sample and update the filters. Runs in the sampling task, never call it elsewhere
+void lightSensorTick();
 
-// Calculate dimmer brightness based on light level
-// Returns: 0 (light/off) to 100 (dark/full brightness)
-// Inverted: darker environment = brighter dimmer
-int calculateBrightness();
+// Latest filtered readings. Lock-free, never touches the ADC
+void getLightReading(LightReading &reading);
+
+// Light level from the filtered readings (running mean)
+// Returns: 0 (bright light) to 4095 (dark)
+int readLightLevel();
 
 #endif
@@ -0,0 +1,242 @@
+#include "live_server.h"
+#include "telemetry_encoder.h"
+#include "dimmer.h"
+#include "dimmer_curves.h"
+#include <WebSocketsServer.h>
+#include <lwip/sockets.h>
+
+struct LiveFrame {
+    uint16_t length;
+    char data[TELEMETRY_LIVE_MAX];
+};
+
+// Where each client is in the frame sequence
+struct LiveClient {
+    bool connected;
+    uint32_t next;         // Sequence number of the next frame to send
+    uint32_t lostInRow;    // Frames lost since the client last caught up
+};
+
+// sendTXT() keeps retrying on a full TCP window for up to WEBSOCKETS_TCP_TIMEOUT
+// (5 s), and the timer restarts on every partial write. Nothing may be sent to
+// a socket unless it can take the frame right away
+class LiveSocketServer : public WebSocketsServer {
+public:
+    LiveSocketServer(uint16_t port) : WebSocketsServer(port) {}
+
+    // lwIP only reports a socket writable with at least TCP_SNDLOWAT bytes
+    // free in its send buffer (about 2.8 KB), far more than one frame
+    bool canSend(uint8_t num) {
+        WSclient_t &c = _clients[num];
+        if (c.tcp == NULL || !c.tcp->connected()) return false;
+        int fd = c.tcp->fd();
+        if (fd < 0) return false;
+
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(fd, &set);
+        struct timeval zero = {0, 0};
+        return select(fd + 1, NULL, &set, NULL, &zero) > 0;
+    }
+
+    // Close the socket without the close handshake, which is one more
+    // write the client would hold us up on
+    void drop(uint8_t num) {
+        WSclient_t *c = &_clients[num];
+        if (clientIsConnected(c)) clientDisconnect(c);
+    }
+};
+
+static LiveSocketServer server(LIVE_PORT);
+static LiveCommandHandler commandHandler = NULL;
+
+// Frame n lives in frames[n % LIVE_RING_FRAMES] until frame n + LIVE_RING_FRAMES replaces it
+static LiveFrame frames[LIVE_RING_FRAMES];
+static uint32_t frameCount = 0;
+
+static LiveClient clients[WEBSOCKETS_SERVER_CLIENT_MAX];
+
+static LiveStats liveStats = {};
+static portMUX_TYPE liveStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// --- COMMANDS ---
+
+// Integer value of "key": in a flat JSON object, false if it is not there
+static bool findInt(const char *json, size_t length, const char *key, long &value) {
+    size_t keyLength = strlen(key);
+    for (size_t i = 0; i + keyLength + 2 < length; i++) {
+        if (json[i] != '"' || strncmp(json + i + 1, key, keyLength) != 0 || json[i + 1 + keyLength] != '"') continue;
+
+        size_t p = i + keyLength + 2;
+        while (p < length && (json[p] == ' ' || json[p] == ':')) p++;
+        if (p + 4 <= length && strncmp(json + p, "true", 4) == 0) {
+            value = 1;
+            return true;
+        }
+
+        bool negative = p < length && json[p] == '-';
+        if (negative) p++;
+        if (p >= length || json[p] < '0' || json[p] > '9') return false;
+        long v = 0;
+        while (p < length && json[p] >= '0' && json[p] <= '9' && v < 1000000) v = v * 10 + (json[p++] - '0');
+        value = negative ? -v : v;
+        return true;
+    }
+    return false;
+}
+
+static bool parseCommand(const char *json, size_t length, LiveCommand &command) {
+    long value;
+    command.automatic = findInt(json, length, "auto", value) && value == 1;
+    if (command.automatic) return true;
+
+    long channel, level, fade = 0;
+    if (!findInt(json, length, "dimmer", channel) || !findInt(json, length, "level", level)) return false;
+    findInt(json, length, "fade_ms", fade);
+
+    if (channel < 1 || channel > dimmerChannelCount()) return false;
+    if (level < 0 || level > DIMMER_LEVELS) return false;
+    if (fade < 0 || fade > (long)LIVE_MAX_FADE_MS) return false;
+
+    command.channel = channel;
+    command.level = level;
+    command.fadeMs = fade;
+    return true;
+}
+
+static void onEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length) {
+    if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) return;
+    LiveClient &c = clients[num];
+
+    switch (type) {
+    case WStype_CONNECTED:
+        // Start with the newest frame so the dashboard has something to show right away
+        c.connected = true;
+        c.next = frameCount > 0 ? frameCount - 1 : 0;
+        c.lostInRow = 0;
+        break;
+
+    case WStype_DISCONNECTED:
+        c.connected = false;
+        break;
+
+    case WStype_TEXT: {
+        LiveCommand command;
+        bool ok = parseCommand((const char *)payload, length, command);
+        portENTER_CRITICAL(&liveStatsLock);
+        if (ok) liveStats.commands++;
+        else liveStats.rejected++;
+        portEXIT_CRITICAL(&liveStatsLock);
+
+        if (ok && commandHandler != NULL) commandHandler(command);
+        if (server.canSend(num)) server.sendTXT(num, ok ? "{\"ok\":true}" : "{\"ok\":false}");
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+// --- FEED ---
+
+void liveServerBegin(LiveCommandHandler handler) {
+    commandHandler = handler;
+    server.begin();
+    server.onEvent(onEvent);
+}
+
+void livePublish(const TelemetrySample &sample) {
+    LiveFrame &f = frames[frameCount % LIVE_RING_FRAMES];
+    f.length = encodeLivePayload(f.data, sizeof(f.data), sample, frameCount, millis());
+    frameCount++;
+
+    portENTER_CRITICAL(&liveStatsLock);
+    liveStats.published++;
+    portEXIT_CRITICAL(&liveStatsLock);
+}
+
+static void kick(uint8_t num) {
+    clients[num].connected = false;
+    server.drop(num);
+
+    portENTER_CRITICAL(&liveStatsLock);
+    liveStats.kicked++;
+    portEXIT_CRITICAL(&liveStatsLock);
+}
+
+// Count frames a client will never get, false if it was disconnected for it
+static bool loseFrames(uint8_t num, uint32_t lost) {
+    LiveClient &c = clients[num];
+    c.next += lost;
+    c.lostInRow += lost;
+
+    portENTER_CRITICAL(&liveStatsLock);
+    liveStats.dropped += lost;
+    portEXIT_CRITICAL(&liveStatsLock);
+
+    if (c.lostInRow > LIVE_DROP_LIMIT) {
+        kick(num);
+        return false;
+    }
+    return true;
+}
+
+// Send what one client has not seen yet, up to LIVE_SEND_BURST frames
+static void serviceClient(uint8_t num) {
+    LiveClient &c = clients[num];
+
+    // Frames that were overwritten before the client got them are gone
+    if (frameCount - c.next > (uint32_t)LIVE_RING_FRAMES) {
+        if (!loseFrames(num, frameCount - LIVE_RING_FRAMES - c.next)) return;
+    }
+
+    for (int n = 0; n < LIVE_SEND_BURST && c.next != frameCount; n++) {
+        // Its TCP window is full: skip this frame rather than wait for it
+        if (!server.canSend(num)) {
+            loseFrames(num, 1);
+            return;
+        }
+
+        const LiveFrame &f = frames[c.next % LIVE_RING_FRAMES];
+        c.next++;
+        if (f.length == 0) continue; // Did not fit, never happens with TELEMETRY_LIVE_MAX
+
+        unsigned long start = micros();
+        bool ok = server.sendTXT(num, f.data, f.length);
+        unsigned long elapsed = micros() - start;
+
+        portENTER_CRITICAL(&liveStatsLock);
+        if (ok) liveStats.sent++;
+        if (elapsed > liveStats.maxSendMicros) liveStats.maxSendMicros = elapsed;
+        portEXIT_CRITICAL(&liveStatsLock);
+
+        if (!ok || elapsed > LIVE_STALL_MICROS) {
+            kick(num);
+            return;
+        }
+    }
+
+    if (c.next == frameCount) c.lostInRow = 0;
+}
+
+void liveServerTick() {
+    server.loop();
+
+    uint8_t connected = 0;
+    for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+        if (!clients[i].connected) continue;
+        serviceClient(i);
+        if (clients[i].connected) connected++;
+    }
+
+    portENTER_CRITICAL(&liveStatsLock);
+    liveStats.clients = connected;
+    portEXIT_CRITICAL(&liveStatsLock);
+}
+
+void getLiveStats(LiveStats &stats) {
+    portENTER_CRITICAL(&liveStatsLock);
+    stats = liveStats;
+    portEXIT_CRITICAL(&liveStatsLock);
+}
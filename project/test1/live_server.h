@@ -0,0 +1,70 @@
+#ifndef LIVE_SERVER_H
+#define LIVE_SERVER_H
+
+#include <Arduino.h>
+#include "telemetry_queue.h"
+
+// --- LAN LIVE FEED ---
+// WebSocket server on the local network: every published sample goes to all
+// connected clients, with no cloud round trip. Clients can send dimmer commands back:
+//   {"dimmer":1,"level":500,"fade_ms":200}   set one channel (level 0 - DIMMER_LEVELS)
+//   {"auto":true}                            hand the lamps back to the daylight control
+// Published frames sit in a small ring that every client reads at its own
+// pace. Nothing is sent to a client whose TCP window is full: it loses that
+// frame instead, as does a client that falls a whole ring behind. One that
+// keeps losing frames is disconnected. No client can hold up the others.
+// Everything runs in the task that calls liveServerTick(), publish from that task too
+
+const uint16_t LIVE_PORT = 81;
+
+// One frame per control period
+const unsigned long LIVE_PUBLISH_MS = 100;
+
+// Frames kept for clients that are behind (1.6 s at one frame per 100 ms)
+const int LIVE_RING_FRAMES = 16;
+
+// Frames sent to one client per tick at most
+const int LIVE_SEND_BURST = 4;
+
+// A client is disconnected after losing this many frames without catching up
+const uint32_t LIVE_DROP_LIMIT = 50;
+
+// ... or when a single send still takes longer than this
+const unsigned long LIVE_STALL_MICROS = 50000;
+
+// Longest dimmer fade a command may ask for (ms)
+const unsigned long LIVE_MAX_FADE_MS = 60000;
+
+// Validated dimmer command from a client
+struct LiveCommand {
+    bool automatic;       // true: back to automatic control, the other fields are unused
+    int channel;          // 1 to dimmerChannelCount()
+    int level;            // 0 to DIMMER_LEVELS
+    unsigned long fadeMs;
+};
+
+typedef void (*LiveCommandHandler)(const LiveCommand &command);
+
+struct LiveStats {
+    uint8_t clients;        // Connected right now
+    uint32_t published;     // Frames published
+    uint32_t sent;          // Frames sent, all clients together
+    uint32_t dropped;       // Frames a client missed because it was too far behind
+    uint32_t kicked;        // Clients disconnected for being too slow
+    uint32_t commands;      // Accepted commands
+    uint32_t rejected;      // Malformed or out of range commands
+    uint32_t maxSendMicros; // Slowest single send
+};
+
+// Start listening on LIVE_PORT. handler is called for every valid command
+void liveServerBegin(LiveCommandHandler handler);
+
+// Queue one sample for all clients
+void livePublish(const TelemetrySample &sample);
+
+// Accept clients, read commands and send queued frames. Call every 10 - 20 ms
+void liveServerTick();
+
+void getLiveStats(LiveStats &stats);
+
+#endif
@@ -0,0 +1,296 @@
+#include "log_sink.h"
+
+// --- RING ---
+// Producers reserve space and copy whole records under the lock, the drain is
+// the only consumer and never takes it: it only reads up to logHead and only
+// moves logTail, and producers never write past logTail
+static uint8_t ring[LOG_BUFFER_SIZE];
+static volatile size_t logHead = 0;   // Next byte to write
+static volatile size_t logTail = 0;   // Next byte to send
+static portMUX_TYPE logLock = portMUX_INITIALIZER_UNLOCKED;
+
+static LogLevel maxLevel = LOG_INFO;
+
+// Token bucket in bytes, refilled from millis() on every record
+static uint32_t tokens = LOG_RATE_BURST;
+static unsigned long lastRefill = 0;
+
+static LogStats logStats = {};
+
+static const uint32_t POW10[] = {1, 10, 100, 1000, 10000};
+
+// Bytes logEnd() appends after the fields: "}\n" for JSON, nothing for MessagePack
+#if LOG_MSGPACK
+static const size_t RECORD_TAIL = 0;
+#else
+static const size_t RECORD_TAIL = 2;
+#endif
+
+void logSetLevel(LogLevel level) {
+    maxLevel = level;
+}
+
+// --- RECORD BUILDING ---
+
+// Once something did not fit nothing more is written, the record is dropped by logEnd()
+static void put(LogRecord &r, const void *data, size_t length) {
+    if (r.overflow || r.length + length > LOG_RECORD_MAX - RECORD_TAIL) {
+        r.overflow = true;
+        return;
+    }
+    memcpy(r.data + r.length, data, length);
+    r.length += length;
+}
+
+static void put(LogRecord &r, const char *text) {
+    put(r, text, strlen(text));
+}
+
+static void putByte(LogRecord &r, uint8_t b) {
+    put(r, &b, 1);
+}
+
+// Decimal digits of v, most significant first
+static void putDigits(LogRecord &r, uint32_t v) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    while (n > 0) putByte(r, digits[--n]);
+}
+
+#if LOG_MSGPACK
+static void putBigEndian(LogRecord &r, uint32_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) putByte(r, (v >> (8 * i)) & 0xFF);
+}
+
+static void putMsgPackString(LogRecord &r, const char *text) {
+    size_t length = strlen(text);
+    if (length > 255) length = 255;
+    if (length < 32) {
+        putByte(r, 0xA0 | length);      // fixstr
+    } else {
+        putByte(r, 0xD9);               // str 8
+        putByte(r, length);
+    }
+    put(r, text, length);
+}
+
+static void putMsgPackInt(LogRecord &r, int32_t v) {
+    if (v >= 0 && v < 128) {
+        putByte(r, v);                  // positive fixint
+    } else if (v < 0 && v >= -32) {
+        putByte(r, (uint8_t)(int8_t)v); // negative fixint
+    } else {
+        putByte(r, 0xD2);               // int 32
+        putBigEndian(r, (uint32_t)v, 4);
+    }
+}
+#endif
+
+// Key and separator in front of every value
+static bool beginField(LogRecord &r, const char *key) {
+    if (!r.enabled) return false;
+#if LOG_MSGPACK
+    putMsgPackString(r, key);
+#else
+    if (r.fields > 0) putByte(r, ',');
+    putByte(r, '"');
+    put(r, key);
+    put(r, "\":");
+#endif
+    r.fields++;
+    return true;
+}
+
+bool logBegin(LogRecord &r, LogLevel level) {
+    r.length = 0;
+    r.fields = 0;
+    r.level = level;
+    r.overflow = false;
+    r.enabled = level <= maxLevel;
+
+    if (!r.enabled) {
+        portENTER_CRITICAL(&logLock);
+        logStats.filtered++;
+        portEXIT_CRITICAL(&logLock);
+        return false;
+    }
+
+#if LOG_MSGPACK
+    // map 16, the entry count is filled in by logEnd()
+    putByte(r, 0xDE);
+    putByte(r, 0);
+    putByte(r, 0);
+#else
+    putByte(r, '{');
+#endif
+    return true;
+}
+
+void logInt(LogRecord &r, const char *key, int32_t value) {
+    if (!beginField(r, key)) return;
+#if LOG_MSGPACK
+    putMsgPackInt(r, value);
+#else
+    if (value < 0) putByte(r, '-');
+    putDigits(r, value < 0 ? 0u - (uint32_t)value : (uint32_t)value);
+#endif
+}
+
+void logUnsigned(LogRecord &r, const char *key, uint32_t value) {
+    if (!beginField(r, key)) return;
+#if LOG_MSGPACK
+    if (value < 128) {
+        putByte(r, value);
+    } else {
+        putByte(r, 0xCE);               // uint 32
+        putBigEndian(r, value, 4);
+    }
+#else
+    putDigits(r, value);
+#endif
+}
+
+void logFloat(LogRecord &r, const char *key, float value, int decimals) {
+    if (!beginField(r, key)) return;
+#if LOG_MSGPACK
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    putByte(r, 0xCA);                   // float 32
+    putBigEndian(r, bits, 4);
+#else
+    decimals = constrain(decimals, 0, 4);
+    if (isnan(value) || isinf(value) || fabsf(value) >= 4e9f / POW10[decimals]) {
+        put(r, "null");
+        return;
+    }
+
+    // Fixed point with rounding, same digits Serial.print(value, decimals) gives
+    float scaled = fabsf(value) * POW10[decimals] + 0.5f;
+    uint32_t magnitude = (uint32_t)scaled;
+    if (value < 0 && magnitude != 0) putByte(r, '-');
+    putDigits(r, magnitude / POW10[decimals]);
+    if (decimals == 0) return;
+
+    putByte(r, '.');
+    uint32_t rest = magnitude % POW10[decimals];
+    for (int i = decimals - 1; i >= 0; i--) putByte(r, '0' + rest / POW10[i] % 10);
+#endif
+}
+
+void logBool(LogRecord &r, const char *key, bool value) {
+    if (!beginField(r, key)) return;
+#if LOG_MSGPACK
+    putByte(r, value ? 0xC3 : 0xC2);
+#else
+    put(r, value ? "true" : "false");
+#endif
+}
+
+void logString(LogRecord &r, const char *key, const char *value) {
+    if (!beginField(r, key)) return;
+#if LOG_MSGPACK
+    putMsgPackString(r, value);
+#else
+    putByte(r, '"');
+    put(r, value);
+    putByte(r, '"');
+#endif
+}
+
+// --- QUEUEING ---
+
+static size_t ringUsed() {
+    return (logHead + LOG_BUFFER_SIZE - logTail) % LOG_BUFFER_SIZE;
+}
+
+bool logEnd(LogRecord &r) {
+    if (!r.enabled) return false;
+
+#if LOG_MSGPACK
+    r.data[1] = r.fields >> 8;
+    r.data[2] = r.fields & 0xFF;
+#else
+    // put() always leaves room for these
+    r.data[r.length++] = '}';
+    r.data[r.length++] = '\n';
+#endif
+    // A cut record is not valid JSON (or desyncs a MessagePack reader): drop it
+    bool keep = !r.overflow;
+
+    bool queued = false;
+    portENTER_CRITICAL(&logLock);
+    if (r.overflow) logStats.truncated++;
+
+    unsigned long now = millis();
+    uint32_t refill = (uint64_t)(now - lastRefill) * LOG_RATE_BYTES_PER_SEC / 1000;
+    if (refill > 0) {
+        tokens = min(tokens + refill, LOG_RATE_BURST);
+        lastRefill = now;
+    }
+
+    // One byte is always left free so a full ring is not mistaken for an empty one
+    if (!keep) {
+        // Counted as truncated above
+    } else if (r.level != LOG_ERROR && tokens < r.length) {
+        logStats.rateLimited++;
+    } else if (LOG_BUFFER_SIZE - 1 - ringUsed() < r.length) {
+        logStats.dropped++;
+    } else {
+        if (r.level != LOG_ERROR) tokens -= r.length;
+
+        size_t head = logHead;
+        size_t first = min(r.length, LOG_BUFFER_SIZE - head);
+        memcpy(ring + head, r.data, first);
+        memcpy(ring, r.data + first, r.length - first);
+        logHead = (head + r.length) % LOG_BUFFER_SIZE;
+
+        logStats.records++;
+        size_t used = ringUsed();
+        if (used > logStats.maxUsed) logStats.maxUsed = used;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&logLock);
+    return queued;
+}
+
+bool logText(LogLevel level, const char *key, const char *value) {
+    LogRecord r;
+    if (!logBegin(r, level)) return false;
+    logString(r, key, value);
+    return logEnd(r);
+}
+
+// --- DRAIN ---
+
+void logDrain() {
+    // Only as much as the UART takes right now, Serial.write() never waits then
+    int room = Serial.availableForWrite();
+    while (room > 0) {
+        size_t head = logHead;
+        size_t tail = logTail;
+        if (head == tail) break;
+
+        // Contiguous part up to the end of the ring or the head
+        size_t chunk = head > tail ? head - tail : LOG_BUFFER_SIZE - tail;
+        if (chunk > (size_t)room) chunk = room;
+
+        size_t sent = Serial.write(ring + tail, chunk);
+        if (sent == 0) break;
+        logTail = (tail + sent) % LOG_BUFFER_SIZE;
+        room -= sent;
+
+        portENTER_CRITICAL(&logLock);
+        logStats.bytes += sent;
+        portEXIT_CRITICAL(&logLock);
+    }
+}
+
+void getLogStats(LogStats &stats) {
+    portENTER_CRITICAL(&logLock);
+    stats = logStats;
+    portEXIT_CRITICAL(&logLock);
+}
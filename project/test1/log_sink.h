@@ -0,0 +1,83 @@
+#ifndef LOG_SINK_H
+#define LOG_SINK_H
+
+#include <Arduino.h>
+
+// --- BUFFERED LOG ---
+// Records are formatted on the caller's stack and copied into a RAM ring,
+// logDrain() moves them to the UART no faster than its FIFO takes them.
+// A task that logs never waits for the serial port, when the ring is full
+// the record is dropped and counted instead.
+//
+//   LogRecord r;
+//   logBegin(r, LOG_INFO);
+//   logFloat(r, "temperature", t, 1);
+//   logEnd(r);              // {"temperature":23.4}
+//
+// Keys and string values are written as they are, they must not need JSON escaping
+
+// Binary output for host tools: each record is one MessagePack map instead of a
+// JSON line. Build with -DLOG_MSGPACK=1
+#ifndef LOG_MSGPACK
+#define LOG_MSGPACK 0
+#endif
+
+const size_t LOG_BUFFER_SIZE = 4096;  // Ring between the tasks and the UART
+const size_t LOG_RECORD_MAX = 256;    // Longer records are dropped (and counted as truncated)
+
+// Records below LOG_ERROR share a token bucket, so a chatty task cannot fill
+// the UART. 115200 baud moves about 11 KB/s
+const uint32_t LOG_RATE_BYTES_PER_SEC = 8000;
+const uint32_t LOG_RATE_BURST = 4096;
+
+enum LogLevel {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+};
+
+// One record being built, lives on the caller's stack
+struct LogRecord {
+    char data[LOG_RECORD_MAX];
+    size_t length;
+    uint16_t fields;
+    LogLevel level;
+    bool enabled;     // false when filtered out, the field calls then do nothing
+    bool overflow;
+};
+
+struct LogStats {
+    uint32_t records;      // Records accepted into the ring
+    uint32_t bytes;        // Bytes handed to the UART
+    uint32_t dropped;      // Ring was full
+    uint32_t rateLimited;  // Over the byte rate
+    uint32_t filtered;     // Below the current level
+    uint32_t truncated;    // Dropped for being longer than LOG_RECORD_MAX
+    uint32_t maxUsed;      // High water mark of the ring (bytes)
+};
+
+// Records more verbose than this are discarded, LOG_INFO by default
+void logSetLevel(LogLevel level);
+
+// Start a record. Returns false if the level is filtered out
+bool logBegin(LogRecord &record, LogLevel level);
+
+void logInt(LogRecord &record, const char *key, int32_t value);
+void logUnsigned(LogRecord &record, const char *key, uint32_t value);
+void logFloat(LogRecord &record, const char *key, float value, int decimals);
+void logBool(LogRecord &record, const char *key, bool value);
+void logString(LogRecord &record, const char *key, const char *value);
+
+// Finish the record and queue it. Returns false if it was dropped
+bool logEnd(LogRecord &record);
+
+// Shorthand for a record with a single string field
+bool logText(LogLevel level, const char *key, const char *value);
+
+// Move queued bytes to Serial without blocking, call it every few ms
+void logDrain();
+
+void getLogStats(LogStats &stats);
+
+#endif
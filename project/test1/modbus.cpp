@@ -1,96 +1,274 @@
 #include "modbus.h"
-#include <HardwareSerial.h>
+#include <CRC16Modbus.h>
 
-extern HardwareSerial SensorSerial;
+// --- TRANSACTION STATE MACHINE ---
+// IDLE     -> bus silent for T3.5, next request goes out
+// SENDING  -> frame is in the UART, wait until the last bit has left before releasing the driver
+// WAITING  -> collect reply bytes until the expected length or T3.5 of silence, or time out
+enum MasterState
+{
+  MASTER_IDLE,
+  MASTER_SENDING,
+  MASTER_WAITING
+};
 
-// Making sure the data not changed even one bit during transmission
-static uint16_t modbusCRC(byte *buf, int len)
+struct ModbusRequest
 {
-  uint16_t crc = 0xFFFF;
-  for (int pos = 0; pos < len; pos++)
-  {
-    // Assign crc with the XOR of the next byte data
-    // Cast buf[pos] to uint16_t since XOR need to have the same bit width
-    // Adding 8 new bits to the crc since casting 8 bit to 16 bit so the first 8 is 0
-    crc ^= (uint16_t)buf[pos];
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  uint8_t count;
+  ModbusCallback callback;
+  void *context;
+};
 
-    // Loop 8 time since we only need to process 8 bits, while the other 8 is padding
-    for (int i = 8; i != 0; i--)
-    {
-      // Checking if the lowest bit is 1
-      if ((crc & 0x0001) != 0)
-      {
-        // Shift right by 1 bit
-        // Then assign crc with the XOR of the polynomial
-        crc >>= 1;
-        crc ^= 0xA001;
-      }
-      else
-      {
-        // Just shift right by 1 bit
-        crc >>= 1;
-      }
-    }
-  }
-  return crc;
+// Longest reply we accept: address + function + byte count + data + CRC
+static const int MAX_REPLY = 5 + 2 * MODBUS_MAX_REGISTERS;
+
+static HardwareSerial *bus = NULL;
+static int dirPin = -1;
+
+static unsigned long charMicros = 0;  // Time to shift one 11-bit character out
+static unsigned long silenceMicros = 0; // T3.5 inter-frame gap
+
+static ModbusRequest queue[MODBUS_QUEUE_SIZE];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+
+static MasterState state = MASTER_IDLE;
+static byte reply[MAX_REPLY];
+static int replyLen = 0;
+static uint16_t replyCRC = CRC16_MODBUS_INIT; // Updated as each reply byte arrives
+static int expectedLen = 0;
+static unsigned long txStart = 0;      // micros() when the frame was handed to the UART
+static unsigned long txDuration = 0;   // How long the frame takes on the wire
+static unsigned long waitStart = 0;    // millis() when we switched to receive
+static unsigned long lastByteMicros = 0; // micros() of the last received byte
+static unsigned long lastBusActivity = 0; // micros() when the bus last went quiet
+
+static ModbusStats stats = {0, 0, 0, 0, 0, 0};
+
+void modbusBegin(HardwareSerial &port, int pin, unsigned long baud)
+{
+  bus = &port;
+  dirPin = pin;
+
+  pinMode(dirPin, OUTPUT);
+  digitalWrite(dirPin, LOW);
+
+  // Modbus RTU counts 11 bits per character (start + 8 data + parity/stop + stop)
+  charMicros = 11000000UL / baud;
+
+  // Above 19200 baud the spec fixes the inter-frame gap at 1.75 ms
+  if (baud > 19200)
+    silenceMicros = 1750;
+  else
+    silenceMicros = (charMicros * 7) / 2;
+
+  // Hand every received byte to the driver right away so the byte timestamps are accurate
+  bus->setRxFIFOFull(1);
+
+  lastBusActivity = micros();
+}
+
+bool modbusRead(uint8_t slave, uint8_t function, uint16_t reg, uint8_t count,
+                ModbusCallback callback, void *context)
+{
+  if (count == 0 || count > MODBUS_MAX_REGISTERS)
+    return false;
+  if (queueCount >= MODBUS_QUEUE_SIZE)
+    return false;
+
+  ModbusRequest &req = queue[(queueHead + queueCount) % MODBUS_QUEUE_SIZE];
+  req.slave = slave;
+  req.function = function;
+  req.reg = reg;
+  req.count = count;
+  req.callback = callback;
+  req.context = context;
+  queueCount++;
+  return true;
+}
+
+bool modbusReadInputRegisters(uint8_t slave, uint16_t reg, uint8_t count,
+                              ModbusCallback callback, void *context)
+{
+  return modbusRead(slave, MODBUS_READ_INPUT_REGISTERS, reg, count, callback, context);
+}
+
+uint8_t modbusQueueFree()
+{
+  return MODBUS_QUEUE_SIZE - queueCount;
+}
+
+bool modbusIdle()
+{
+  return state == MASTER_IDLE && queueCount == 0;
+}
+
+void modbusGetStats(ModbusStats &out)
+{
+  out = stats;
 }
 
-// Read the Modbus register
-// High Byte : the first 8 number from 16 bits
-// Low Byte  : the last 8 number from 16 bits
-float readModBus(uint16_t reg)
+// Send the request at the head of the queue
+static void startTransaction()
 {
+  const ModbusRequest &req = queue[queueHead];
+
   byte cmd[8];
-  cmd[0] = 0x01;       // Slave ID ( check ref manual )
-  cmd[1] = 0x04;       // Function code ( check ref manual )
-  cmd[2] = reg >> 8;   // Hight Byte (0x00)
-  cmd[3] = reg & 0xFF; // Low Byte (0x01)
-  cmd[4] = 0x00;       // Count High Byte (0x00)
-  cmd[5] = 0x01;       // Count Low Byte (0x01, read 1 register)
+  cmd[0] = req.slave;    // Slave ID ( check ref manual )
+  cmd[1] = req.function; // Function code ( check ref manual )
+  cmd[2] = req.reg >> 8;   // Register High Byte
+  cmd[3] = req.reg & 0xFF; // Register Low Byte
+  cmd[4] = 0x00;           // Count High Byte
+  cmd[5] = req.count;      // Count Low Byte
   // array 0 - 5 is the command data, 6 and 7 is CRC
 
-  uint16_t crc = modbusCRC(cmd, 6);
+  // Making sure the data not changed even one bit during transmission
+  uint16_t crc = crc16Modbus(cmd, 6);
   cmd[6] = crc & 0xFF;        // CRC Low Byte
   cmd[7] = (crc >> 8) & 0xFF; // CRC High Byte
 
-  digitalWrite(RS485_DIR, HIGH); // Send through RS485
-  delay(10);
-  SensorSerial.write(cmd, 8);   // Send Data (cmd) with length of (8) bytes
-  SensorSerial.flush();         // Making sure all data is sent before switching to receive mode
-  digitalWrite(RS485_DIR, LOW); // Switch to receive mode
-  delay(200);                   // Wait for response
-
-  // Actual respon only 7 bytes
-  // response[0] = 0x01;   ->     Slave ID
-  // response[1] = 0x04;    ->    Function code
-  // response[2] = 0x02;    ->    Byte count (2 data bytes)
-  // response[3] = HIGH;    ->    Data high byte
-  // response[4] = LOW;     ->    Data low byte
-  // response[5] = CRC_LOW; ->    CRC low byte
-  // response[6] = CRC_HIGH;->    CRC high byte
-
-  byte response[8]; // Allocate 8 bytes to avoid buffer overflow
-  unsigned int i = 0;
-  unsigned long start = millis(); // Start time for response timeout
-  while (millis() - start < 500)  // Wait for response
+  // Throw away anything left over from a previous, late reply
+  while (bus->available())
+    bus->read();
+
+  digitalWrite(dirPin, HIGH); // Send through RS485
+  bus->write(cmd, 8);         // Goes into the TX FIFO, returns immediately
+
+  txStart = micros();
+  txDuration = 8 * charMicros;
+  replyLen = 0;
+  replyCRC = CRC16_MODBUS_INIT;
+  // Address + function + byte count + 2 bytes per register + CRC
+  expectedLen = 5 + 2 * req.count;
+  state = MASTER_SENDING;
+}
+
+// Pop the current request and report its outcome
+static void finishTransaction(ModbusStatus status)
+{
+  ModbusRequest req = queue[queueHead];
+  queueHead = (queueHead + 1) % MODBUS_QUEUE_SIZE;
+  queueCount--;
+  state = MASTER_IDLE;
+  lastBusActivity = micros();
+
+  stats.transactions++;
+  stats.busyMicros += lastBusActivity - txStart;
+  if (status == MODBUS_TIMEOUT)
+    stats.timeouts++;
+  else if (status == MODBUS_CRC_ERROR)
+    stats.crcErrors++;
+  else if (status == MODBUS_EXCEPTION)
+    stats.exceptions++;
+  else if (status == MODBUS_BAD_FRAME)
+    stats.badFrames++;
+
+  if (req.callback == NULL)
+    return;
+
+  ModbusResult result;
+  result.status = status;
+  result.slave = req.slave;
+  result.function = req.function;
+  result.reg = req.reg;
+  result.count = req.count;
+  result.exceptionCode = 0;
+  result.startMicros = txStart;
+  result.durationMicros = lastBusActivity - txStart;
+
+  if (status == MODBUS_EXCEPTION)
   {
-    // Check if data is available
-    if (SensorSerial.available())
-    {
-      // Read the incoming byte by assigning it to the response array
-      response[i++] = SensorSerial.read();
-      if (i >= sizeof(response))
-        break;
-    }
+    result.exceptionCode = reply[2];
   }
-
-  // Check response validity
-  if (i >= 5 && response[1] == 0x04)
+  else if (status == MODBUS_OK)
   {
-    // Shifting high byte to the left by 8 bits and ORing with low byte
-    int raw = (response[3] << 8) | response[4];
-    return raw / 10.0; // Convert to float and divide by 10 for temperature/humidity since it have 0.1f resolution ( check ref manual )
+    // Data starts at byte 3, each register is High Byte then Low Byte
+    for (int i = 0; i < req.count; i++)
+      result.values[i] = (reply[3 + 2 * i] << 8) | reply[4 + 2 * i];
   }
 
-  return -1;
-}
\ No newline at end of file
+  // The callback may queue the next request, the slot was already released
+  req.callback(result, req.context);
+}
+
+// Validate a complete reply frame
+static ModbusStatus checkReply()
+{
+  const ModbusRequest &req = queue[queueHead];
+
+  if (replyLen < 5)
+    return MODBUS_BAD_FRAME;
+
+  // The running CRC already covers the trailing CRC bytes, a good frame leaves zero
+  if (replyCRC != CRC16_MODBUS_RESIDUE)
+    return MODBUS_CRC_ERROR;
+
+  if (reply[0] != req.slave)
+    return MODBUS_BAD_FRAME;
+
+  // Exception reply: function code with the high bit set, then the exception code
+  if (reply[1] == (req.function | 0x80))
+    return MODBUS_EXCEPTION;
+
+  if (reply[1] != req.function || reply[2] != 2 * req.count || replyLen != expectedLen)
+    return MODBUS_BAD_FRAME;
+
+  return MODBUS_OK;
+}
+
+void modbusTick()
+{
+  if (bus == NULL)
+    return;
+
+  unsigned long now = micros();
+
+  switch (state)
+  {
+  case MASTER_IDLE:
+    // Respect the T3.5 gap since the bus last went quiet before talking again
+    if (queueCount > 0 && now - lastBusActivity >= silenceMicros)
+      startTransaction();
+    break;
+
+  case MASTER_SENDING:
+    // Keep the driver enabled until the whole frame has been shifted out
+    if (now - txStart < txDuration)
+      break;
+    bus->flush();                 // Only waits for the last few bit times, if any
+    digitalWrite(dirPin, LOW);    // Switch to receive mode
+    waitStart = millis();
+    state = MASTER_WAITING;
+    break;
+
+  case MASTER_WAITING:
+    while (bus->available())
+    {
+      byte c = bus->read();
+      if (replyLen < MAX_REPLY)
+      {
+        reply[replyLen++] = c;
+        replyCRC = crc16ModbusUpdate(replyCRC, c);
+      }
+      lastByteMicros = micros();
+    }
+
+    if (replyLen > 0)
+    {
+      // Exception replies are always 5 bytes, no need to wait for the silence
+      bool isException = replyLen >= 5 && (reply[1] & 0x80);
+      bool silent = micros() - lastByteMicros >= silenceMicros;
+
+      if (replyLen >= expectedLen || isException || silent)
+        finishTransaction(checkReply());
+    }
+    else if (millis() - waitStart >= MODBUS_RESPONSE_TIMEOUT_MS)
+    {
+      finishTransaction(MODBUS_TIMEOUT);
+    }
+    break;
+  }
+}
@@ -2,9 +2,83 @@
 #define MODBUS_H
 
 #include <Arduino.h>
+#include <HardwareSerial.h>
 
 const int RS485_DIR = 4;
 
-float readModBus(uint16_t reg);
+// Largest register block a single request may read (the protocol allows 125)
+const uint8_t MODBUS_MAX_REGISTERS = 32;
+
+// Requests waiting for the bus, the one on the wire included
+const uint8_t MODBUS_QUEUE_SIZE = 8;
+
+// How long a slave may take before the first byte of its reply arrives
+const unsigned long MODBUS_RESPONSE_TIMEOUT_MS = 500;
+
+// Function codes used by the sensors on the bus
+const uint8_t MODBUS_READ_HOLDING_REGISTERS = 0x03;
+const uint8_t MODBUS_READ_INPUT_REGISTERS = 0x04;
+
+enum ModbusStatus
+{
+  MODBUS_OK,
+  MODBUS_TIMEOUT,   // No reply within MODBUS_RESPONSE_TIMEOUT_MS
+  MODBUS_CRC_ERROR, // Reply arrived but the checksum did not match
+  MODBUS_EXCEPTION, // Slave answered with an exception code
+  MODBUS_BAD_FRAME  // Reply was too short or from the wrong slave/function
+};
+
+// Outcome of one transaction, handed to the request callback
+struct ModbusResult
+{
+  ModbusStatus status;
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  uint8_t count;
+  uint8_t exceptionCode;                  // Only valid for MODBUS_EXCEPTION
+  uint16_t values[MODBUS_MAX_REGISTERS];  // Only valid for MODBUS_OK
+  uint32_t startMicros;                   // micros() when the request left the UART
+  uint32_t durationMicros;                // Request start until the reply was complete
+};
+
+// Running totals since modbusBegin()
+struct ModbusStats
+{
+  uint32_t transactions;
+  uint32_t timeouts;
+  uint32_t crcErrors;
+  uint32_t exceptions;
+  uint32_t badFrames;
+  uint32_t busyMicros; // Time the bus spent in transactions, wraps after ~71 minutes
+};
+
+typedef void (*ModbusCallback)(const ModbusResult &result, void *context);
+
+// Attach the master to a UART that has already been begun at the given baud rate
+// dirPin is the RS485 driver enable (HIGH = transmit, LOW = receive)
+void modbusBegin(HardwareSerial &port, int dirPin, unsigned long baud);
+
+// Queue a read of 'count' registers starting at 'reg'
+// The callback runs from modbusTick() once the transaction is over
+// Returns false if the queue is full or the request is invalid
+bool modbusRead(uint8_t slave, uint8_t function, uint16_t reg, uint8_t count,
+                ModbusCallback callback, void *context);
+
+// Shorthand for function 0x04, the one the XY-MD02 uses
+bool modbusReadInputRegisters(uint8_t slave, uint16_t reg, uint8_t count,
+                              ModbusCallback callback, void *context);
+
+// Advance the transaction state machine. Never blocks, call it every loop()
+void modbusTick();
+
+// Free slots in the request queue
+uint8_t modbusQueueFree();
+
+// True when nothing is queued and the bus is not in a transaction
+bool modbusIdle();
+
+// Copy of the transaction counters
+void modbusGetStats(ModbusStats &stats);
 
 #endif
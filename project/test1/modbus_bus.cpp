@@ -0,0 +1,107 @@
+#include "modbus_bus.h"
+
+HardwareSerial SensorSerial(2); // UART2 for Modbus
+
+static ModbusDevice devices[MODBUS_BUS_MAX_DEVICES];
+static uint8_t deviceCount = 0;
+
+// Utilisation window
+static unsigned long windowStart = 0;
+static uint32_t windowBusyStart = 0;
+static float utilisation = 0;
+
+void modbusBusBegin()
+{
+  SensorSerial.begin(MODBUS_BAUD, SERIAL_8N1, MODBUS_RX_PIN, MODBUS_TX_PIN);
+  modbusBegin(SensorSerial, RS485_DIR, MODBUS_BAUD); // RS485_DIR from modbus.h
+
+  windowStart = millis();
+  windowBusyStart = 0;
+}
+
+int modbusBusAddDevice(const char *name, ModbusMap &map, unsigned long periodMs, uint8_t priority)
+{
+  if (deviceCount >= MODBUS_BUS_MAX_DEVICES)
+    return -1;
+
+  ModbusDevice &dev = devices[deviceCount];
+  dev.name = name;
+  dev.map = &map;
+  dev.periodMs = periodMs;
+  dev.priority = priority;
+  dev.nextDue = millis(); // Poll right away
+  dev.polls = 0;
+  dev.lateStarts = 0;
+  return deviceCount++;
+}
+
+const ModbusDevice *modbusBusDevice(int index)
+{
+  if (index < 0 || index >= deviceCount)
+    return NULL;
+  return &devices[index];
+}
+
+// Highest priority device that is due and not already on the bus, or -1
+static int nextDueDevice(unsigned long now)
+{
+  int best = -1;
+  for (int i = 0; i < deviceCount; i++)
+  {
+    const ModbusDevice &dev = devices[i];
+    if ((long)(now - dev.nextDue) < 0 || modbusMapBusy(*dev.map))
+      continue;
+    if (best < 0 || dev.priority > devices[best].priority)
+      best = i;
+  }
+  return best;
+}
+
+void modbusBusTick()
+{
+  modbusTick();
+
+  unsigned long now = millis();
+
+  // Queue every due device that fits, so the master sends them back to back
+  // separated only by the T3.5 gap
+  for (int n = 0; n < deviceCount; n++)
+  {
+    int i = nextDueDevice(now);
+    if (i < 0)
+      break;
+
+    ModbusDevice &dev = devices[i];
+    if (!modbusMapPoll(*dev.map))
+      break; // Queue full, try again next tick
+
+    dev.polls++;
+    dev.nextDue += dev.periodMs;
+
+    // More than a whole period behind: the bus cannot keep up, skip ahead instead of bursting
+    if ((long)(now - dev.nextDue) >= 0)
+    {
+      dev.lateStarts++;
+      dev.nextDue = now + dev.periodMs;
+    }
+  }
+
+  // Roll the utilisation window
+  if (now - windowStart >= MODBUS_BUS_STATS_WINDOW_MS)
+  {
+    ModbusStats master;
+    modbusGetStats(master);
+    utilisation = (master.busyMicros - windowBusyStart) / ((now - windowStart) * 1000.0f);
+    windowBusyStart = master.busyMicros;
+    windowStart = now;
+  }
+}
+
+void modbusBusGetStats(ModbusBusStats &out)
+{
+  modbusGetStats(out.master);
+  out.utilisation = utilisation;
+  out.lateStarts = 0;
+  for (int i = 0; i < deviceCount; i++)
+    out.lateStarts += devices[i].lateStarts;
+}
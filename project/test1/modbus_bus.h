@@ -0,0 +1,56 @@
+#ifndef MODBUS_BUS_H
+#define MODBUS_BUS_H
+
+#include <Arduino.h>
+#include <HardwareSerial.h>
+#include "modbus.h"
+#include "modbus_map.h"
+
+// RS485 transceiver wiring and line settings
+#define MODBUS_RX_PIN 18
+#define MODBUS_TX_PIN 17
+const unsigned long MODBUS_BAUD = 9600;
+
+// Devices the scheduler can hold
+const uint8_t MODBUS_BUS_MAX_DEVICES = 8;
+
+// Window over which bus utilisation is measured
+const unsigned long MODBUS_BUS_STATS_WINDOW_MS = 1000;
+
+// The UART the bus owns (UART2)
+extern HardwareSerial SensorSerial;
+
+struct ModbusDevice
+{
+  const char *name;
+  ModbusMap *map;
+  unsigned long periodMs;
+  uint8_t priority;       // Higher goes first when several devices are due together
+  unsigned long nextDue;  // millis() of the next poll
+  uint32_t polls;         // Polls handed to the master
+  uint32_t lateStarts;    // Polls that started a full period late (bus saturated)
+};
+
+struct ModbusBusStats
+{
+  ModbusStats master;     // Totals from the transaction engine
+  float utilisation;      // Fraction of the last window the bus was busy (0.0 - 1.0)
+  uint32_t lateStarts;    // Sum over all devices
+};
+
+// Start SensorSerial, the direction pin and the Modbus master
+void modbusBusBegin();
+
+// Register a device whose map is polled every periodMs
+// Returns the device index, or -1 if the table is full
+int modbusBusAddDevice(const char *name, ModbusMap &map, unsigned long periodMs, uint8_t priority);
+
+// Advance the master and queue every due device, highest priority first
+// Call every loop(), never blocks
+void modbusBusTick();
+
+const ModbusDevice *modbusBusDevice(int index);
+
+void modbusBusGetStats(ModbusBusStats &stats);
+
+#endif
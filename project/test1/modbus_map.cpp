@@ -0,0 +1,163 @@
+#include "modbus_map.h"
+
+// Registers taken by a field of the given type
+static uint8_t fieldWidth(ModbusFieldType type)
+{
+  return (type == FIELD_U16 || type == FIELD_S16) ? 1 : 2;
+}
+
+// Order fields by slave, function and register so neighbours end up next to each other
+static bool fieldBefore(const ModbusField &a, const ModbusField &b)
+{
+  if (a.slave != b.slave)
+    return a.slave < b.slave;
+  if (a.function != b.function)
+    return a.function < b.function;
+  return a.reg < b.reg;
+}
+
+bool modbusMapBuild(ModbusMap &map, ModbusField *fields, uint8_t fieldCount, uint8_t maxGap)
+{
+  map.fields = fields;
+  map.fieldCount = fieldCount;
+  map.blockCount = 0;
+  map.pending = 0;
+  map.lastPollMicros = 0;
+  map.pollMicros = 0;
+  map.polls = 0;
+
+  // Insertion sort, maps are a handful of fields and this runs once at setup
+  for (int i = 1; i < fieldCount; i++)
+  {
+    ModbusField f = fields[i];
+    int j = i - 1;
+    while (j >= 0 && fieldBefore(f, fields[j]))
+    {
+      fields[j + 1] = fields[j];
+      j--;
+    }
+    fields[j + 1] = f;
+  }
+
+  ModbusBlock *block = NULL;
+  for (int i = 0; i < fieldCount; i++)
+  {
+    const ModbusField &f = fields[i];
+    uint16_t end = f.reg + fieldWidth(f.type); // One past the last register of this field
+
+    // Extend the current block if the field is close enough and still fits
+    if (block != NULL &&
+        block->slave == f.slave &&
+        block->function == f.function &&
+        f.reg <= block->reg + block->count + maxGap &&
+        end - block->reg <= MODBUS_MAX_REGISTERS)
+    {
+      if (end > block->reg + block->count)
+        block->count = end - block->reg;
+      block->fieldCount++;
+      continue;
+    }
+
+    if (map.blockCount >= MODBUS_MAP_MAX_BLOCKS)
+      return false;
+
+    block = &map.blocks[map.blockCount++];
+    block->map = &map;
+    block->slave = f.slave;
+    block->function = f.function;
+    block->reg = f.reg;
+    block->count = fieldWidth(f.type);
+    block->firstField = i;
+    block->fieldCount = 1;
+    block->lastStatus = MODBUS_TIMEOUT;
+    block->lastDurationMicros = 0;
+  }
+
+  return true;
+}
+
+// Turn the registers of one field into its scaled value
+static float decodeField(const ModbusField &f, const uint16_t *regs)
+{
+  switch (f.type)
+  {
+  case FIELD_U16:
+    return regs[0] * f.scale;
+  case FIELD_S16:
+    return (int16_t)regs[0] * f.scale;
+  case FIELD_U32:
+    return ((uint32_t)regs[0] << 16 | regs[1]) * f.scale;
+  case FIELD_S32:
+    return (int32_t)((uint32_t)regs[0] << 16 | regs[1]) * f.scale;
+  case FIELD_U32_SWAPPED:
+    return ((uint32_t)regs[1] << 16 | regs[0]) * f.scale;
+  }
+  return -1;
+}
+
+static void onBlockRead(const ModbusResult &result, void *context)
+{
+  ModbusBlock *block = (ModbusBlock *)context;
+  ModbusMap *map = block->map;
+
+  block->lastStatus = result.status;
+  block->lastDurationMicros = result.durationMicros;
+
+  for (int i = 0; i < block->fieldCount; i++)
+  {
+    const ModbusField &f = map->fields[block->firstField + i];
+    if (f.value != NULL && result.status == MODBUS_OK)
+      *f.value = decodeField(f, &result.values[f.reg - block->reg]);
+  }
+
+  map->pollMicros += result.durationMicros;
+  if (--map->pending == 0)
+  {
+    map->lastPollMicros = map->pollMicros;
+    map->polls++;
+  }
+}
+
+bool modbusMapPoll(ModbusMap &map)
+{
+  if (map.pending > 0 || modbusQueueFree() < map.blockCount)
+    return false;
+
+  map.pollMicros = 0;
+  for (int i = 0; i < map.blockCount; i++)
+  {
+    ModbusBlock &block = map.blocks[i];
+    if (modbusRead(block.slave, block.function, block.reg, block.count, onBlockRead, &block))
+      map.pending++;
+  }
+  return true;
+}
+
+bool modbusMapBusy(const ModbusMap &map)
+{
+  return map.pending > 0;
+}
+
+bool modbusMapOk(const ModbusMap &map)
+{
+  for (int i = 0; i < map.blockCount; i++)
+  {
+    if (map.blocks[i].lastStatus != MODBUS_OK)
+      return false;
+  }
+  return map.blockCount > 0;
+}
+
+bool modbusMapValueOk(const ModbusMap &map, const float *value)
+{
+  for (int i = 0; i < map.blockCount; i++)
+  {
+    const ModbusBlock &block = map.blocks[i];
+    for (int j = 0; j < block.fieldCount; j++)
+    {
+      if (map.fields[block.firstField + j].value == value)
+        return block.lastStatus == MODBUS_OK;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,81 @@
+#ifndef MODBUS_MAP_H
+#define MODBUS_MAP_H
+
+#include <Arduino.h>
+#include "modbus.h"
+
+// How a field is laid out in the register block
+enum ModbusFieldType
+{
+  FIELD_U16,        // One register, unsigned
+  FIELD_S16,        // One register, two's complement
+  FIELD_U32,        // Two registers, high word first
+  FIELD_S32,        // Two registers, high word first, two's complement
+  FIELD_U32_SWAPPED // Two registers, low word first (PZEM style)
+};
+
+// One value to read from a slave
+// value = raw * scale, written to *value after every successful read. A failed
+// read leaves the last good value in place, see modbusMapOk() and modbusMapValueOk()
+struct ModbusField
+{
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  ModbusFieldType type;
+  float scale;
+  float *value;
+};
+
+// Blocks a single map can be split into
+const uint8_t MODBUS_MAP_MAX_BLOCKS = 8;
+
+struct ModbusMap;
+
+// A run of registers read with one request
+struct ModbusBlock
+{
+  ModbusMap *map;
+  uint8_t slave;
+  uint8_t function;
+  uint16_t reg;
+  uint8_t count;
+  uint8_t firstField;  // Index into ModbusMap::fields
+  uint8_t fieldCount;
+  ModbusStatus lastStatus;     // MODBUS_TIMEOUT until the first read completes
+  uint32_t lastDurationMicros; // Bus time of the last transaction
+};
+
+struct ModbusMap
+{
+  ModbusField *fields;
+  uint8_t fieldCount;
+  ModbusBlock blocks[MODBUS_MAP_MAX_BLOCKS];
+  uint8_t blockCount;
+  uint8_t pending;          // Transactions of the current poll still on the bus
+  uint32_t lastPollMicros;  // Bus time of the last complete poll (sum of its transactions)
+  uint32_t pollMicros;      // Running sum for the poll in progress
+  uint32_t polls;           // Completed polls
+};
+
+// Sort the fields and coalesce them into as few requests as possible
+// Fields of the same slave/function are merged when at most maxGap unused registers
+// separate them and the block stays within MODBUS_MAX_REGISTERS
+// Returns false if the fields need more than MODBUS_MAP_MAX_BLOCKS requests
+bool modbusMapBuild(ModbusMap &map, ModbusField *fields, uint8_t fieldCount, uint8_t maxGap = 4);
+
+// Queue one request per block. Returns false if the previous poll is still running
+// or the Modbus queue has no room
+bool modbusMapPoll(ModbusMap &map);
+
+// True while requests of the last poll are outstanding
+bool modbusMapBusy(const ModbusMap &map);
+
+// True if every block was read successfully in the last poll
+bool modbusMapOk(const ModbusMap &map);
+
+// True if the block holding the field that writes to value was read successfully
+// in the last poll. False for a pointer that belongs to no field of the map
+bool modbusMapValueOk(const ModbusMap &map, const float *value);
+
+#endif
@@ -1,19 +1,38 @@
 #include "pzem.h"
-#include <PZEM004Tv30.h>
+#include <PZEMBus.h>
 #include <HardwareSerial.h>
 
 HardwareSerial pzemSerial(1); // Use UART 1
 
-PZEM004Tv30 pzem(pzemSerial, PZEM_RX_PIN, PZEM_TX_PIN);
+// All meters share UART 1, each needs its own address (see PZEMChangeAddress)
+PZEMBus pzemBus(pzemSerial, PZEM_RX_PIN, PZEM_TX_PIN);
+
+// Meter addresses on the bus. A single meter can stay on the general address
+const uint8_t PZEM_ADDRESSES[] = {PZEM_DEFAULT_ADDR};
 
 void initializePZEM() {
-    // The library constructor now handles calling begin() for ESP32
+    // The bus constructor handles calling begin() for ESP32
+    for (uint8_t addr : PZEM_ADDRESSES) {
+        pzemBus.addMeter(addr);
+    }
+    pzemBus.setInterval(PZEM_READ_INTERVAL);
+}
+
+void pzemTick() {
+    // Collects reply bytes and starts the next meter's read as soon as the bus is free
+    pzemBus.loop();
 }
 
-PzemData readPZEM() {
+int pzemMeterCount() {
+    return pzemBus.meterCount();
+}
+
+PzemData readPZEM(int meter) {
     PzemData data;
-    data.voltage = pzem.voltage();
-    if (isnan(data.voltage)) {
+    PZEMValues values;
+
+    // No reply yet, or the meter stopped answering
+    if (!pzemBus.getValues(meter, values) || pzemBus.valuesAge(meter) > PZEM_STALE_MS) {
         data.connected = false;
         data.voltage = 0;
         data.current = 0;
@@ -23,11 +42,12 @@ PzemData readPZEM() {
         data.pf = 0;
     } else {
         data.connected = true;
-        data.current = pzem.current();
-        data.power = pzem.power();
-        data.energy = pzem.energy();
-        data.frequency = pzem.frequency();
-        data.pf = pzem.pf();
+        data.voltage = values.voltage;
+        data.current = values.current;
+        data.power = values.power;
+        data.energy = values.energy;
+        data.frequency = values.frequency;
+        data.pf = values.pf;
     }
     return data;
 }
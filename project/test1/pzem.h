@@ -7,6 +7,12 @@
 const int PZEM_RX_PIN = 15;  // ESP32 RX (receives from PZEM TX)
 const int PZEM_TX_PIN = 16;  // ESP32 TX (sends to PZEM RX)
 
+// Each meter is read this often (one 25 byte transaction for all values)
+const unsigned long PZEM_READ_INTERVAL = 500;
+
+// Snapshot older than this is reported as disconnected
+const unsigned long PZEM_STALE_MS = 2000;
+
 struct PzemData {
   float voltage;
   float current;
@@ -18,6 +24,14 @@ struct PzemData {
 };
 
 void initializePZEM();
-PzemData readPZEM();
+
+// Drive the meter bus, call every loop(). Never blocks
+void pzemTick();
+
+// Number of meters on the bus
+int pzemMeterCount();
+
+// Latest snapshot of one meter, does not touch the UART
+PzemData readPZEM(int meter = 0);
 
 #endif
@@ -0,0 +1,117 @@
+#include "scheduler.h"
+
+struct ScheduledTask {
+    void (*fn)();
+    uint32_t stackBytes;
+    UBaseType_t priority;
+    BaseType_t core;
+    TaskHandle_t handle;
+    TaskStats stats;
+};
+
+static ScheduledTask tasks[SCHEDULER_MAX_TASKS];
+static int numTasks = 0;
+
+// Protects the statistics, tasks update them while others read
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+
+int addTask(const char *name, void (*fn)(), uint32_t periodMs, uint32_t deadlineMs,
+            uint32_t stackBytes, UBaseType_t priority, BaseType_t core) {
+    if (numTasks >= SCHEDULER_MAX_TASKS || periodMs == 0) {
+        return -1;
+    }
+
+    ScheduledTask &t = tasks[numTasks];
+    t.fn = fn;
+    t.stackBytes = stackBytes;
+    t.priority = priority;
+    t.core = core;
+    t.handle = NULL;
+
+    memset(&t.stats, 0, sizeof(t.stats));
+    t.stats.name = name;
+    t.stats.periodMs = periodMs;
+    t.stats.deadlineMs = deadlineMs ? deadlineMs : periodMs;
+    t.stats.stackFree = stackBytes;
+
+    return numTasks++;
+}
+
+// Body of every FreeRTOS task: run fn once per period and time it
+static void taskRunner(void *arg) {
+    ScheduledTask *t = (ScheduledTask *)arg;
+    const TickType_t periodTicks = pdMS_TO_TICKS(t->stats.periodMs);
+    const int64_t periodUs = (int64_t)t->stats.periodMs * 1000;
+    const int64_t deadlineUs = (int64_t)t->stats.deadlineMs * 1000;
+
+    TickType_t lastWake = xTaskGetTickCount();
+    int64_t release = esp_timer_get_time(); // Ideal start of the current run
+
+    for (;;) {
+        int64_t start = esp_timer_get_time();
+        t->fn();
+        int64_t end = esp_timer_get_time();
+
+        uint32_t jitter = start > release ? (uint32_t)(start - release) : 0;
+        uint32_t exec = (uint32_t)(end - start);
+        uint32_t stackFree = uxTaskGetStackHighWaterMark(NULL);
+
+        portENTER_CRITICAL(&statsLock);
+        TaskStats &s = t->stats;
+        s.runs++;
+        s.lastJitter = jitter;
+        s.lastExec = exec;
+        if (jitter > s.maxJitter) s.maxJitter = jitter;
+        if (exec > s.maxExec) s.maxExec = exec;
+        if (end - release > deadlineUs) s.overruns++;
+        s.stackFree = stackFree;
+        portEXIT_CRITICAL(&statsLock);
+
+        release += periodUs;
+
+        // pdFALSE means the next release is already in the past: the run took
+        // longer than a period. Skip the missed releases instead of running
+        // back to back to catch up
+        if (xTaskDelayUntil(&lastWake, periodTicks) == pdFALSE) {
+            int64_t now = esp_timer_get_time();
+            uint32_t missed = (uint32_t)((now - release) / periodUs) + 1;
+
+            portENTER_CRITICAL(&statsLock);
+            t->stats.skipped += missed;
+            portEXIT_CRITICAL(&statsLock);
+
+            lastWake = xTaskGetTickCount();
+            release = now;
+        }
+    }
+}
+
+void startScheduler() {
+    for (int i = 0; i < numTasks; i++) {
+        ScheduledTask &t = tasks[i];
+        if (t.handle != NULL) {
+            continue; // Already running
+        }
+
+        if (xTaskCreatePinnedToCore(taskRunner, t.stats.name, t.stackBytes, &t,
+                                    t.priority, &t.handle, t.core) != pdPASS) {
+            Serial.print("Failed to start task ");
+            Serial.println(t.stats.name);
+        }
+    }
+}
+
+int taskCount() {
+    return numTasks;
+}
+
+bool getTaskStats(int id, TaskStats &stats) {
+    if (id < 0 || id >= numTasks) {
+        return false;
+    }
+
+    portENTER_CRITICAL(&statsLock);
+    stats = tasks[id].stats;
+    portEXIT_CRITICAL(&statsLock);
+    return true;
+}
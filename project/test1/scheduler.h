@@ -0,0 +1,42 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+
+// Maximum number of scheduled tasks
+const int SCHEDULER_MAX_TASKS = 12;
+
+// Run on whichever core is free
+const BaseType_t SCHEDULER_ANY_CORE = tskNO_AFFINITY;
+
+// Timing of one task, all times in microseconds
+struct TaskStats {
+    const char *name;
+    uint32_t periodMs;
+    uint32_t deadlineMs;
+    uint32_t runs;
+    uint32_t overruns;       // Runs that finished after release + deadline
+    uint32_t skipped;        // Releases dropped because the previous run was still going
+    uint32_t lastJitter;     // Start time minus ideal release time
+    uint32_t maxJitter;
+    uint32_t lastExec;       // Execution time of the task function
+    uint32_t maxExec;
+    uint32_t stackFree;      // Smallest amount of stack left so far, in bytes
+};
+
+// Register a periodic task. It gets its own FreeRTOS task with the given stack
+// size (bytes) and priority, and calls fn every periodMs
+// deadlineMs: fn must finish within this long of its release, 0 = same as period
+// Returns the task id, or -1 if the table is full
+int addTask(const char *name, void (*fn)(), uint32_t periodMs, uint32_t deadlineMs,
+            uint32_t stackBytes, UBaseType_t priority, BaseType_t core = SCHEDULER_ANY_CORE);
+
+// Create the FreeRTOS tasks for everything registered so far
+void startScheduler();
+
+int taskCount();
+
+// Copy of the timing statistics of one task
+bool getTaskStats(int id, TaskStats &stats);
+
+#endif
@@ -0,0 +1,273 @@
+#include "sensor_bus.h"
+
+// Slot numbers fit a byte
+static_assert(SENSOR_POOL_SLOTS <= 256, "sensor pool too large");
+static_assert((SENSOR_QUEUE_DEPTH & (SENSOR_QUEUE_DEPTH - 1)) == 0, "queue depth must be a power of two");
+
+// --- DRIVERS ---
+// Only touched by sensorsTick() once the tasks run
+
+struct DriverState {
+    const SensorDriver *driver;
+    uint32_t lastTick;
+    uint32_t lastRead;
+};
+
+static DriverState drivers[SENSOR_MAX_DRIVERS];
+static int driverCount = 0;
+
+// --- POOL ---
+// refs[i] counts the subscribers still holding slot i. Only the producer
+// raises it (from 0), consumers lower it when they release the sample
+
+static SensorSample pool[SENSOR_POOL_SLOTS];
+static uint8_t refs[SENSOR_POOL_SLOTS];
+static int poolCursor = 0;   // Where the producer looks for a free slot next
+
+// --- SUBSCRIBER QUEUES ---
+// head is written by the producer only, tail by the consumer only
+
+struct Subscriber {
+    const char *name;
+    uint32_t mask;
+    volatile uint32_t head;   // Entries pushed
+    volatile uint32_t tail;   // Entries released
+    uint8_t slots[SENSOR_QUEUE_DEPTH];
+    uint32_t delivered;
+    uint32_t dropped;
+    uint32_t maxQueued;
+};
+
+static Subscriber subscribers[SENSOR_MAX_SUBSCRIBERS];
+static int subscriberCount = 0;
+
+// --- LATEST ---
+// Newest sample per type behind a sequence lock, same scheme as the light sensor:
+// odd while the producer is writing, readers retry until it is even and unchanged
+
+static SensorSample latest[SENSOR_TYPE_COUNT];
+static volatile uint32_t latestSeq[SENSOR_TYPE_COUNT];
+static bool latestValid[SENSOR_TYPE_COUNT];
+
+static uint32_t publishedCount = 0;
+static uint32_t poolFullCount = 0;
+
+int sensorAdd(const SensorDriver &driver) {
+    if (driverCount >= SENSOR_MAX_DRIVERS || driver.read == NULL || driver.type >= SENSOR_TYPE_COUNT) {
+        return -1;
+    }
+    DriverState &d = drivers[driverCount];
+    d.driver = &driver;
+    d.lastTick = 0;
+    d.lastRead = 0;
+    return driverCount++;
+}
+
+int sensorSubscribe(const char *name, uint32_t typeMask) {
+    if (subscriberCount >= SENSOR_MAX_SUBSCRIBERS) {
+        return -1;
+    }
+    Subscriber &s = subscribers[subscriberCount];
+    s.name = name;
+    s.mask = typeMask;
+    s.head = 0;
+    s.tail = 0;
+    s.delivered = 0;
+    s.dropped = 0;
+    s.maxQueued = 0;
+    return subscriberCount++;
+}
+
+void sensorsBegin() {
+    for (int i = 0; i < driverCount; i++) {
+        if (drivers[i].driver->begin != NULL) drivers[i].driver->begin();
+        drivers[i].lastTick = millis();
+        drivers[i].lastRead = millis();
+    }
+}
+
+static int allocateSlot() {
+    for (int n = 0; n < SENSOR_POOL_SLOTS; n++) {
+        int slot = poolCursor;
+        poolCursor = (poolCursor + 1) % SENSOR_POOL_SLOTS;
+        if (__atomic_load_n(&refs[slot], __ATOMIC_ACQUIRE) == 0) return slot;
+    }
+    return -1;
+}
+
+static void publish(const SensorSample &sample) {
+    publishedCount++;
+
+    uint32_t seq = latestSeq[sample.type];
+    latestSeq[sample.type] = seq + 1;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    latest[sample.type] = sample;
+    latestValid[sample.type] = true;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    latestSeq[sample.type] = seq + 2;
+
+    // Who gets it. Queues only gain room while we look, so the count holds
+    Subscriber *targets[SENSOR_MAX_SUBSCRIBERS];
+    int targetCount = 0;
+    for (int i = 0; i < subscriberCount; i++) {
+        Subscriber &s = subscribers[i];
+        if (!(s.mask & SENSOR_MASK(sample.type))) continue;
+        if (s.head - __atomic_load_n(&s.tail, __ATOMIC_ACQUIRE) >= (uint32_t)SENSOR_QUEUE_DEPTH) {
+            s.dropped++;
+            continue;
+        }
+        targets[targetCount++] = &s;
+    }
+    if (targetCount == 0) return;
+
+    int slot = allocateSlot();
+    if (slot < 0) {
+        poolFullCount++;
+        return;
+    }
+    pool[slot] = sample;
+
+    // Set the count before any consumer can see the slot and release it
+    __atomic_store_n(&refs[slot], (uint8_t)targetCount, __ATOMIC_RELEASE);
+
+    for (int i = 0; i < targetCount; i++) {
+        Subscriber &s = *targets[i];
+        uint32_t head = s.head;
+        s.slots[head % SENSOR_QUEUE_DEPTH] = slot;
+        __atomic_store_n(&s.head, head + 1, __ATOMIC_RELEASE);
+
+        s.delivered++;
+        uint32_t queued = head + 1 - __atomic_load_n(&s.tail, __ATOMIC_ACQUIRE);
+        if (queued > s.maxQueued) s.maxQueued = queued;
+    }
+}
+
+void sensorsTick() {
+    uint32_t now = millis();
+
+    for (int i = 0; i < driverCount; i++) {
+        DriverState &d = drivers[i];
+        const SensorDriver &driver = *d.driver;
+
+        if (driver.tick != NULL && (driver.tickMs == 0 || now - d.lastTick >= driver.tickMs)) {
+            // Keep the average rate, but do not try to catch up after a long stall
+            d.lastTick += driver.tickMs;
+            if (now - d.lastTick >= driver.tickMs) d.lastTick = now;
+            driver.tick();
+        }
+
+        if (now - d.lastRead < driver.readMs) continue;
+        d.lastRead += driver.readMs;
+        if (now - d.lastRead >= driver.readMs) d.lastRead = now;
+
+        SensorSample sample;
+        memset(&sample, 0, sizeof(sample));
+        if (!driver.read(sample)) continue;
+
+        sample.seq = publishedCount;
+        sample.time = timeNow();
+        sample.type = driver.type;
+        sample.source = i;
+        publish(sample);
+    }
+}
+
+const SensorSample *sensorPeek(int subscription) {
+    if (subscription < 0 || subscription >= subscriberCount) return NULL;
+    Subscriber &s = subscribers[subscription];
+
+    uint32_t tail = s.tail;
+    if (tail == __atomic_load_n(&s.head, __ATOMIC_ACQUIRE)) return NULL;
+    return &pool[s.slots[tail % SENSOR_QUEUE_DEPTH]];
+}
+
+void sensorRelease(int subscription) {
+    if (subscription < 0 || subscription >= subscriberCount) return;
+    Subscriber &s = subscribers[subscription];
+
+    uint32_t tail = s.tail;
+    if (tail == __atomic_load_n(&s.head, __ATOMIC_ACQUIRE)) return;
+    uint8_t slot = s.slots[tail % SENSOR_QUEUE_DEPTH];
+    __atomic_store_n(&s.tail, tail + 1, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&refs[slot], 1, __ATOMIC_ACQ_REL);
+}
+
+bool sensorLatest(uint8_t type, SensorSample &sample) {
+    if (type >= SENSOR_TYPE_COUNT) return false;
+
+    uint32_t seq;
+    bool valid;
+    do {
+        seq = latestSeq[type];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        sample = latest[type];
+        valid = latestValid[type];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != latestSeq[type]);
+    return valid;
+}
+
+void applySensorSample(SensorReadings &readings, const SensorSample &sample) {
+    if (sample.type >= SENSOR_TYPE_COUNT) return;
+    readings.quality[sample.type] = sample.quality;
+
+    switch (sample.type) {
+    case SENSOR_ENVIRONMENT:
+        if (sample.quality & SENSOR_NO_RESPONSE) {
+            readings.temperature = -1;
+            readings.humidity = -1;
+        } else {
+            readings.temperature = sample.environment.temperature;
+            readings.humidity = sample.environment.humidity;
+        }
+        break;
+    case SENSOR_POWER:
+        readings.pzem = sample.power;
+        break;
+    case SENSOR_LIGHT:
+        readings.lightLevel = sample.light.level;
+        break;
+    case SENSOR_LAMP:
+        readings.brightness = sample.lamp.brightness;
+        break;
+    }
+}
+
+void readSensors(SensorReadings &readings) {
+    memset(&readings, 0, sizeof(readings));
+    readings.temperature = -1;
+    readings.humidity = -1;
+
+    uint32_t now = millis();
+    for (uint8_t type = 0; type < SENSOR_TYPE_COUNT; type++) {
+        SensorSample sample;
+        if (!sensorLatest(type, sample)) {
+            readings.quality[type] = SENSOR_NO_RESPONSE;
+            continue;
+        }
+        applySensorSample(readings, sample);
+
+        // driverCount and the drivers are fixed once the tasks run
+        const SensorDriver &driver = *drivers[sample.source].driver;
+        if (now - sample.time.uptimeMs > driver.staleMs) {
+            readings.quality[type] |= SENSOR_STALE;
+        }
+    }
+}
+
+void getSensorBusStats(SensorBusStats &stats) {
+    stats.published = publishedCount;
+    stats.poolFull = poolFullCount;
+    stats.drivers = driverCount;
+    stats.subscribers = subscriberCount;
+}
+
+bool getSensorSubscriberStats(int subscription, SensorSubscriberStats &stats) {
+    if (subscription < 0 || subscription >= subscriberCount) return false;
+    const Subscriber &s = subscribers[subscription];
+    stats.name = s.name;
+    stats.delivered = s.delivered;
+    stats.dropped = s.dropped;
+    stats.maxQueued = s.maxQueued;
+    return true;
+}
@@ -0,0 +1,145 @@
+#ifndef SENSOR_BUS_H
+#define SENSOR_BUS_H
+
+#include <Arduino.h>
+#include "pzem.h"
+#include "timestamp.h"
+
+// --- SENSOR BUS ---
+// Every sensor is a SensorDriver: a tick() that drives its hardware and a
+// read() that turns the latest reading into a SensorSample. sensorsTick()
+// runs all drivers from one task and publishes their samples on the bus.
+//
+// A sample is written once into a shared pool slot. Each subscriber has its
+// own single-producer/single-consumer queue of slot numbers, so handing a
+// sample to N sinks is N index writes and no copies. A slot is reused once
+// every subscriber that got it has released it. The queues are lock-free:
+// sensorsTick() is the only producer, each subscription has one consumer task.
+// A full queue drops the new sample for that subscriber only.
+//
+// The newest sample of every type is also kept for sinks that want the
+// current state rather than the stream (readSensors()).
+
+// Kinds of samples, a subscriber picks the ones it wants with SENSOR_MASK()
+enum SensorType : uint8_t {
+    SENSOR_ENVIRONMENT,  // Temperature and humidity (XY-MD02)
+    SENSOR_POWER,        // Mains readings (PZEM-004T)
+    SENSOR_LIGHT,        // Filtered light level (MDL-07)
+    SENSOR_LAMP,         // Dimmer brightness set by the control loop
+    SENSOR_TYPE_COUNT
+};
+
+#define SENSOR_MASK(type) (1u << (type))
+const uint32_t SENSOR_ALL = (1u << SENSOR_TYPE_COUNT) - 1;
+
+// Sample quality bits, 0 = good
+const uint8_t SENSOR_NO_RESPONSE = 0x01;  // Device did not answer, values are not valid
+const uint8_t SENSOR_STALE = 0x02;        // No new sample for the driver's staleMs
+const uint8_t SENSOR_OUT_OF_RANGE = 0x04; // Value clamped to the sensor's range
+
+// Driver and subscriber tables
+const int SENSOR_MAX_DRIVERS = 8;
+const int SENSOR_MAX_SUBSCRIBERS = 6;
+
+// Samples in the shared pool, and queue depth per subscriber (power of two)
+const int SENSOR_POOL_SLOTS = 64;
+const int SENSOR_QUEUE_DEPTH = 16;
+
+// How often the sensor task calls sensorsTick() (ms)
+const uint32_t SENSOR_TICK_MS = 2;
+
+// One reading, 44 bytes. The bus fills in seq, time, type and source
+struct SensorSample {
+    uint32_t seq;      // Publish order over all types
+    TimePair time;     // When the driver's read() returned it
+    uint8_t type;      // SensorType
+    uint8_t source;    // Driver id
+    uint8_t quality;   // SENSOR_* quality bits
+    uint8_t reserved;
+    union {
+        struct {
+            float temperature;  // °C
+            float humidity;     // %
+        } environment;
+        PzemData power;
+        struct {
+            uint16_t level;     // Running mean, 0 (bright) - 4095 (dark)
+            uint16_t raw;       // Last ADC reading
+        } light;
+        struct {
+            uint8_t brightness; // 0-100 %
+            bool manual;        // Set from the LAN feed, not by the daylight control
+        } lamp;
+    };
+};
+
+// A sensor. tick, begin may be NULL
+struct SensorDriver {
+    const char *name;
+    uint8_t type;                        // SensorType of its samples
+    uint32_t tickMs;                     // tick() period, 0 = every sensorsTick()
+    uint32_t readMs;                     // read() period
+    uint32_t staleMs;                    // Newest sample older than this is marked SENSOR_STALE
+    void (*begin)();                     // Hardware setup, from sensorsBegin()
+    void (*tick)();                      // Drive the hardware, never blocks
+    bool (*read)(SensorSample &sample);  // Fill in the payload and quality, false = nothing new
+};
+
+// What the upload and logging tasks work from, the newest value of every type
+struct SensorReadings {
+    float temperature;   // -1 = no response
+    float humidity;      // -1 = no response
+    PzemData pzem;
+    int lightLevel;
+    int brightness;
+    uint8_t quality[SENSOR_TYPE_COUNT];
+};
+
+struct SensorSubscriberStats {
+    const char *name;
+    uint32_t delivered;   // Samples queued for this subscriber
+    uint32_t dropped;     // Samples lost because its queue was full
+    uint32_t maxQueued;   // Deepest the queue has been
+};
+
+struct SensorBusStats {
+    uint32_t published;
+    uint32_t poolFull;    // Samples lost because every pool slot was still in use
+    uint8_t drivers;
+    uint8_t subscribers;
+};
+
+// Register a driver (kept by pointer). Returns the driver id, or -1 if the table is full
+int sensorAdd(const SensorDriver &driver);
+
+// Register a subscriber for the sample types in typeMask. Call before the tasks start
+// Returns the subscription id, or -1 if the table is full
+int sensorSubscribe(const char *name, uint32_t typeMask);
+
+// Call every driver's begin()
+void sensorsBegin();
+
+// Tick and read the drivers that are due and publish their samples.
+// Call every SENSOR_TICK_MS from one task, the only producer of the bus
+void sensorsTick();
+
+// Oldest unread sample of a subscription, NULL if there is none.
+// The sample stays valid until sensorRelease(), do not keep the pointer after that
+const SensorSample *sensorPeek(int subscription);
+
+// Done with the sample sensorPeek() returned
+void sensorRelease(int subscription);
+
+// Copy of the newest sample of one type. Lock-free, false if there was none yet
+bool sensorLatest(uint8_t type, SensorSample &sample);
+
+// Fold a sample into a set of readings
+void applySensorSample(SensorReadings &readings, const SensorSample &sample);
+
+// The newest value of every type, marked stale where the driver went quiet
+void readSensors(SensorReadings &readings);
+
+void getSensorBusStats(SensorBusStats &stats);
+bool getSensorSubscriberStats(int subscription, SensorSubscriberStats &stats);
+
+#endif
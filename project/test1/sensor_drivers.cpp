@@ -0,0 +1,80 @@
+#include "sensor_drivers.h"
+#include "modbus_bus.h"
+#include "pzem.h"
+#include "light_sensor.h"
+
+// --- XY-MD02 ---
+// Reference: https://www.idbsmart.cz/wp-content/uploads/2024/05/xy-md02-manual.pdf
+
+// Latest good readings, written by the register map. A failed poll leaves them
+// as they were, modbusMapOk() tells whether they are from the last one
+static float temperature = 0;
+static float humidity = 0;
+
+// Input registers, both in 0.1 units. Adjacent registers are read with a single request
+static ModbusField environmentFields[] = {
+    {0x01, MODBUS_READ_INPUT_REGISTERS, 0x0001, FIELD_S16, 0.1f, &temperature},
+    {0x01, MODBUS_READ_INPUT_REGISTERS, 0x0002, FIELD_U16, 0.1f, &humidity},
+};
+ModbusMap environmentMap;
+
+static uint32_t environmentPolls = 0; // Polls already published
+
+static void environmentBegin() {
+    modbusBusBegin(); // SensorSerial + RS485 direction pin
+    modbusMapBuild(environmentMap, environmentFields, 2);
+    modbusBusAddDevice("xy-md02", environmentMap, ENVIRONMENT_POLL_MS, 1);
+}
+
+// One sample per completed poll
+static bool environmentRead(SensorSample &sample) {
+    if (environmentMap.polls == environmentPolls) return false;
+    environmentPolls = environmentMap.polls;
+
+    if (!modbusMapOk(environmentMap)) {
+        sample.quality = SENSOR_NO_RESPONSE;
+        return true;
+    }
+
+    // Rated range -40 to 60 °C, 0 to 100 %RH
+    sample.environment.temperature = constrain(temperature, -40.0f, 60.0f);
+    sample.environment.humidity = constrain(humidity, 0.0f, 100.0f);
+    if (sample.environment.temperature != temperature || sample.environment.humidity != humidity)
+        sample.quality = SENSOR_OUT_OF_RANGE;
+    return true;
+}
+
+const SensorDriver environmentSensor = {
+    "xy-md02", SENSOR_ENVIRONMENT, 0, 100, 3 * ENVIRONMENT_POLL_MS,
+    environmentBegin, modbusBusTick, environmentRead,
+};
+
+// --- PZEM-004T ---
+
+static bool powerRead(SensorSample &sample) {
+    sample.power = readPZEM();
+    if (!sample.power.connected) sample.quality = SENSOR_NO_RESPONSE;
+    return true;
+}
+
+const SensorDriver powerSensor = {
+    "pzem", SENSOR_POWER, 0, PZEM_READ_INTERVAL, PZEM_STALE_MS,
+    initializePZEM, pzemTick, powerRead,
+};
+
+// --- MDL-07 ---
+
+static bool lightRead(SensorSample &sample) {
+    LightReading reading;
+    getLightReading(reading);
+    if (reading.samples == 0) return false;
+
+    sample.light.level = reading.mean;
+    sample.light.raw = reading.raw;
+    return true;
+}
+
+const SensorDriver lightSensor = {
+    "mdl-07", SENSOR_LIGHT, LIGHT_SAMPLE_PERIOD_MS, LIGHT_PUBLISH_MS, 3 * LIGHT_PUBLISH_MS,
+    initLightSensor, lightSensorTick, lightRead,
+};
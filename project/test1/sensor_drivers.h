@@ -0,0 +1,25 @@
+#ifndef SENSOR_DRIVERS_H
+#define SENSOR_DRIVERS_H
+
+#include <Arduino.h>
+#include "sensor_bus.h"
+#include "modbus_map.h"
+
+// --- SENSOR DRIVERS ---
+// The sensors on this board as bus drivers (sensor_bus.h). The sketch only
+// registers them, a new sensor is one more driver here and one sensorAdd()
+
+// XY-MD02 poll period on the Modbus bus
+const unsigned long ENVIRONMENT_POLL_MS = 1000;
+
+// Light level samples on the bus, one per control period
+const unsigned long LIGHT_PUBLISH_MS = 100;
+
+extern const SensorDriver environmentSensor;  // XY-MD02 temperature / humidity, Modbus RTU
+extern const SensorDriver powerSensor;        // PZEM-004T, first meter on the bus
+extern const SensorDriver lightSensor;        // MDL-07 on the ADC, filtered
+
+// XY-MD02 register map, for its bus timing
+extern ModbusMap environmentMap;
+
+#endif
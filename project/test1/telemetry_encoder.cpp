@@ -0,0 +1,423 @@
+#include "telemetry_encoder.h"
+#include "timestamp.h"
+
+// --- BUFFER WRITER ---
+// Appends to a fixed buffer and remembers if anything did not fit,
+// so the encoders can write unconditionally and check once at the end
+struct Writer {
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+};
+
+static void put(Writer &w, const char *text, size_t n) {
+    if (w.overflow || w.length + n >= w.size) {
+        w.overflow = true;
+        return;
+    }
+    memcpy(w.buffer + w.length, text, n);
+    w.length += n;
+}
+
+static void put(Writer &w, const char *text) {
+    put(w, text, strlen(text));
+}
+
+static void putUnsigned(Writer &w, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    char out[10];
+    for (int i = 0; i < n; i++) out[i] = digits[n - 1 - i];
+    put(w, out, n);
+}
+
+static void putInteger(Writer &w, int32_t value) {
+    if (value < 0) {
+        put(w, "-", 1);
+        putUnsigned(w, (uint32_t)(-(int64_t)value));
+    } else {
+        putUnsigned(w, value);
+    }
+}
+
+// Fixed point value with the given number of decimals, e.g. (235, 1) -> "23.5"
+static void putFixed(Writer &w, int32_t value, uint8_t decimals) {
+    static const uint32_t POW10[] = {1, 10, 100, 1000, 10000};
+
+    uint32_t magnitude = value < 0 ? (uint32_t)(-(int64_t)value) : value;
+    if (value < 0) put(w, "-", 1);
+
+    putUnsigned(w, magnitude / POW10[decimals]);
+    if (decimals == 0) return;
+
+    char frac[5];
+    uint32_t rest = magnitude % POW10[decimals];
+    for (int i = decimals - 1; i >= 0; i--) {
+        frac[i] = '0' + rest % 10;
+        rest /= 10;
+    }
+    put(w, ".", 1);
+    put(w, frac, decimals);
+}
+
+static void putBool(Writer &w, bool value) {
+    put(w, value ? "true" : "false");
+}
+
+// Cached formatter (timestamp.h), 0 (clock not set) gives the 1970 epoch text
+static void putLocalTime(Writer &w, uint32_t unixTime) {
+    char text[TIMESTAMP_LOCAL_SIZE];
+    put(w, text, formatLocalTime(text, unixTime));
+}
+
+static void putIsoTime(Writer &w, uint32_t unixTime) {
+    char text[TIMESTAMP_ISO_SIZE];
+    put(w, text, formatIsoTime(text, unixTime));
+}
+
+static size_t finish(Writer &w) {
+    if (w.size == 0) return 0;
+    if (w.overflow) {
+        w.buffer[0] = '\0';
+        return 0;
+    }
+    w.buffer[w.length] = '\0';
+    return w.length;
+}
+
+// Current is kept in mA, both uploads report it with 2 decimals
+static int32_t currentCentiamps(const TelemetrySample &s) {
+    return (s.current + 5) / 10;
+}
+
+// --- RTDB ---
+
+size_t encodeRtdbPayload(char *buffer, size_t size, const TelemetrySample &s, const char *device) {
+    Writer w = {buffer, size, 0, false};
+
+    // Timestamps (root level)
+    put(w, "{\"timestamp\":\"");
+    putLocalTime(w, s.unixTime);
+    put(w, "\",\"unix_time\":");
+    putUnsigned(w, s.unixTime);
+
+    // Environment group (XY-MD02 Modbus sensor)
+    put(w, ",\"environment\":{\"temperature\":");
+    putFixed(w, s.temperature, 1);
+    put(w, ",\"humidity\":");
+    putFixed(w, s.humidity, 1);
+    put(w, ",\"connected\":");
+    putBool(w, s.flags & SAMPLE_ENV_CONNECTED);
+
+    // Power group (PZEM-004T sensor)
+    put(w, "},\"power\":{\"voltage\":");
+    putFixed(w, s.voltage, 1);
+    put(w, ",\"current\":");
+    putFixed(w, currentCentiamps(s), 2);
+    put(w, ",\"power\":");
+    putFixed(w, s.power, 1);
+    put(w, ",\"energy\":");
+    putFixed(w, s.energy, 3);
+    put(w, ",\"frequency\":");
+    putFixed(w, s.frequency, 1);
+    put(w, ",\"pf\":");
+    putFixed(w, s.pf, 2);
+    put(w, ",\"connected\":");
+    putBool(w, s.flags & SAMPLE_PZEM_CONNECTED);
+
+    // Lighting group (Light sensor + Dimmers)
+    put(w, "},\"lighting\":{\"light_level\":");
+    putUnsigned(w, s.lightLevel);
+    put(w, ",\"auto_brightness\":");
+    putUnsigned(w, s.brightness);
+    put(w, ",\"dimmer1\":");
+    putUnsigned(w, s.brightness);
+    put(w, ",\"dimmer2\":");
+    putUnsigned(w, s.brightness);
+
+    // System group (Device info)
+    put(w, "},\"system\":{\"device\":\"");
+    put(w, device);
+    put(w, "\",\"free_heap\":");
+    putUnsigned(w, s.freeHeap);
+    put(w, ",\"wifi_rssi\":");
+    putInteger(w, s.rssi);
+    put(w, "}}");
+
+    return finish(w);
+}
+
+// --- RTDB DELTA ---
+
+static bool moved(int32_t value, int32_t sent, uint32_t deadband) {
+    int32_t diff = value - sent;
+    return (uint32_t)(diff < 0 ? -diff : diff) >= deadband;
+}
+
+uint16_t rtdbChangedFields(const TelemetrySample &s, const TelemetrySample &sent) {
+    uint16_t mask = 0;
+
+    if (moved(s.temperature, sent.temperature, DEADBAND_TEMPERATURE)) mask |= RTDB_TEMPERATURE;
+    if (moved(s.humidity, sent.humidity, DEADBAND_HUMIDITY)) mask |= RTDB_HUMIDITY;
+    if ((s.flags ^ sent.flags) & SAMPLE_ENV_CONNECTED) mask |= RTDB_ENV_STATUS;
+
+    if (moved(s.voltage, sent.voltage, DEADBAND_VOLTAGE)) mask |= RTDB_VOLTAGE;
+    if (moved(s.current, sent.current, DEADBAND_CURRENT)) mask |= RTDB_CURRENT;
+    if (moved(s.power, sent.power, DEADBAND_POWER)) mask |= RTDB_POWER;
+    if (moved(s.energy, sent.energy, DEADBAND_ENERGY)) mask |= RTDB_ENERGY;
+    if (moved(s.frequency, sent.frequency, DEADBAND_FREQUENCY)) mask |= RTDB_FREQUENCY;
+    if (moved(s.pf, sent.pf, DEADBAND_PF)) mask |= RTDB_PF;
+    if ((s.flags ^ sent.flags) & SAMPLE_PZEM_CONNECTED) mask |= RTDB_PZEM_STATUS;
+
+    if (moved(s.lightLevel, sent.lightLevel, DEADBAND_LIGHT_LEVEL)) mask |= RTDB_LIGHT_LEVEL;
+    if (moved(s.brightness, sent.brightness, DEADBAND_BRIGHTNESS)) mask |= RTDB_BRIGHTNESS;
+
+    if (moved(s.freeHeap, sent.freeHeap, DEADBAND_FREE_HEAP)) mask |= RTDB_FREE_HEAP;
+    if (moved(s.rssi, sent.rssi, DEADBAND_RSSI)) mask |= RTDB_RSSI;
+
+    return mask;
+}
+
+void rtdbMergeFields(TelemetrySample &sent, const TelemetrySample &s, uint16_t mask) {
+    sent.unixTime = s.unixTime;
+    sent.uptimeSec = s.uptimeSec;
+
+    if (mask & RTDB_TEMPERATURE) sent.temperature = s.temperature;
+    if (mask & RTDB_HUMIDITY) sent.humidity = s.humidity;
+    if (mask & RTDB_ENV_STATUS) sent.flags = (sent.flags & ~SAMPLE_ENV_CONNECTED) | (s.flags & SAMPLE_ENV_CONNECTED);
+
+    if (mask & RTDB_VOLTAGE) sent.voltage = s.voltage;
+    if (mask & RTDB_CURRENT) sent.current = s.current;
+    if (mask & RTDB_POWER) sent.power = s.power;
+    if (mask & RTDB_ENERGY) sent.energy = s.energy;
+    if (mask & RTDB_FREQUENCY) sent.frequency = s.frequency;
+    if (mask & RTDB_PF) sent.pf = s.pf;
+    if (mask & RTDB_PZEM_STATUS) sent.flags = (sent.flags & ~SAMPLE_PZEM_CONNECTED) | (s.flags & SAMPLE_PZEM_CONNECTED);
+
+    if (mask & RTDB_LIGHT_LEVEL) sent.lightLevel = s.lightLevel;
+    if (mask & RTDB_BRIGHTNESS) sent.brightness = s.brightness;
+
+    if (mask & RTDB_FREE_HEAP) sent.freeHeap = s.freeHeap;
+    if (mask & RTDB_RSSI) sent.rssi = s.rssi;
+}
+
+size_t encodeRtdbPatch(char *buffer, size_t size, const TelemetrySample &s, uint16_t mask) {
+    Writer w = {buffer, size, 0, false};
+
+    // Timestamps go with every patch so the dashboard can tell the data is current
+    put(w, "{\"timestamp\":\"");
+    putLocalTime(w, s.unixTime);
+    put(w, "\",\"unix_time\":");
+    putUnsigned(w, s.unixTime);
+
+    // Paths are relative to the document being patched
+    if (mask & RTDB_TEMPERATURE) { put(w, ",\"environment/temperature\":"); putFixed(w, s.temperature, 1); }
+    if (mask & RTDB_HUMIDITY) { put(w, ",\"environment/humidity\":"); putFixed(w, s.humidity, 1); }
+    if (mask & RTDB_ENV_STATUS) { put(w, ",\"environment/connected\":"); putBool(w, s.flags & SAMPLE_ENV_CONNECTED); }
+
+    if (mask & RTDB_VOLTAGE) { put(w, ",\"power/voltage\":"); putFixed(w, s.voltage, 1); }
+    if (mask & RTDB_CURRENT) { put(w, ",\"power/current\":"); putFixed(w, currentCentiamps(s), 2); }
+    if (mask & RTDB_POWER) { put(w, ",\"power/power\":"); putFixed(w, s.power, 1); }
+    if (mask & RTDB_ENERGY) { put(w, ",\"power/energy\":"); putFixed(w, s.energy, 3); }
+    if (mask & RTDB_FREQUENCY) { put(w, ",\"power/frequency\":"); putFixed(w, s.frequency, 1); }
+    if (mask & RTDB_PF) { put(w, ",\"power/pf\":"); putFixed(w, s.pf, 2); }
+    if (mask & RTDB_PZEM_STATUS) { put(w, ",\"power/connected\":"); putBool(w, s.flags & SAMPLE_PZEM_CONNECTED); }
+
+    if (mask & RTDB_LIGHT_LEVEL) { put(w, ",\"lighting/light_level\":"); putUnsigned(w, s.lightLevel); }
+    if (mask & RTDB_BRIGHTNESS) {
+        put(w, ",\"lighting/auto_brightness\":");
+        putUnsigned(w, s.brightness);
+        put(w, ",\"lighting/dimmer1\":");
+        putUnsigned(w, s.brightness);
+        put(w, ",\"lighting/dimmer2\":");
+        putUnsigned(w, s.brightness);
+    }
+
+    if (mask & RTDB_FREE_HEAP) { put(w, ",\"system/free_heap\":"); putUnsigned(w, s.freeHeap); }
+    if (mask & RTDB_RSSI) { put(w, ",\"system/wifi_rssi\":"); putInteger(w, s.rssi); }
+    put(w, "}");
+
+    return finish(w);
+}
+
+// --- FIRESTORE ---
+// Typed values: {"doubleValue":1.5}, {"integerValue":"15"} (64-bit integers are strings),
+// {"booleanValue":true}, maps are {"mapValue":{"fields":{...}}}
+
+static void putDoubleField(Writer &w, const char *name, int32_t value, uint8_t decimals) {
+    put(w, "\"");
+    put(w, name);
+    put(w, "\":{\"doubleValue\":");
+    putFixed(w, value, decimals);
+    put(w, "}");
+}
+
+static void putIntegerField(Writer &w, const char *name, int32_t value) {
+    put(w, "\"");
+    put(w, name);
+    put(w, "\":{\"integerValue\":\"");
+    putInteger(w, value);
+    put(w, "\"}");
+}
+
+static void putBoolField(Writer &w, const char *name, bool value) {
+    put(w, "\"");
+    put(w, name);
+    put(w, "\":{\"booleanValue\":");
+    putBool(w, value);
+    put(w, "}");
+}
+
+static void putFirestoreWrite(Writer &w, const TelemetrySample &s, const char *projectId, const char *device) {
+    uint32_t unixTime = telemetrySampleTime(s);
+
+    // The document ID is derived from the sample, so a batch that is sent twice
+    // (reply lost after the commit went through) overwrites instead of duplicating
+    put(w, "{\"update\":{\"name\":\"projects/");
+    put(w, projectId);
+    put(w, "/databases/(default)/documents/sensorLogs/");
+    put(w, device);
+    if (unixTime != 0) {
+        put(w, "-");
+        putUnsigned(w, unixTime);
+    } else {
+        put(w, "-b");
+        putUnsigned(w, s.boot);
+        put(w, "-");
+        putUnsigned(w, s.uptimeSec);
+    }
+
+    put(w, "\",\"fields\":{");
+    if (unixTime != 0) {
+        // Timestamps, from the time the sample was taken (not when it is uploaded)
+        put(w, "\"timestamp\":{\"timestampValue\":\"");
+        putIsoTime(w, unixTime);
+        put(w, "\"},\"local_time\":{\"stringValue\":\"");
+        putLocalTime(w, unixTime);
+        put(w, "\"},");
+    } else {
+        // Taken before NTP sync on an earlier boot, it can never be dated.
+        // No timestamp rather than a permanent 1970 one
+        putIntegerField(w, "boot", s.boot);
+        put(w, ",");
+        putIntegerField(w, "uptime_s", s.uptimeSec);
+        put(w, ",");
+    }
+
+    // Environment group
+    put(w, "\"environment\":{\"mapValue\":{\"fields\":{");
+    putDoubleField(w, "temperature", s.temperature, 1);
+    put(w, ",");
+    putDoubleField(w, "humidity", s.humidity, 1);
+    put(w, ",");
+    putBoolField(w, "connected", s.flags & SAMPLE_ENV_CONNECTED);
+
+    // Power group
+    put(w, "}}},\"power\":{\"mapValue\":{\"fields\":{");
+    putDoubleField(w, "voltage", s.voltage, 1);
+    put(w, ",");
+    putDoubleField(w, "current", currentCentiamps(s), 2);
+    put(w, ",");
+    putDoubleField(w, "power", s.power, 1);
+    put(w, ",");
+    putDoubleField(w, "energy", s.energy, 3);
+    put(w, ",");
+    putDoubleField(w, "frequency", s.frequency, 1);
+    put(w, ",");
+    putDoubleField(w, "pf", s.pf, 2);
+    put(w, ",");
+    putBoolField(w, "connected", s.flags & SAMPLE_PZEM_CONNECTED);
+    if (s.flags & SAMPLE_POWER_AGGREGATED) {
+        // Voltage, current, power and pf above are means over the interval
+        put(w, ",");
+        putDoubleField(w, "power_max", s.powerMax, 1);
+        put(w, ",");
+        putDoubleField(w, "energy_interval", s.intervalEnergy, 3);
+    }
+
+    // Lighting group
+    put(w, "}}},\"lighting\":{\"mapValue\":{\"fields\":{");
+    putIntegerField(w, "light_level", s.lightLevel);
+    put(w, ",");
+    putIntegerField(w, "auto_brightness", s.brightness);
+    put(w, ",");
+    putIntegerField(w, "dimmer1", s.brightness);
+    put(w, ",");
+    putIntegerField(w, "dimmer2", s.brightness);
+
+    // System group
+    put(w, "}}},\"system\":{\"mapValue\":{\"fields\":{\"device\":{\"stringValue\":\"");
+    put(w, device);
+    put(w, "\"},");
+    putIntegerField(w, "free_heap", s.freeHeap);
+    put(w, ",");
+    putIntegerField(w, "wifi_rssi", s.rssi);
+    put(w, ",");
+    putIntegerField(w, "uptime_s", s.uptimeSec);
+    put(w, "}}}}}}");
+}
+
+size_t encodeFirestoreCommit(char *buffer, size_t size, const TelemetrySample *samples, int count,
+                             const char *projectId, const char *device) {
+    Writer w = {buffer, size, 0, false};
+
+    put(w, "{\"writes\":[");
+    for (int i = 0; i < count; i++) {
+        if (i > 0) put(w, ",");
+        putFirestoreWrite(w, samples[i], projectId, device);
+    }
+    put(w, "]}");
+
+    return finish(w);
+}
+
+// --- LIVE ---
+
+size_t encodeLivePayload(char *buffer, size_t size, const TelemetrySample &s, uint32_t seq, uint32_t uptimeMs) {
+    Writer w = {buffer, size, 0, false};
+
+    put(w, "{\"seq\":");
+    putUnsigned(w, seq);
+    put(w, ",\"t\":");
+    putUnsigned(w, s.unixTime);
+    put(w, ",\"up\":");
+    putUnsigned(w, uptimeMs);
+
+    put(w, ",\"temp\":");
+    putFixed(w, s.temperature, 1);
+    put(w, ",\"hum\":");
+    putFixed(w, s.humidity, 1);
+    put(w, ",\"env\":");
+    putBool(w, s.flags & SAMPLE_ENV_CONNECTED);
+
+    put(w, ",\"v\":");
+    putFixed(w, s.voltage, 1);
+    put(w, ",\"a\":");
+    putFixed(w, s.current, 3);
+    put(w, ",\"w\":");
+    putFixed(w, s.power, 1);
+    put(w, ",\"wh\":");
+    putUnsigned(w, s.energy);
+    put(w, ",\"hz\":");
+    putFixed(w, s.frequency, 1);
+    put(w, ",\"pf\":");
+    putFixed(w, s.pf, 2);
+    put(w, ",\"pzem\":");
+    putBool(w, s.flags & SAMPLE_PZEM_CONNECTED);
+
+    put(w, ",\"light\":");
+    putUnsigned(w, s.lightLevel);
+    put(w, ",\"bright\":");
+    putUnsigned(w, s.brightness);
+    put(w, ",\"rssi\":");
+    putInteger(w, s.rssi);
+    put(w, "}");
+
+    return finish(w);
+}
@@ -0,0 +1,79 @@
+#ifndef TELEMETRY_ENCODER_H
+#define TELEMETRY_ENCODER_H
+
+#include <Arduino.h>
+#include "telemetry_queue.h"
+
+// Largest RTDB payload (about 400 bytes with every field at its widest)
+const size_t TELEMETRY_RTDB_MAX = 512;
+
+// Largest Firestore write for one sample (about 1 KB), and the commit request wrapper around them
+const size_t TELEMETRY_FIRESTORE_WRITE_MAX = 1280;
+const size_t TELEMETRY_FIRESTORE_COMMIT_OVERHEAD = 16;
+
+// Payloads are written straight into the caller's buffer in a fixed layout:
+// no JsonDocument, no String and no heap allocation.
+// Both return the payload length, or 0 if it did not fit in size bytes.
+// The buffer is always NUL terminated when size > 0.
+
+// Live state document for the Realtime Database (same layout the dashboard reads)
+size_t encodeRtdbPayload(char *buffer, size_t size, const TelemetrySample &sample, const char *device);
+
+// --- RTDB DELTA UPDATES ---
+// Fields of the live state document that can be updated on their own
+const uint16_t RTDB_TEMPERATURE  = 0x0001;
+const uint16_t RTDB_HUMIDITY     = 0x0002;
+const uint16_t RTDB_ENV_STATUS   = 0x0004;
+const uint16_t RTDB_VOLTAGE      = 0x0008;
+const uint16_t RTDB_CURRENT      = 0x0010;
+const uint16_t RTDB_POWER        = 0x0020;
+const uint16_t RTDB_ENERGY       = 0x0040;
+const uint16_t RTDB_FREQUENCY    = 0x0080;
+const uint16_t RTDB_PF           = 0x0100;
+const uint16_t RTDB_PZEM_STATUS  = 0x0200;
+const uint16_t RTDB_LIGHT_LEVEL  = 0x0400;
+const uint16_t RTDB_BRIGHTNESS   = 0x0800; // auto_brightness, dimmer1 and dimmer2
+const uint16_t RTDB_FREE_HEAP    = 0x1000;
+const uint16_t RTDB_RSSI         = 0x2000;
+
+// Dead-bands in the sample's fixed point units: a field is only resent once it
+// has moved at least this far from the value the database already holds
+const uint16_t DEADBAND_TEMPERATURE = 1;     // 0.1 °C
+const uint16_t DEADBAND_HUMIDITY = 5;        // 0.5 %
+const uint16_t DEADBAND_VOLTAGE = 10;        // 1 V
+const uint16_t DEADBAND_CURRENT = 20;        // 20 mA
+const uint16_t DEADBAND_POWER = 10;          // 1 W
+const uint16_t DEADBAND_ENERGY = 10;         // 10 Wh
+const uint16_t DEADBAND_FREQUENCY = 1;       // 0.1 Hz
+const uint16_t DEADBAND_PF = 2;              // 0.02
+const uint16_t DEADBAND_LIGHT_LEVEL = 50;    // ADC counts
+const uint16_t DEADBAND_BRIGHTNESS = 1;      // 1 %
+const uint32_t DEADBAND_FREE_HEAP = 4096;    // Bytes
+const uint8_t DEADBAND_RSSI = 5;             // dBm
+
+// RTDB_* bits of the fields in sample that moved past their dead-band relative to sent
+uint16_t rtdbChangedFields(const TelemetrySample &sample, const TelemetrySample &sent);
+
+// Copy the fields in mask from sample into sent, after they were written
+void rtdbMergeFields(TelemetrySample &sent, const TelemetrySample &sample, uint16_t mask);
+
+// Multi-path PATCH body with the timestamps and the fields in mask,
+// e.g. {"timestamp":"...","unix_time":...,"power/power":12.5}
+size_t encodeRtdbPatch(char *buffer, size_t size, const TelemetrySample &sample, uint16_t mask);
+
+// --- LIVE ---
+// Largest LAN dashboard frame (about 230 bytes with every field at its widest)
+const size_t TELEMETRY_LIVE_MAX = 256;
+
+// Flat document for the local WebSocket feed, short keys, no timestamps as text
+// seq counts frames so a client can see what it missed, up is millis()
+// e.g. {"seq":12,"t":1760000000,"up":123456,"temp":23.4,"hum":55.0,"v":229.8,...}
+size_t encodeLivePayload(char *buffer, size_t size, const TelemetrySample &sample, uint32_t seq, uint32_t uptimeMs);
+
+// Firestore documents:commit request with one "update" write per sample
+// projectId and device make up the document names. A sample that cannot be
+// dated (telemetrySampleTime() == 0) gets boot/uptime_s fields instead of a timestamp
+size_t encodeFirestoreCommit(char *buffer, size_t size, const TelemetrySample *samples, int count,
+                             const char *projectId, const char *device);
+
+#endif
@@ -0,0 +1,259 @@
+#include "telemetry_queue.h"
+#include <WiFi.h>
+#include "timestamp.h"
+
+#if TELEMETRY_SPILL_TO_FLASH
+#include <LittleFS.h>
+#endif
+
+// --- RAM RING ---
+// Newest samples. Samples leave from the flash side first, so the order
+// oldest -> newest is: flash head ... flash tail, ram head ... ram tail
+static TelemetrySample ring[TELEMETRY_RAM_SAMPLES];
+static int ringHead = 0;
+static int ringCount = 0;
+
+static uint32_t pushedCount = 0;
+static uint32_t sentCount = 0;
+static uint32_t droppedCount = 0;
+static uint8_t bootCount = 0;
+
+#if TELEMETRY_SPILL_TO_FLASH
+// --- FLASH RING ---
+// Fixed size file: header followed by TELEMETRY_FLASH_SAMPLES slots
+struct SpillHeader {
+    uint32_t magic;
+    uint32_t head;
+    uint32_t count;
+    uint32_t boots;
+};
+
+static const uint32_t SPILL_MAGIC = 0x54514C32; // "TQL2", 48 byte samples
+
+// The spill file stores samples as raw structs: a layout change needs a new magic
+static_assert(sizeof(TelemetrySample) == 48, "TelemetrySample layout changed, bump SPILL_MAGIC");
+static SpillHeader spill = {SPILL_MAGIC, 0, 0, 0};
+static bool flashReady = false;
+
+static size_t slotOffset(uint32_t slot) {
+    return sizeof(SpillHeader) + (size_t)slot * sizeof(TelemetrySample);
+}
+
+static void writeSpillHeader(File &f) {
+    f.seek(0);
+    f.write((const uint8_t *)&spill, sizeof(spill));
+}
+
+// Append one sample to the flash ring, dropping the oldest one if it is full
+static void spillToFlash(const TelemetrySample &sample) {
+    File f = LittleFS.open(TELEMETRY_SPILL_PATH, "r+");
+    if (!f) {
+        droppedCount++;
+        return;
+    }
+
+    uint32_t slot = (spill.head + spill.count) % TELEMETRY_FLASH_SAMPLES;
+    f.seek(slotOffset(slot));
+    f.write((const uint8_t *)&sample, sizeof(sample));
+
+    if (spill.count < (uint32_t)TELEMETRY_FLASH_SAMPLES) {
+        spill.count++;
+    } else {
+        spill.head = (spill.head + 1) % TELEMETRY_FLASH_SAMPLES; // Drop oldest
+        droppedCount++;
+    }
+    writeSpillHeader(f);
+    f.close();
+}
+#endif
+
+void telemetryQueueBegin() {
+#if TELEMETRY_SPILL_TO_FLASH
+    if (!LittleFS.begin(true)) {
+        Serial.println("LittleFS mount failed, telemetry queue is RAM only");
+        return;
+    }
+
+    File f = LittleFS.open(TELEMETRY_SPILL_PATH, "r");
+    bool valid = f && f.read((uint8_t *)&spill, sizeof(spill)) == sizeof(spill) &&
+                 spill.magic == SPILL_MAGIC &&
+                 spill.head < (uint32_t)TELEMETRY_FLASH_SAMPLES &&
+                 spill.count <= (uint32_t)TELEMETRY_FLASH_SAMPLES;
+    if (f) f.close();
+
+    if (!valid) {
+        // First boot or unknown layout: start with an empty spill file
+        spill.magic = SPILL_MAGIC;
+        spill.head = 0;
+        spill.count = 0;
+        spill.boots = 0;
+        f = LittleFS.open(TELEMETRY_SPILL_PATH, "w");
+        if (!f) {
+            Serial.println("Cannot create telemetry spill file");
+            return;
+        }
+        writeSpillHeader(f);
+        f.close();
+    }
+
+    // Count boots so samples without a clock can be matched to the current uptime
+    spill.boots++;
+    bootCount = spill.boots;
+    f = LittleFS.open(TELEMETRY_SPILL_PATH, "r+");
+    if (f) {
+        writeSpillHeader(f);
+        f.close();
+    }
+
+    flashReady = true;
+    Serial.print("Telemetry queue: ");
+    Serial.print(spill.count);
+    Serial.println(" samples waiting in flash");
+#endif
+}
+
+// Fixed point conversion with rounding, clamped to the field range
+static int32_t toFixed(float value, float scale, int32_t lo, int32_t hi) {
+    if (isnan(value)) return 0;
+    float scaled = value * scale;
+    int32_t v = (int32_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+    return constrain(v, lo, hi);
+}
+
+TelemetrySample makeTelemetrySample(const SensorReadings &readings) {
+    const PzemData &pzemData = readings.pzem;
+    TelemetrySample s;
+    memset(&s, 0, sizeof(s));
+
+    TimePair now = timeNow();
+    s.unixTime = now.unixTime;
+    s.uptimeSec = now.uptimeMs / 1000;
+
+    s.temperature = toFixed(readings.temperature, 10, INT16_MIN, INT16_MAX);
+    s.humidity = toFixed(readings.humidity, 10, 0, UINT16_MAX);
+    s.voltage = toFixed(pzemData.voltage, 10, 0, UINT16_MAX);
+    s.frequency = toFixed(pzemData.frequency, 10, 0, UINT16_MAX);
+    s.current = toFixed(pzemData.current, 1000, 0, INT32_MAX);
+    s.power = toFixed(pzemData.power, 10, 0, INT32_MAX);
+    s.energy = toFixed(pzemData.energy, 1000, 0, INT32_MAX);
+    s.lightLevel = constrain(readings.lightLevel, 0, 4095);
+    s.brightness = constrain(readings.brightness, 0, 100);
+    s.pf = toFixed(pzemData.pf, 100, 0, 100);
+    s.boot = bootCount;
+    s.rssi = WiFi.status() == WL_CONNECTED ? constrain(WiFi.RSSI(), -128, 0) : 0;
+    s.freeHeap = ESP.getFreeHeap();
+
+    if (!(readings.quality[SENSOR_ENVIRONMENT] & (SENSOR_NO_RESPONSE | SENSOR_STALE))) s.flags |= SAMPLE_ENV_CONNECTED;
+    if (pzemData.connected) s.flags |= SAMPLE_PZEM_CONNECTED;
+    return s;
+}
+
+void telemetryQueuePush(const TelemetrySample &sample) {
+    pushedCount++;
+
+    if (ringCount == TELEMETRY_RAM_SAMPLES) {
+        // RAM full: move the oldest RAM sample to flash, or drop it
+        const TelemetrySample &oldest = ring[ringHead];
+#if TELEMETRY_SPILL_TO_FLASH
+        if (flashReady) {
+            spillToFlash(oldest);
+        } else {
+            droppedCount++;
+        }
+#else
+        (void)oldest;
+        droppedCount++;
+#endif
+        ringHead = (ringHead + 1) % TELEMETRY_RAM_SAMPLES;
+        ringCount--;
+    }
+
+    ring[(ringHead + ringCount) % TELEMETRY_RAM_SAMPLES] = sample;
+    ringCount++;
+}
+
+int telemetryQueuePeek(TelemetrySample *out, int max) {
+    int n = 0;
+
+#if TELEMETRY_SPILL_TO_FLASH
+    // Oldest samples are in flash
+    if (flashReady && spill.count > 0 && n < max) {
+        File f = LittleFS.open(TELEMETRY_SPILL_PATH, "r");
+        if (f) {
+            while (n < max && (uint32_t)n < spill.count) {
+                uint32_t slot = (spill.head + n) % TELEMETRY_FLASH_SAMPLES;
+                f.seek(slotOffset(slot));
+                if (f.read((uint8_t *)&out[n], sizeof(TelemetrySample)) != sizeof(TelemetrySample)) {
+                    break;
+                }
+                n++;
+            }
+            f.close();
+        }
+        // Never mix in RAM samples while flash still has older ones we could not read
+        if ((uint32_t)n < spill.count) {
+            return n;
+        }
+    }
+#endif
+
+    for (int i = 0; n < max && i < ringCount; i++) {
+        out[n++] = ring[(ringHead + i) % TELEMETRY_RAM_SAMPLES];
+    }
+    return n;
+}
+
+void telemetryQueuePop(int count) {
+    sentCount += count;
+
+#if TELEMETRY_SPILL_TO_FLASH
+    if (flashReady && spill.count > 0 && count > 0) {
+        uint32_t fromFlash = min((uint32_t)count, spill.count);
+        spill.head = (spill.head + fromFlash) % TELEMETRY_FLASH_SAMPLES;
+        spill.count -= fromFlash;
+        count -= fromFlash;
+
+        File f = LittleFS.open(TELEMETRY_SPILL_PATH, "r+");
+        if (f) {
+            writeSpillHeader(f);
+            f.close();
+        }
+    }
+#endif
+
+    if (count > ringCount) count = ringCount;
+    ringHead = (ringHead + count) % TELEMETRY_RAM_SAMPLES;
+    ringCount -= count;
+}
+
+float telemetryQueueFill() {
+    float capacity = TELEMETRY_RAM_SAMPLES;
+    float queued = ringCount;
+#if TELEMETRY_SPILL_TO_FLASH
+    if (flashReady) {
+        capacity += TELEMETRY_FLASH_SAMPLES;
+        queued += spill.count;
+    }
+#endif
+    return queued / capacity;
+}
+
+void telemetryQueueGetStats(TelemetryQueueStats &stats) {
+    stats.inFlash = 0;
+#if TELEMETRY_SPILL_TO_FLASH
+    stats.inFlash = spill.count;
+#endif
+    stats.queued = ringCount + stats.inFlash;
+    stats.pushed = pushedCount;
+    stats.sent = sentCount;
+    stats.dropped = droppedCount;
+}
+
+uint32_t telemetrySampleTime(const TelemetrySample &sample) {
+    if (sample.unixTime != 0) return sample.unixTime;
+
+    TimePair now = timeNow();
+    if (now.unixTime == 0 || sample.boot != bootCount) return 0;
+
+    return now.unixTime - (now.uptimeMs / 1000 - sample.uptimeSec);
+}
@@ -0,0 +1,84 @@
+#ifndef TELEMETRY_QUEUE_H
+#define TELEMETRY_QUEUE_H
+
+#include <Arduino.h>
+#include "pzem.h"
+#include "sensor_bus.h"
+
+// Samples kept in RAM (48 bytes each)
+const int TELEMETRY_RAM_SAMPLES = 256;
+
+// Set to 1 to move samples that no longer fit in RAM to LittleFS instead of dropping them
+#ifndef TELEMETRY_SPILL_TO_FLASH
+#define TELEMETRY_SPILL_TO_FLASH 1
+#endif
+
+// Samples the flash spill file can hold (~2 weeks at one sample per 5 minutes)
+const int TELEMETRY_FLASH_SAMPLES = 4096;
+#define TELEMETRY_SPILL_PATH "/telemetry.bin"
+
+// Sample flags
+const uint8_t SAMPLE_ENV_CONNECTED = 0x01;
+const uint8_t SAMPLE_PZEM_CONNECTED = 0x02;
+const uint8_t SAMPLE_POWER_AGGREGATED = 0x04; // Power values are interval means (energy_stats.h)
+
+// One logged sample in fixed point, 48 bytes instead of the ~1 KB JSON document
+struct TelemetrySample {
+    uint32_t unixTime;     // 0 if the clock was not synced when the sample was taken
+    uint32_t uptimeSec;    // Seconds since boot, used to date samples taken before NTP sync
+    int16_t temperature;   // 0.1 °C
+    uint16_t humidity;     // 0.1 %
+    uint16_t voltage;      // 0.1 V
+    uint16_t frequency;    // 0.1 Hz
+    uint32_t current;      // mA
+    uint32_t power;        // 0.1 W
+    uint32_t energy;       // Wh
+    uint16_t lightLevel;   // Raw ADC (0-4095)
+    uint8_t brightness;    // 0-100 %
+    uint8_t pf;            // 0.01
+    uint8_t flags;         // SAMPLE_* bits
+    uint8_t boot;          // Boot counter (low byte), tells which boot uptimeSec belongs to
+    int8_t rssi;           // dBm, 0 when WiFi was down
+    uint8_t reserved;
+    uint32_t freeHeap;
+    uint32_t powerMax;       // 0.1 W, peak over the interval (SAMPLE_POWER_AGGREGATED only)
+    uint32_t intervalEnergy; // mWh used over the interval (SAMPLE_POWER_AGGREGATED only)
+};
+
+struct TelemetryQueueStats {
+    uint32_t queued;       // Samples waiting (RAM + flash)
+    uint32_t inFlash;      // Of which spilled to flash
+    uint32_t pushed;
+    uint32_t sent;
+    uint32_t dropped;      // Oldest samples discarded because both stores were full
+};
+
+// The queue is not locked, use it from one task only
+
+// Mount LittleFS and pick up samples spilled before the last reboot
+void telemetryQueueBegin();
+
+// Pack the current readings into a sample
+TelemetrySample makeTelemetrySample(const SensorReadings &readings);
+
+// Append a sample. When full the oldest sample is dropped (never blocks)
+void telemetryQueuePush(const TelemetrySample &sample);
+
+// Copy up to max of the oldest samples without removing them
+// Returns the number copied
+int telemetryQueuePeek(TelemetrySample *out, int max);
+
+// Remove the count oldest samples after they were delivered
+void telemetryQueuePop(int count);
+
+// Fill level 0.0 - 1.0 of the whole queue, for backpressure decisions
+float telemetryQueueFill();
+
+void telemetryQueueGetStats(TelemetryQueueStats &stats);
+
+// Unix time of a sample. Samples taken before NTP sync are dated from their uptime
+// once the clock is set, returns 0 if that is not possible (clock still unset, or
+// the sample is from an earlier boot)
+uint32_t telemetrySampleTime(const TelemetrySample &sample);
+
+#endif
@@ -1,120 +1,557 @@
-// Reference XY-MD02: https://www.idbsmart.cz/wp-content/uploads/2024/05/xy-md02-manual.pdf
-
 #include <HardwareSerial.h>
-#include "modbus.h"
+#include "modbus_bus.h"
 #include "pzem.h"
 #include "dimmer.h"
+#include "zero_cross.h"
 #include "wifi_firebase.h"
 #include "light_sensor.h"
+#include "sensor_bus.h"
+#include "sensor_drivers.h"
+#include "daylight_control.h"
+#include "scheduler.h"
+#include "log_sink.h"
+#include "telemetry_queue.h"
+#include "energy_stats.h"
+#include "history_log.h"
+#include "live_server.h"
+#include <LittleFS.h>
 
-HardwareSerial SensorSerial(2); // UART2 for Modbus
+// --- TASKS ---
+// Each runs in its own FreeRTOS task, so a slow HTTPS call can only delay itself.
+// Higher priority preempts lower: sensors > control > logging > uploads
 
-#define RXD2 18
-#define TXD2 17
+// Sensor drivers (every SENSOR_TICK_MS): Modbus and PZEM exchanges, light
+// sampling, and every new reading published on the sensor bus
+void sensorsTask()
+{
+  sensorsTick();
+}
 
-// Dimmer brightness (controlled by light sensor)
-int brightness = 0;
-int lightLevel = 0;
+// WiFi reconnects and SNTP start (every 100 ms)
+void netTask()
+{
+  connectivityTick();
+}
 
-// Firebase upload interval (5 seconds)
-const unsigned long FIREBASE_INTERVAL = 5000;
-unsigned long lastFirebaseUpload = 0;
+// Local flash history (every HISTORY_INTERVAL_MS), kept whether or not the cloud is reachable.
+// Once an hour the past hour is read back and logged as a summary, so a
+// corrupt block shows up in the log rather than when someone needs the data
+struct HourSummary {
+  uint32_t samples;
+  int32_t temperatureMin;
+  int32_t temperatureMax;
+  int64_t temperatureSum;
+  uint64_t powerSum;
+  uint32_t powerMax;
+};
 
-// Firestore logging interval (5 minutes)
-const unsigned long FIRESTORE_INTERVAL = 300000;  // 5 * 60 * 1000
-unsigned long lastFirestoreUpload = 0;
+static bool addToSummary(const HistorySample &sample, void *context)
+{
+  HourSummary &h = *(HourSummary *)context;
+  if (h.samples == 0 || sample.temperature < h.temperatureMin)
+    h.temperatureMin = sample.temperature;
+  if (h.samples == 0 || sample.temperature > h.temperatureMax)
+    h.temperatureMax = sample.temperature;
+  h.temperatureSum += sample.temperature;
+  h.powerSum += sample.power;
+  h.powerMax = max(h.powerMax, sample.power);
+  h.samples++;
+  return true;
+}
 
-void setup()
+uint32_t summarizedHour = 0; // Start of the last hour logged
+
+void logHourSummary(uint32_t hourStart)
 {
-  Serial.begin(115200);
-  Serial.println("\n=== ESP32-S3 IoT System ===");
-  
-  SensorSerial.begin(9600, SERIAL_8N1, RXD2, TXD2); // RXD2, TXD2 for Modbus
-  pinMode(RS485_DIR, OUTPUT); // From modbus.h
-  digitalWrite(RS485_DIR, LOW);
+  HourSummary h = {};
+  int n = historyQuery(hourStart - 3600, hourStart - 1, addToSummary, &h);
 
-  // Initialize WiFi (also initializes NTP for timestamps)
-  initWiFi();
+  LogRecord r;
+  logBegin(r, n < 0 ? LOG_ERROR : LOG_INFO);
+  logUnsigned(r, "hour_from", hourStart - 3600);
+  logInt(r, "hour_samples", n);
+  if (h.samples > 0) {
+    logFloat(r, "hour_t_min", h.temperatureMin / 10.0f, 1);
+    logFloat(r, "hour_t_max", h.temperatureMax / 10.0f, 1);
+    logFloat(r, "hour_t_mean", h.temperatureSum / 10.0f / h.samples, 1);
+    logFloat(r, "hour_w_mean", h.powerSum / 10.0f / h.samples, 1);
+    logFloat(r, "hour_w_max", h.powerMax / 10.0f, 1);
+  }
+  logEnd(r);
+}
 
-  initializePZEM();       // Initialize PZEM sensor
-  initializeDimmers();    // Initialize the dimmers
-  initLightSensor();      // Initialize light sensor
-  
-  Serial.println("System Ready!");
+void historyTask()
+{
+  SensorReadings s;
+  readSensors(s);
+  TelemetrySample sample = makeTelemetrySample(s);
+  historyAppend(sample);
+
+  // The first sample with a time only sets the starting point
+  uint32_t hourStart = sample.unixTime - sample.unixTime % 3600;
+  if (sample.unixTime != 0 && hourStart != summarizedHour) {
+    if (summarizedHour != 0)
+      logHourSummary(hourStart);
+    summarizedHour = hourStart;
+  }
 }
 
-void loop()
+// Power aggregates (every PZEM_READ_INTERVAL), every meter reading from the bus
+int energySubscription = -1;
+
+void energyTask()
 {
-  // Read Modbus sensor
-  float temperature = readModBus(0x0001); // Temperature ( check ref manual )
-  float humidity = readModBus(0x0002);    // Humidity ( check ref manual )
-
-  Serial.print("{\"temperature\":");
-  Serial.print(temperature);
-  Serial.print(",\"humidity\":");
-  Serial.print(humidity);
-  Serial.println("}");
-
-  // Read PZEM sensor
-  PzemData pzemData = readPZEM();
-  if (pzemData.connected) {
-    Serial.print("{\"voltage\":");
-    Serial.print(pzemData.voltage);
-    Serial.print(",\"current\":");
-    Serial.print(pzemData.current);
-    Serial.print(",\"power\":");
-    Serial.print(pzemData.power);
-    Serial.print(",\"energy\":");
-    Serial.print(pzemData.energy);
-    Serial.print(",\"frequency\":");
-    Serial.print(pzemData.frequency);
-    Serial.print(",\"pf\":");
-    Serial.print(pzemData.pf);
-    Serial.println("}");
+  const SensorSample *sample;
+  while ((sample = sensorPeek(energySubscription)) != NULL) {
+    energyStatsAdd(sample->power, sample->time.uptimeMs);
+    sensorRelease(energySubscription);
+  }
+}
+
+// Closed loop daylight control (every 100 ms)
+// The controller only returns a new level when it needs to move the lamps,
+// the dimmer ISR fades there over one control period.
+// A dimmer command from the LAN feed takes the lamps over until {"auto":true}.
+// Commands are only queued by the live task and carried out here, so the
+// control loop can never overwrite a command it has not seen yet
+unsigned long firstControlMs = 0; // millis() of the first control decision = time from boot
+volatile bool manualDimmers = false;  // Written by controlTask only
+volatile int lampBrightness = 0;      // 0-100 %, published by lampSensor
+
+struct PendingDimmer {
+  bool pending;
+  int level;
+  unsigned long fadeMs;
+};
+PendingDimmer pendingDimmers[DIMMER_MAX_CHANNELS + 1]; // By channel number, [0] unused
+bool pendingAutomatic = false;
+portMUX_TYPE commandLock = portMUX_INITIALIZER_UNLOCKED;
+
+void controlTask()
+{
+  // Commands that came in since the last period
+  PendingDimmer commands[DIMMER_MAX_CHANNELS + 1];
+  portENTER_CRITICAL(&commandLock);
+  memcpy(commands, pendingDimmers, sizeof(commands));
+  memset(pendingDimmers, 0, sizeof(pendingDimmers));
+  bool automatic = pendingAutomatic;
+  pendingAutomatic = false;
+  portEXIT_CRITICAL(&commandLock);
+
+  // Back to automatic: put the lamps at the controller output right away
+  bool resync = automatic && manualDimmers;
+  if (automatic)
+    manualDimmers = false;
+
+  for (int ch = 1; ch <= DIMMER_MAX_CHANNELS; ch++) {
+    if (!commands[ch].pending)
+      continue;
+    manualDimmers = true;
+    fadeDimmerTo(ch, commands[ch].level, commands[ch].fadeMs, DIMMER_CURVE_LINEAR_POWER);
+  }
+
+  // Filtered light level, no ADC access here
+  int level = readLightLevel();
+  int brightness;
+
+  if (manualDimmers) {
+    brightness = (getDimmerLevel(1) + 5) / 10;
   } else {
-    Serial.println("{\"pzem_status\":\"disconnected\"}");
+    int newLevel = daylightControlUpdate(level, millis());
+
+    DaylightStats control;
+    getDaylightStats(control);
+    if (newLevel < 0 && resync)
+      newLevel = control.output;
+
+    if (newLevel >= 0) {
+      fadeDimmerTo(1, newLevel, 100, DIMMER_CURVE_LINEAR_POWER);
+      fadeDimmerTo(2, newLevel, 100, DIMMER_CURVE_LINEAR_POWER);
+    }
+    brightness = (control.output + 5) / 10;
+  }
+
+  lampBrightness = brightness;
+
+  if (firstControlMs == 0)
+    firstControlMs = millis();
+}
+
+// The lamps as a bus sensor, so the sinks see them like any other reading
+static bool lampRead(SensorSample &sample)
+{
+  sample.lamp.brightness = lampBrightness;
+  sample.lamp.manual = manualDimmers;
+  return true;
+}
+
+const SensorDriver lampSensor = {
+  "lamp", SENSOR_LAMP, 0, 100, 1000, NULL, NULL, lampRead,
+};
+
+// Commands from LAN dashboards, runs in liveTask. Queued for controlTask,
+// the newest command wins: {"auto":true} cancels channel commands not yet
+// carried out and a channel command cancels a pending {"auto":true}
+void onLiveCommand(const LiveCommand &command)
+{
+  portENTER_CRITICAL(&commandLock);
+  if (command.automatic) {
+    memset(pendingDimmers, 0, sizeof(pendingDimmers));
+    pendingAutomatic = true;
+  } else {
+    PendingDimmer &p = pendingDimmers[command.channel];
+    p.pending = true;
+    p.level = command.level;
+    p.fadeMs = command.fadeMs;
+    pendingAutomatic = false;
+  }
+  portEXIT_CRITICAL(&commandLock);
+}
+
+// LAN WebSocket feed (every 20 ms), a frame per control period
+// Follows the bus stream, each frame carries the newest value of every type
+int liveSubscription = -1;
+SensorReadings liveReadings;
+unsigned long lastLivePublish = 0;
+
+void liveTask()
+{
+  const SensorSample *sample;
+  while ((sample = sensorPeek(liveSubscription)) != NULL) {
+    applySensorSample(liveReadings, *sample);
+    sensorRelease(liveSubscription);
+  }
+
+  if (millis() - lastLivePublish >= LIVE_PUBLISH_MS) {
+    lastLivePublish = millis();
+    livePublish(makeTelemetrySample(liveReadings));
+  }
+  liveServerTick();
+}
+
+// Sensor records (every 100 ms)
+// Records go into the log ring, logOutTask moves them to the UART
+void logTask()
+{
+  SensorReadings s;
+  readSensors(s);
+
+  ModbusBusStats busStats;
+  modbusBusGetStats(busStats);
+
+  LogRecord r;
+  logBegin(r, LOG_INFO);
+  logFloat(r, "temperature", s.temperature, 2);
+  logFloat(r, "humidity", s.humidity, 2);
+  logUnsigned(r, "modbus_us", environmentMap.lastPollMicros);
+  logFloat(r, "bus_util", busStats.utilisation, 2);
+  logUnsigned(r, "bus_timeouts", busStats.master.timeouts);
+  logUnsigned(r, "bus_crc_errors", busStats.master.crcErrors);
+  logEnd(r);
+
+  if (s.pzem.connected) {
+    logBegin(r, LOG_INFO);
+    logFloat(r, "voltage", s.pzem.voltage, 2);
+    logFloat(r, "current", s.pzem.current, 2);
+    logFloat(r, "power", s.pzem.power, 2);
+    logFloat(r, "energy", s.pzem.energy, 2);
+    logFloat(r, "frequency", s.pzem.frequency, 2);
+    logFloat(r, "pf", s.pzem.pf, 2);
+    logEnd(r);
+  } else {
+    logText(LOG_WARN, "pzem_status", "disconnected");
   }
 
-  // --- Automatic Light-Based Dimmer Control ---
-  // Read light sensor and calculate brightness
-  lightLevel = readLightLevel();
-  brightness = calculateBrightness();
-  
-  // Apply brightness to both dimmers
-  setDimmerBrightness(1, brightness);
-  setDimmerBrightness(2, brightness);
-  
   // Log light sensor data
-  Serial.print("{\"light_level\":");
-  Serial.print(lightLevel);
-  Serial.print(",\"auto_brightness\":");
-  Serial.print(brightness);
-  Serial.println("}");
-
-  // --- Firebase Realtime DB Upload (every 5 seconds) ---
-  unsigned long currentMillis = millis();
-  if (currentMillis - lastFirebaseUpload >= FIREBASE_INTERVAL) {
-    lastFirebaseUpload = currentMillis;
-    
-    // Send all sensor data to Firebase Realtime DB (live state)
-    if (sendDataToFirebase(temperature, humidity, pzemData, brightness, lightLevel)) {
-      Serial.println("{\"firebase\":\"upload_success\"}");
-    } else {
-      Serial.println("{\"firebase\":\"upload_failed\"}");
-    }
+  logBegin(r, LOG_INFO);
+  logInt(r, "light_level", s.lightLevel);
+  logInt(r, "auto_brightness", s.brightness);
+  logEnd(r);
+}
+
+// Log ring to the UART (every 10 ms), only what the TX FIFO takes without waiting
+void logOutTask()
+{
+  logDrain();
+}
+
+// Firebase Realtime DB upload, live state (every 5 seconds)
+void firebaseTask()
+{
+  SensorReadings s;
+  readSensors(s);
+
+  if (sendDataToFirebase(s)) {
+    logText(LOG_INFO, "firebase", "upload_success");
+  } else {
+    logText(LOG_WARN, "firebase", "upload_failed");
   }
+}
+
+// Firestore historical logging (every 30 seconds)
+// A sample is queued every FIRESTORE_LOG_INTERVAL whether or not WiFi is up,
+// the queue is drained in batches whenever the connection and the clock are there
+unsigned long lastFirestoreSample = 0;
+bool firestoreSampled = false;
 
-  // --- Firestore Logging (every 5 minutes) ---
-  if (currentMillis - lastFirestoreUpload >= FIRESTORE_INTERVAL) {
-    lastFirestoreUpload = currentMillis;
-    
-    // Send data to Firestore for historical logging
-    if (sendDataToFirestore(temperature, humidity, pzemData, brightness, lightLevel)) {
-      Serial.println("{\"firestore\":\"log_success\"}");
-    } else {
-      Serial.println("{\"firestore\":\"log_failed\"}");
+void firestoreTask()
+{
+  if (!firestoreSampled || millis() - lastFirestoreSample >= FIRESTORE_LOG_INTERVAL) {
+    SensorReadings s;
+    readSensors(s);
+    TelemetrySample sample = makeTelemetrySample(s);
+
+    // Power as means and peak over the whole interval, not the reading of this instant
+    EnergyWindow interval;
+    if (energyStatsTake(interval))
+      applyEnergyWindow(sample, interval);
+    telemetryQueuePush(sample);
+    lastFirestoreSample = millis();
+    firestoreSampled = true;
+  }
+
+  // Samples taken before NTP sync are dated once the clock is set, sending
+  // them earlier would store them without a time
+  if (!isWiFiConnected() || !isTimeSynced())
+    return;
+
+  // Catch up faster when the backlog is large
+  int maxBatches = telemetryQueueFill() > 0.5f ? 8 : 2;
+
+  TelemetrySample batch[FIRESTORE_BATCH_SIZE];
+  for (int i = 0; i < maxBatches; i++) {
+    int n = telemetryQueuePeek(batch, FIRESTORE_BATCH_SIZE);
+    if (n == 0)
+      break;
+
+    // Only remove the samples once Firestore has accepted them
+    if (!sendBatchToFirestore(batch, n)) {
+      logText(LOG_WARN, "firestore", "log_failed");
+      break;
     }
+    telemetryQueuePop(n);
+    logText(LOG_INFO, "firestore", "log_success");
+  }
+}
+
+// Task timing report (every 10 seconds)
+void statsTask()
+{
+  LogRecord r;
+
+  for (int i = 0; i < taskCount(); i++) {
+    TaskStats stats;
+    getTaskStats(i, stats);
+
+    logBegin(r, LOG_INFO);
+    logString(r, "task", stats.name);
+    logUnsigned(r, "runs", stats.runs);
+    logUnsigned(r, "overruns", stats.overruns);
+    logUnsigned(r, "skipped", stats.skipped);
+    logUnsigned(r, "jitter_us", stats.lastJitter);
+    logUnsigned(r, "max_jitter_us", stats.maxJitter);
+    logUnsigned(r, "exec_us", stats.lastExec);
+    logUnsigned(r, "max_exec_us", stats.maxExec);
+    logUnsigned(r, "stack_free", stats.stackFree);
+    logEnd(r);
+  }
+
+  UploadStats upload;
+  getFirebaseUploadStats(upload);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "rtdb_uploads", upload.uploads);
+  logUnsigned(r, "patches", upload.patches);
+  logUnsigned(r, "skipped", upload.skipped);
+  logUnsigned(r, "failures", upload.failures);
+  logUnsigned(r, "connects", upload.connects);
+  logUnsigned(r, "reused", upload.reused);
+  logUnsigned(r, "latency_ms", upload.lastLatencyMs);
+  logUnsigned(r, "max_latency_ms", upload.maxLatencyMs);
+  logEnd(r);
+
+  // Histogram as one field per bucket, "lat_0" is the fastest.
+  // A record of its own, together they would not fit in LOG_RECORD_MAX
+  logBegin(r, LOG_INFO);
+  logString(r, "histogram", "rtdb_latency");
+  char key[8] = "lat_0";
+  for (int i = 0; i < UPLOAD_LATENCY_BUCKETS; i++) {
+    key[4] = '0' + i;
+    logUnsigned(r, key, upload.histogram[i]);
+  }
+  logEnd(r);
+
+  // Zero-cross tracker next to the PZEM reading of the same mains
+  ZeroCrossStats zc;
+  getZeroCrossStats(zc);
+  SensorReadings s;
+  readSensors(s);
+  logBegin(r, LOG_INFO);
+  logBool(r, "mains_locked", zc.locked);
+  logFloat(r, "mains_hz", zc.frequencyCentiHz / 100.0f, 2);
+  logFloat(r, "pzem_hz", s.pzem.frequency, 1);
+  logUnsigned(r, "zc_jitter_us", zc.jitterMicros);
+  logUnsigned(r, "zc_max_jitter_us", zc.maxJitterMicros);
+  logUnsigned(r, "zc_glitches", zc.glitches);
+  logUnsigned(r, "zc_missed", zc.missed);
+  logEnd(r);
+
+  // Last complete minute of power readings
+  EnergyWindow minute;
+  if (energyStatsMinutes(&minute, 1) == 1) {
+    logBegin(r, LOG_INFO);
+    logFloat(r, "minute_v_min", minute.voltageMin / 10.0f, 1);
+    logFloat(r, "minute_v_max", minute.voltageMax / 10.0f, 1);
+    logFloat(r, "minute_w_mean", minute.powerMean / 10.0f, 1);
+    logFloat(r, "minute_w_max", minute.powerMax / 10.0f, 1);
+    logFloat(r, "minute_pf_mean", minute.pfMean / 100.0f, 2);
+    logFloat(r, "minute_wh", minute.energy / 1000.0f, 3);
+    logUnsigned(r, "minute_samples", minute.samples);
+    logEnd(r);
   }
 
-  delay(100); // Short delay for responsive dimmer control
+  DaylightStats control;
+  getDaylightStats(control);
+  logBegin(r, LOG_INFO);
+  logInt(r, "light_setpoint", control.setpoint);
+  logInt(r, "light_level", control.lightLevel);
+  logInt(r, "lamp_level", control.output);
+  logUnsigned(r, "control_updates", control.updates);
+  logUnsigned(r, "control_skipped", control.skipped);
+  logUnsigned(r, "saturated", control.saturated);
+  logEnd(r);
+
+  // Boot timing: control should not wait for the network
+  ConnectivityStats net;
+  getConnectivityStats(net);
+  logBegin(r, LOG_INFO);
+  logBool(r, "wifi_connected", net.state == NET_CONNECTED);
+  logBool(r, "time_synced", net.timeSynced);
+  logInt(r, "rssi", net.rssi);
+  logUnsigned(r, "wifi_connects", net.connects);
+  logUnsigned(r, "wifi_drops", net.disconnects);
+  logUnsigned(r, "wifi_failed", net.failedAttempts);
+  logUnsigned(r, "last_reason", net.lastReason);
+  logUnsigned(r, "boot_to_control_ms", firstControlMs);
+  logUnsigned(r, "boot_to_wifi_ms", net.firstConnectMs);
+  logUnsigned(r, "boot_to_time_ms", net.firstTimeSyncMs);
+  logEnd(r);
+
+  SensorBusStats bus;
+  getSensorBusStats(bus);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "bus_samples", bus.published);
+  logUnsigned(r, "bus_pool_full", bus.poolFull);
+  logUnsigned(r, "env_quality", s.quality[SENSOR_ENVIRONMENT]);
+  logUnsigned(r, "power_quality", s.quality[SENSOR_POWER]);
+  logUnsigned(r, "light_quality", s.quality[SENSOR_LIGHT]);
+  logEnd(r);
+
+  for (int i = 0; i < bus.subscribers; i++) {
+    SensorSubscriberStats sub;
+    getSensorSubscriberStats(i, sub);
+    logBegin(r, LOG_INFO);
+    logString(r, "subscriber", sub.name);
+    logUnsigned(r, "delivered", sub.delivered);
+    logUnsigned(r, "dropped", sub.dropped);
+    logUnsigned(r, "max_queued", sub.maxQueued);
+    logEnd(r);
+  }
+
+  LiveStats live;
+  getLiveStats(live);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "live_clients", live.clients);
+  logUnsigned(r, "live_frames", live.published);
+  logUnsigned(r, "live_sent", live.sent);
+  logUnsigned(r, "live_dropped", live.dropped);
+  logUnsigned(r, "live_kicked", live.kicked);
+  logUnsigned(r, "live_commands", live.commands);
+  logUnsigned(r, "live_rejected", live.rejected);
+  logUnsigned(r, "live_max_send_us", live.maxSendMicros);
+  logBool(r, "manual_dimmers", manualDimmers);
+  logEnd(r);
+
+  HistoryStats history;
+  getHistoryStats(history);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "history_samples", history.appended);
+  logUnsigned(r, "history_skipped", history.skipped);
+  logUnsigned(r, "history_blocks", history.blocks);
+  logUnsigned(r, "history_bytes", history.bytes);
+  logUnsigned(r, "history_segments", history.segments);
+  logUnsigned(r, "history_max_segments", history.maxSegments);
+  logUnsigned(r, "history_errors", history.writeErrors);
+  logUnsigned(r, "history_from", history.firstTime);
+  logEnd(r);
+
+  TelemetryQueueStats queue;
+  telemetryQueueGetStats(queue);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "log_queued", queue.queued);
+  logUnsigned(r, "in_flash", queue.inFlash);
+  logUnsigned(r, "sent", queue.sent);
+  logUnsigned(r, "dropped", queue.dropped);
+  logEnd(r);
+
+  // The log's own counters, records lost here never reached the UART
+  LogStats log;
+  getLogStats(log);
+  logBegin(r, LOG_INFO);
+  logUnsigned(r, "serial_records", log.records);
+  logUnsigned(r, "serial_bytes", log.bytes);
+  logUnsigned(r, "serial_dropped", log.dropped);
+  logUnsigned(r, "serial_rate_limited", log.rateLimited);
+  logUnsigned(r, "serial_truncated", log.truncated);
+  logUnsigned(r, "serial_max_used", log.maxUsed);
+  logEnd(r);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  Serial.println("\n=== ESP32-S3 IoT System ===");
+  
+  // Sensors publish on the bus, sinks subscribe to the sample types they use
+  sensorAdd(environmentSensor);
+  sensorAdd(powerSensor);
+  sensorAdd(lightSensor);
+  sensorAdd(lampSensor);
+  energySubscription = sensorSubscribe("energy", SENSOR_MASK(SENSOR_POWER));
+  liveSubscription = sensorSubscribe("live", SENSOR_ALL);
+  sensorsBegin();
+  readSensors(liveReadings); // Nothing yet: no response everywhere
+
+  // Start connecting to WiFi, returns right away (NTP follows in the background)
+  initConnectivity();
+  liveServerBegin(onLiveCommand); // LAN dashboards, ws://<ip>:81
+
+  initializeDimmers();    // Initialize the dimmers
+  initDaylightControl();  // Lamps follow the light sensor
+  telemetryQueueBegin();  // Samples not uploaded before the last reboot
+  if (LittleFS.begin(true)) // Local history, appended to once a second
+    historyBegin(LittleFS, LittleFS.totalBytes() / 100 * HISTORY_FLASH_PERCENT);
+
+  // name, function, period ms, deadline ms, stack bytes, priority, core
+  // Control work stays on core 1, the WiFi stack runs on core 0
+  addTask("sensors",   sensorsTask,   SENSOR_TICK_MS, 2, 4096, 5, 1);
+  addTask("control",   controlTask,   100,    20,    4096, 4, 1);
+  addTask("energy",    energyTask,    PZEM_READ_INTERVAL, 100, 2048, 3, 1);
+  addTask("log",       logTask,       100,    100,   4096, 2);
+  addTask("history",   historyTask,   HISTORY_INTERVAL_MS, 1000, 4096, 1);
+  addTask("net",       netTask,       100,    100,   4096, 1, 0);
+  addTask("live",      liveTask,      20,     20,    6144, 2, 0);
+  addTask("firebase",  firebaseTask,  5000,   5000,  8192, 1);
+  addTask("firestore", firestoreTask, 30000,  30000, 8192, 1);
+  addTask("stats",     statsTask,     10000,  1000,  4096, 1);
+  addTask("logout",    logOutTask,    10,     10,    2048, 1, 0);
+  startScheduler();
+
+  // From here on everything goes through the log ring
+  logText(LOG_INFO, "system", "ready");
+}
+
+void loop()
+{
+  // All work happens in the scheduler tasks, the Arduino loop task is not needed
+  vTaskDelete(NULL);
 }
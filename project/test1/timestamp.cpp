@@ -0,0 +1,92 @@
+#include "timestamp.h"
+#include "wifi_firebase.h"
+#include <time.h>
+
+static const uint32_t SECONDS_PER_DAY = 86400;
+
+// Same "is synced" test the rest of the sketch uses on time()
+static const time_t CLOCK_SET_AFTER = 1000000000;
+
+// Text of the last second one form produced
+struct FormatCache {
+    uint32_t day;     // Days since 1970-01-01 in the form's zone, UINT32_MAX = empty
+    uint32_t second;  // Unix time the text was made for
+    char text[TIMESTAMP_ISO_SIZE];
+};
+
+static FormatCache localCache = {UINT32_MAX, 0, "YYYY-MM-DD HH:MM:SS"};
+static FormatCache isoCache = {UINT32_MAX, 0, "YYYY-MM-DDTHH:MM:SSZ"};
+
+// Both upload tasks format timestamps, the update is a few dozen instructions
+static portMUX_TYPE cacheLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void put2(char *p, uint32_t v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
+// Days since 1970-01-01 to year/month/day (proleptic Gregorian, H. Hinnant's algorithm)
+static void civilFromDays(uint32_t days, uint32_t &year, uint32_t &month, uint32_t &day) {
+    uint32_t z = days + 719468;          // Days since 0000-03-01
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;     // Day of the 400 year era
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;   // Month counted from March
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+}
+
+// Bring the cached text up to 'zoned' (seconds since the epoch in the form's zone)
+static void updateCache(FormatCache &c, uint32_t unixTime, uint32_t zoned) {
+    uint32_t day = zoned / SECONDS_PER_DAY;
+    if (day != c.day) {
+        uint32_t y, m, d;
+        civilFromDays(day, y, m, d);
+        put2(c.text, y / 100);
+        put2(c.text + 2, y % 100);
+        put2(c.text + 5, m);
+        put2(c.text + 8, d);
+        c.day = day;
+    }
+
+    uint32_t s = zoned % SECONDS_PER_DAY;
+    put2(c.text + 11, s / 3600);
+    put2(c.text + 14, s / 60 % 60);
+    put2(c.text + 17, s % 60);
+    c.second = unixTime;
+}
+
+static size_t formatCached(FormatCache &c, char *buffer, size_t length, uint32_t unixTime, uint32_t zoned) {
+    portENTER_CRITICAL(&cacheLock);
+    if (c.day == UINT32_MAX || c.second != unixTime) updateCache(c, unixTime, zoned);
+    memcpy(buffer, c.text, length);
+    portEXIT_CRITICAL(&cacheLock);
+
+    buffer[length] = '\0';
+    return length;
+}
+
+size_t formatLocalTime(char *buffer, uint32_t unixTime) {
+    // The not-synced epoch stays at midnight, like the old getTimestamp()
+    uint32_t zoned = unixTime == 0 ? 0 : unixTime + GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC;
+    return formatCached(localCache, buffer, TIMESTAMP_LOCAL_SIZE - 1, unixTime, zoned);
+}
+
+size_t formatIsoTime(char *buffer, uint32_t unixTime) {
+    return formatCached(isoCache, buffer, TIMESTAMP_ISO_SIZE - 1, unixTime, unixTime);
+}
+
+TimePair timeNow() {
+    TimePair t;
+    t.uptimeMs = millis();
+    time_t now = time(nullptr);
+    t.unixTime = now > CLOCK_SET_AFTER ? (uint32_t)now : 0;
+    return t;
+}
+
+uint32_t timeAtUptime(const TimePair &now, uint32_t uptimeMs) {
+    if (now.unixTime == 0) return 0;
+    return now.unixTime - (int32_t)(now.uptimeMs - uptimeMs) / 1000;
+}
@@ -0,0 +1,38 @@
+#ifndef TIMESTAMP_H
+#define TIMESTAMP_H
+
+#include <Arduino.h>
+
+// --- TIMESTAMP FORMATTING ---
+// Formats Unix times without time()/localtime()/strftime() and without a String.
+// Each form keeps the text of the last second it produced: the same second is a
+// copy, a later second of the same day only rewrites the time digits, and the
+// date is only worked out again when the day changes.
+// Local time is UTC + GMT_OFFSET_SEC + DAYLIGHT_OFFSET_SEC, the same fixed
+// offset configTime() gives localtime()
+
+// Buffer sizes, NUL included
+const size_t TIMESTAMP_LOCAL_SIZE = 20; // "YYYY-MM-DD HH:MM:SS"
+const size_t TIMESTAMP_ISO_SIZE = 21;   // "YYYY-MM-DDTHH:MM:SSZ"
+
+// Wall clock and monotonic time read together, so a sample taken before the
+// clock was set can still be dated once it is
+struct TimePair {
+    uint32_t unixTime;  // 0 = clock not set yet
+    uint32_t uptimeMs;  // millis()
+};
+
+TimePair timeNow();
+
+// Unix time at an earlier (or later) millis() value, 0 if the clock is not set
+uint32_t timeAtUptime(const TimePair &now, uint32_t uptimeMs);
+
+// "YYYY-MM-DD HH:MM:SS" in local time into a TIMESTAMP_LOCAL_SIZE buffer
+// unixTime 0 gives "1970-01-01 00:00:00". Returns the length (19)
+size_t formatLocalTime(char *buffer, uint32_t unixTime);
+
+// "YYYY-MM-DDTHH:MM:SSZ" in UTC into a TIMESTAMP_ISO_SIZE buffer
+// Returns the length (20)
+size_t formatIsoTime(char *buffer, uint32_t unixTime);
+
+#endif
@@ -1,283 +1,215 @@
 #include "wifi_firebase.h"
 #include <WiFi.h>
+#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
-#include <ArduinoJson.h>
-#include <time.h>
+#include "telemetry_encoder.h"
+#include "timestamp.h"
+#include "log_sink.h"
 
-// Track connection states
-bool wifiConnected = false;
-bool timeInitialized = false;
+// --- RTDB SESSION ---
+// One connection for the lifetime of the device. HTTPClient with reuse enabled
+// leaves the socket (and its TLS session) open after end(), the next begin()
+// to the same host picks it up again without a new handshake
+#if FIREBASE_REALTIME_TLS
+WiFiClientSecure rtdbClient;
+#else
+WiFiClient rtdbClient;
+#endif
+HTTPClient rtdbHttp;
+bool rtdbClientReady = false;
 
-void initWiFi() {
-    Serial.print("Connecting to WiFi");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
-    
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 30) {
-        delay(500);
-        Serial.print(".");
-        attempts++;
-    }
-    
-    if (WiFi.status() == WL_CONNECTED) {
-        wifiConnected = true;
-        Serial.println();
-        Serial.print("Connected! IP: ");
-        Serial.println(WiFi.localIP());
-        
-        // Initialize NTP after WiFi connection
-        initNTP();
-    } else {
-        wifiConnected = false;
-        Serial.println();
-        Serial.println("WiFi connection failed!");
-    }
-}
+const uint16_t UPLOAD_LATENCY_LIMITS_MS[UPLOAD_LATENCY_BUCKETS - 1] = {50, 100, 200, 500, 1000, 2000, 5000};
 
-void initNTP() {
-    Serial.print("Syncing time with NTP");
-    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER, "time.nist.gov");
-    
-    // Wait for time to be set
-    time_t now;
-    int attempts = 0;
-    while ((now = time(nullptr)) < 1000000000 && attempts < 30) {
-        Serial.print(".");
-        delay(500);
-        attempts++;
-    }
-    
-    timeInitialized = (now > 1000000000);
-    
-    if (timeInitialized) {
-        Serial.println();
-        Serial.print("Time synchronized: ");
-        Serial.println(getTimestamp());
-    } else {
-        Serial.println();
-        Serial.println("NTP sync failed!");
+// Payloads are encoded into these, nothing is allocated per upload
+// Each is only used by its own upload task
+char rtdbPayload[TELEMETRY_RTDB_MAX];
+char firestorePayload[TELEMETRY_FIRESTORE_COMMIT_OVERHEAD + FIRESTORE_BATCH_SIZE * TELEMETRY_FIRESTORE_WRITE_MAX];
+
+// What the database holds, as far as we know. Invalid after a failed write,
+// which forces the next upload to be a full PUT
+TelemetrySample rtdbSent;
+bool rtdbSentValid = false;
+unsigned long rtdbLastFullWrite = 0;
+
+UploadStats rtdbStats = {};
+portMUX_TYPE rtdbStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Record one upload in the latency histogram
+static void recordUpload(uint32_t latencyMs, bool ok, bool reused, bool patch) {
+    int bucket = 0;
+    while (bucket < UPLOAD_LATENCY_BUCKETS - 1 && latencyMs >= UPLOAD_LATENCY_LIMITS_MS[bucket]) {
+        bucket++;
     }
+
+    portENTER_CRITICAL(&rtdbStatsLock);
+    rtdbStats.uploads++;
+    if (patch) rtdbStats.patches++;
+    if (!ok) rtdbStats.failures++;
+    if (reused) rtdbStats.reused++;
+    else rtdbStats.connects++;
+    rtdbStats.lastLatencyMs = latencyMs;
+    if (latencyMs > rtdbStats.maxLatencyMs) rtdbStats.maxLatencyMs = latencyMs;
+    rtdbStats.histogram[bucket]++;
+    portEXIT_CRITICAL(&rtdbStatsLock);
 }
 
-String getTimestamp() {
-    if (!timeInitialized) {
-        return "1970-01-01 00:00:00";
-    }
-    
-    time_t now = time(nullptr);
-    struct tm* timeinfo = localtime(&now);
-    
-    char buffer[25];
-    // Format: YYYY-MM-DD HH:MM:SS
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", timeinfo);
-    return String(buffer);
+void getFirebaseUploadStats(UploadStats &stats) {
+    portENTER_CRITICAL(&rtdbStatsLock);
+    stats = rtdbStats;
+    portEXIT_CRITICAL(&rtdbStatsLock);
 }
 
-String getISOTimestamp() {
-    if (!timeInitialized) {
-        return "1970-01-01T00:00:00Z";
+// PUT (whole document) or PATCH (listed fields) the live state path over the persistent connection
+// Returns the HTTP status, or a negative HTTPClient error
+static int rtdbSend(const char *method, const char *payload, size_t length) {
+    bool patch = strcmp(method, "PATCH") == 0;
+
+    if (!rtdbClientReady) {
+#if FIREBASE_REALTIME_TLS
+        rtdbClient.setInsecure(); // Same as HTTPClient::begin(url) without a CA certificate
+#endif
+        rtdbHttp.setReuse(true);  // Ask for keep-alive and keep the socket after end()
+        rtdbHttp.setTimeout(FIREBASE_HTTP_TIMEOUT);
+        rtdbClientReady = true;
     }
-    
-    time_t now = time(nullptr);
-    struct tm* timeinfo = gmtime(&now);  // UTC time for Firestore
-    
-    char buffer[32];
-    // ISO 8601 format: YYYY-MM-DDTHH:MM:SSZ
-    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", timeinfo);
-    return String(buffer);
-}
 
-bool isWiFiConnected() {
-    wifiConnected = (WiFi.status() == WL_CONNECTED);
-    return wifiConnected;
+    // Try on the open connection first. If the server closed it in the meantime
+    // the request fails with a connection error: drop it and retry once on a fresh one
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = rtdbClient.connected();
+        unsigned long start = millis();
+
+        rtdbHttp.begin(rtdbClient, FIREBASE_REALTIME_HOST, FIREBASE_REALTIME_PORT,
+                       "/device/sensorData.json", FIREBASE_REALTIME_TLS);
+        rtdbHttp.addHeader("Content-Type", "application/json");
+
+        int httpCode = rtdbHttp.sendRequest(method, (uint8_t *)payload, length);
+        rtdbHttp.end(); // Keeps the connection open when the server allows it
+
+        if (httpCode > 0) {
+            recordUpload(millis() - start, httpCode == 200, reused, patch);
+            return httpCode;
+        }
+
+        rtdbClient.stop();
+        if (!reused) {
+            // A fresh connection failed too, give up until the next upload
+            recordUpload(millis() - start, false, false, patch);
+            return httpCode;
+        }
+    }
+    return -1;
 }
 
-bool sendDataToFirebase(float temperature, float humidity, PzemData pzemData, int brightness, int lightLevel) {
+bool sendDataToFirebase(const SensorReadings &readings) {
     if (!isWiFiConnected()) {
-        Serial.println("WiFi not connected, skipping Firebase upload");
+        logText(LOG_DEBUG, "firebase", "no_wifi");
         return false;
     }
     
-    HTTPClient https;
+    TelemetrySample sample = makeTelemetrySample(readings);
     
-    // Firebase RTDB REST API URL
-    String url = "https://" + String(FIREBASE_REALTIME_HOST) + "/device/sensorData.json";
+    bool full = !rtdbSentValid || millis() - rtdbLastFullWrite >= FIREBASE_HEARTBEAT_MS;
+    uint16_t changed = full ? 0 : rtdbChangedFields(sample, rtdbSent);
     
-    https.begin(url);
-    https.addHeader("Content-Type", "application/json");
-    
-    // Build JSON payload using ArduinoJson
-    JsonDocument doc;
-    
-    // Timestamps (root level)
-    doc["timestamp"] = getTimestamp();
-    doc["unix_time"] = (unsigned long)time(nullptr);
-    
-    // Environment group (XY-MD02 Modbus sensor)
-    JsonObject environment = doc["environment"].to<JsonObject>();
-    environment["temperature"] = round(temperature * 10) / 10.0;
-    environment["humidity"] = round(humidity * 10) / 10.0;
-    environment["connected"] = (temperature != -1);  // -1 means no response
-    
-    // Power group (PZEM-004T sensor)
-    JsonObject power = doc["power"].to<JsonObject>();
-    power["voltage"] = round(pzemData.voltage * 10) / 10.0;
-    power["current"] = round(pzemData.current * 100) / 100.0;
-    power["power"] = round(pzemData.power * 10) / 10.0;
-    power["energy"] = round(pzemData.energy * 1000) / 1000.0;
-    power["frequency"] = round(pzemData.frequency * 10) / 10.0;
-    power["pf"] = round(pzemData.pf * 100) / 100.0;
-    power["connected"] = pzemData.connected;
-    
-    // Lighting group (Light sensor + Dimmers)
-    JsonObject lighting = doc["lighting"].to<JsonObject>();
-    lighting["light_level"] = lightLevel;           // Raw ADC value (0-4095)
-    lighting["auto_brightness"] = brightness;       // Calculated brightness (0-100%)
-    lighting["dimmer1"] = brightness;
-    lighting["dimmer2"] = brightness;
-    
-    // System group (Device info)
-    JsonObject system = doc["system"].to<JsonObject>();
-    system["device"] = "ESP32S3_IoT";
-    system["free_heap"] = ESP.getFreeHeap();
-    system["wifi_rssi"] = WiFi.RSSI();              // Signal strength in dBm
+    if (!full && changed == 0) {
+        portENTER_CRITICAL(&rtdbStatsLock);
+        rtdbStats.skipped++;
+        portEXIT_CRITICAL(&rtdbStatsLock);
+        return true;
+    }
     
-    // Serialize JSON to string
-    String jsonString;
-    serializeJson(doc, jsonString);
+    size_t length;
+    if (full) {
+        length = encodeRtdbPayload(rtdbPayload, sizeof(rtdbPayload), sample, DEVICE_NAME);
+    } else {
+        length = encodeRtdbPatch(rtdbPayload, sizeof(rtdbPayload), sample, changed);
+    }
+    if (length == 0) {
+        logText(LOG_ERROR, "firebase", "payload_too_large");
+        return false;
+    }
     
-    // Send PUT request (overwrites data at path)
-    int httpCode = https.PUT(jsonString);
+    // PUT overwrites the whole document, PATCH only the listed paths
+    int httpCode = rtdbSend(full ? "PUT" : "PATCH", rtdbPayload, length);
     
-    https.end();
+    if (httpCode == 200) {
+        if (full) {
+            rtdbSent = sample;
+            rtdbSentValid = true;
+            rtdbLastFullWrite = millis();
+        } else {
+            rtdbMergeFields(rtdbSent, sample, changed);
+        }
+    } else {
+        // We no longer know what the database holds
+        rtdbSentValid = false;
+    }
     
     if (httpCode == 200) {
-        Serial.print("Firebase update OK at ");
-        Serial.println(getTimestamp());
+        char text[TIMESTAMP_LOCAL_SIZE];
+        formatLocalTime(text, timeNow().unixTime);
+        LogRecord r;
+        logBegin(r, LOG_DEBUG);
+        logString(r, "firebase", full ? "put" : "patch");
+        logString(r, "at", text);
+        logEnd(r);
         return true;
     } else {
-        Serial.print("Firebase update failed, HTTP code: ");
-        Serial.println(httpCode);
+        LogRecord r;
+        logBegin(r, LOG_WARN);
+        logString(r, "firebase", "http_error");
+        logInt(r, "code", httpCode);
+        logEnd(r);
         return false;
     }
 }
 
-bool sendDataToFirestore(float temperature, float humidity, PzemData pzemData, int brightness, int lightLevel) {
+bool sendBatchToFirestore(const TelemetrySample *samples, int count) {
     if (!isWiFiConnected()) {
-        Serial.println("WiFi not connected, skipping Firestore upload");
+        logText(LOG_DEBUG, "firestore", "no_wifi");
         return false;
     }
+    if (count <= 0) {
+        return true;
+    }
     
-    HTTPClient https;
+    // Fails (returns 0) for more than FIRESTORE_BATCH_SIZE samples
+    size_t length = encodeFirestoreCommit(firestorePayload, sizeof(firestorePayload), samples, count,
+                                          FIREBASE_PROJECT_ID, DEVICE_NAME);
+    if (length == 0) {
+        logText(LOG_ERROR, "firestore", "payload_too_large");
+        return false;
+    }
     
-    // Firestore REST API URL - creates new document in 'sensorLogs' collection
-    String url = "https://firestore.googleapis.com/v1/projects/" + 
-                 String(FIREBASE_PROJECT_ID) + 
-                 "/databases/(default)/documents/sensorLogs";
+    HTTPClient https;
     
-    https.begin(url);
+    // Firestore REST API commit: all writes are applied atomically in one request
+    https.begin("https://firestore.googleapis.com/v1/projects/" FIREBASE_PROJECT_ID
+                "/databases/(default)/documents:commit");
     https.addHeader("Content-Type", "application/json");
+    https.setTimeout(FIREBASE_HTTP_TIMEOUT);
     
-    // Build Firestore JSON format (requires special structure)
-    JsonDocument doc;
-    JsonObject fields = doc["fields"].to<JsonObject>();
-    
-    // Timestamp field
-    JsonObject timestampField = fields["timestamp"].to<JsonObject>();
-    timestampField["timestampValue"] = getISOTimestamp();
-    
-    // Local timestamp (human readable)
-    JsonObject localTimeField = fields["local_time"].to<JsonObject>();
-    localTimeField["stringValue"] = getTimestamp();
-    
-    // Environment group
-    JsonObject envField = fields["environment"].to<JsonObject>();
-    JsonObject envMap = envField["mapValue"].to<JsonObject>();
-    JsonObject envFields = envMap["fields"].to<JsonObject>();
-    
-    JsonObject tempField = envFields["temperature"].to<JsonObject>();
-    tempField["doubleValue"] = round(temperature * 10) / 10.0;
-    
-    JsonObject humField = envFields["humidity"].to<JsonObject>();
-    humField["doubleValue"] = round(humidity * 10) / 10.0;
-    
-    JsonObject envConnField = envFields["connected"].to<JsonObject>();
-    envConnField["booleanValue"] = (temperature != -1);
-    
-    // Power group
-    JsonObject powerField = fields["power"].to<JsonObject>();
-    JsonObject powerMap = powerField["mapValue"].to<JsonObject>();
-    JsonObject powerFields = powerMap["fields"].to<JsonObject>();
-    
-    JsonObject voltageField = powerFields["voltage"].to<JsonObject>();
-    voltageField["doubleValue"] = round(pzemData.voltage * 10) / 10.0;
-    
-    JsonObject currentField = powerFields["current"].to<JsonObject>();
-    currentField["doubleValue"] = round(pzemData.current * 100) / 100.0;
-    
-    JsonObject pwrField = powerFields["power"].to<JsonObject>();
-    pwrField["doubleValue"] = round(pzemData.power * 10) / 10.0;
-    
-    JsonObject energyField = powerFields["energy"].to<JsonObject>();
-    energyField["doubleValue"] = round(pzemData.energy * 1000) / 1000.0;
-    
-    JsonObject freqField = powerFields["frequency"].to<JsonObject>();
-    freqField["doubleValue"] = round(pzemData.frequency * 10) / 10.0;
-    
-    JsonObject pfField = powerFields["pf"].to<JsonObject>();
-    pfField["doubleValue"] = round(pzemData.pf * 100) / 100.0;
-    
-    JsonObject pzemConnField = powerFields["connected"].to<JsonObject>();
-    pzemConnField["booleanValue"] = pzemData.connected;
-    
-    // Lighting group
-    JsonObject lightField = fields["lighting"].to<JsonObject>();
-    JsonObject lightMap = lightField["mapValue"].to<JsonObject>();
-    JsonObject lightFields = lightMap["fields"].to<JsonObject>();
-    
-    JsonObject lightLevelField = lightFields["light_level"].to<JsonObject>();
-    lightLevelField["integerValue"] = String(lightLevel);
-    
-    JsonObject brightnessField = lightFields["auto_brightness"].to<JsonObject>();
-    brightnessField["integerValue"] = String(brightness);
-    
-    JsonObject dimmer1Field = lightFields["dimmer1"].to<JsonObject>();
-    dimmer1Field["integerValue"] = String(brightness);
-    
-    JsonObject dimmer2Field = lightFields["dimmer2"].to<JsonObject>();
-    dimmer2Field["integerValue"] = String(brightness);
-    
-    // System group
-    JsonObject sysField = fields["system"].to<JsonObject>();
-    JsonObject sysMap = sysField["mapValue"].to<JsonObject>();
-    JsonObject sysFields = sysMap["fields"].to<JsonObject>();
-    
-    JsonObject deviceField = sysFields["device"].to<JsonObject>();
-    deviceField["stringValue"] = "ESP32S3_IoT";
-    
-    JsonObject heapField = sysFields["free_heap"].to<JsonObject>();
-    heapField["integerValue"] = String(ESP.getFreeHeap());
-    
-    JsonObject rssiField = sysFields["wifi_rssi"].to<JsonObject>();
-    rssiField["integerValue"] = String(WiFi.RSSI());
-    
-    // Serialize JSON to string
-    String jsonString;
-    serializeJson(doc, jsonString);
-    
-    // Send POST request (creates new document with auto-generated ID)
-    int httpCode = https.POST(jsonString);
+    int httpCode = https.POST((uint8_t *)firestorePayload, length);
     
     https.end();
     
     if (httpCode == 200) {
-        Serial.print("Firestore log OK at ");
-        Serial.println(getTimestamp());
+        char text[TIMESTAMP_LOCAL_SIZE];
+        formatLocalTime(text, timeNow().unixTime);
+        LogRecord r;
+        logBegin(r, LOG_DEBUG);
+        logString(r, "firestore", "batch");
+        logInt(r, "count", count);
+        logString(r, "at", text);
+        logEnd(r);
         return true;
     } else {
-        Serial.print("Firestore log failed, HTTP code: ");
-        Serial.println(httpCode);
+        LogRecord r;
+        logBegin(r, LOG_WARN);
+        logString(r, "firestore", "http_error");
+        logInt(r, "code", httpCode);
+        logEnd(r);
         return false;
     }
 }
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include "pzem.h"
+#include "telemetry_queue.h"
+#include "connectivity.h"
 
 // WiFi credentials
 #define WIFI_SSID "koswismacendanaputih_balkon"
@@ -10,36 +12,74 @@
 
 // Firebase configuration
 #define FIREBASE_PROJECT_ID "e-smarthome-62391"
+#ifndef FIREBASE_REALTIME_HOST
 #define FIREBASE_REALTIME_HOST "e-smarthome-62391-default-rtdb.asia-southeast1.firebasedatabase.app"
+#endif
 
-// NTP configuration for human-readable timestamp (GMT+7 Indonesia)
-#define NTP_SERVER "pool.ntp.org"
-#define GMT_OFFSET_SEC 25200  // GMT+7 (7 * 3600)
-#define DAYLIGHT_OFFSET_SEC 0
+// Device name reported in every upload and used in Firestore document IDs
+#define DEVICE_NAME "ESP32S3_IoT"
 
-// Initialize WiFi connection
-void initWiFi();
+// Firestore history: one sample per interval, uploaded in batches of up to
+// FIRESTORE_BATCH_SIZE documents per commit request
+#define FIRESTORE_LOG_INTERVAL 300000
+#define FIRESTORE_BATCH_SIZE 10
 
-// Initialize NTP for time synchronization
-void initNTP();
+// RTDB transport. To watch keep-alive and latency against the plain-HTTP
+// stand-in in host/rtdb_server.cpp, set FIREBASE_REALTIME_HOST to the PC's
+// address, FIREBASE_REALTIME_TLS 0 and FIREBASE_REALTIME_PORT 8080
+#ifndef FIREBASE_REALTIME_TLS
+#define FIREBASE_REALTIME_TLS 1
+#endif
+#ifndef FIREBASE_REALTIME_PORT
+#define FIREBASE_REALTIME_PORT 443
+#endif
 
-// Get human-readable timestamp string (format: "YYYY-MM-DD HH:MM:SS")
-String getTimestamp();
+// RTDB request timeout (ms), a stalled keep-alive connection is dropped after this
+#define FIREBASE_HTTP_TIMEOUT 5000
 
-// Get ISO 8601 timestamp for Firestore (format: "YYYY-MM-DDTHH:MM:SSZ")
-String getISOTimestamp();
+// RTDB live state is only PATCHed with the fields that moved past their dead-band
+// (see telemetry_encoder.h). The whole document is PUT at least this often (ms)
+// so the dashboard timestamp never gets older than this on stable readings
+#ifndef FIREBASE_HEARTBEAT_MS
+#define FIREBASE_HEARTBEAT_MS 60000
+#endif
+
+// Upload latency histogram: bucket i counts uploads faster than UPLOAD_LATENCY_LIMITS_MS[i],
+// the last bucket counts everything slower
+const int UPLOAD_LATENCY_BUCKETS = 8;
+extern const uint16_t UPLOAD_LATENCY_LIMITS_MS[UPLOAD_LATENCY_BUCKETS - 1];
+
+struct UploadStats {
+    uint32_t uploads;        // Upload attempts (full writes and patches)
+    uint32_t patches;        // Of which partial updates
+    uint32_t skipped;        // Updates not sent because nothing moved past its dead-band
+    uint32_t failures;       // Non-200 status or connection errors
+    uint32_t connects;       // New connections (full TLS handshakes)
+    uint32_t reused;         // Requests sent on an already open connection
+    uint32_t lastLatencyMs;
+    uint32_t maxLatencyMs;
+    uint32_t histogram[UPLOAD_LATENCY_BUCKETS];
+};
+
+// NTP configuration for human-readable timestamp (GMT+7 Indonesia)
+// SNTP is started by the connectivity manager once WiFi is up
+#define NTP_SERVER "pool.ntp.org"
+#define GMT_OFFSET_SEC 25200  // GMT+7 (7 * 3600)
+#define DAYLIGHT_OFFSET_SEC 0
 
 // Send sensor data to Firebase Realtime Database (live state, every 5 seconds)
+// Only changed fields are sent, nothing at all if no field changed and the
+// heartbeat is not due yet (that counts as success)
+// Keeps the connection open between calls and reconnects once if it was dropped
 // Returns true if successful, false otherwise
-// brightness: current dimmer brightness (0-100)
-// lightLevel: raw light sensor reading (0-4095)
-bool sendDataToFirebase(float temperature, float humidity, PzemData pzemData, int brightness, int lightLevel);
+bool sendDataToFirebase(const SensorReadings &readings);
 
-// Send sensor data to Firestore (historical logging, every 5 minutes)
-// Creates a new document in the 'sensorLogs' collection
-bool sendDataToFirestore(float temperature, float humidity, PzemData pzemData, int brightness, int lightLevel);
+// Write queued samples to the 'sensorLogs' Firestore collection in one commit request
+// Document IDs come from the sample time, so resending a batch does not duplicate it
+// Returns true if every write was applied, false otherwise (nothing was written)
+bool sendBatchToFirestore(const TelemetrySample *samples, int count);
 
-// Check WiFi connection status
-bool isWiFiConnected();
+// Copy of the RTDB upload statistics
+void getFirebaseUploadStats(UploadStats &stats);
 
 #endif
@@ -0,0 +1,116 @@
+#include "zero_cross.h"
+
+// --- PERIOD TRACKER ---
+// A second order loop on the edge times: each edge is compared with the time
+// predicted from the last edge and the period estimate, and the error nudges
+// the period. Edges far too early are noise, edges far too late mean some
+// were missed. Periods are kept in 1/16 microseconds so small corrections add up
+
+// Gain of the period correction once locked (1/16 of the error per edge)
+const int PERIOD_GAIN_SHIFT = 4;
+
+// Gain while acquiring, follows the measured period more closely
+const int ACQUIRE_GAIN_SHIFT = 2;
+
+// Allowed distance from the predicted edge, as a fraction of the period (1/8)
+const int WINDOW_SHIFT = 3;
+
+// Longest run of missing edges we bridge without dropping the lock
+const int MAX_MISSED_EDGES = 4;
+
+volatile uint32_t periodQ4 = ZC_NOMINAL_HALF_PERIOD << 4;
+volatile uint32_t jitterQ4 = 0;
+volatile unsigned long lastEdge = 0;
+volatile bool haveEdge = false;
+volatile int lockCount = 0;
+
+ZeroCrossStats zcStats = {false, ZC_NOMINAL_HALF_PERIOD, 5000, 0, 0, 0, 0, 0, 0};
+
+static void IRAM_ATTR dropLock(unsigned long now) {
+    if (lockCount >= ZC_LOCK_EDGES) zcStats.relocks++;
+    lockCount = 0;
+    lastEdge = now;
+}
+
+bool IRAM_ATTR zeroCrossUpdate(unsigned long now) {
+    if (!haveEdge) {
+        haveEdge = true;
+        lastEdge = now;
+        zcStats.edges++;
+        return true;
+    }
+
+    unsigned long dt = now - lastEdge;
+    uint32_t period = periodQ4 >> 4;
+    bool locked = lockCount >= ZC_LOCK_EDGES;
+
+    if (!locked) {
+        // Acquiring: anything shorter than the shortest half-cycle is noise
+        if (dt < ZC_MIN_HALF_PERIOD) {
+            zcStats.glitches++;
+            return false;
+        }
+        if (dt > ZC_MAX_HALF_PERIOD) {
+            // Too long to measure anything, start again from this edge
+            dropLock(now);
+            zcStats.edges++;
+            return true;
+        }
+
+        int32_t error = (int32_t)(dt << 4) - (int32_t)periodQ4;
+        if (lockCount == 0) periodQ4 = dt << 4;
+        else periodQ4 += error >> ACQUIRE_GAIN_SHIFT;
+
+        lockCount++;
+        lastEdge = now;
+        zcStats.edges++;
+        return true;
+    }
+
+    // Locked: compare with the predicted edge
+    uint32_t window = period >> WINDOW_SHIFT;
+
+    if (dt + window < period) {
+        zcStats.glitches++;
+        return false;
+    }
+
+    if (dt > period + window) {
+        // Late: either whole half-cycles went missing or the mains changed
+        uint32_t cycles = (dt + period / 2) / period;
+        int32_t residual = (int32_t)dt - (int32_t)(cycles * period);
+        if (cycles <= MAX_MISSED_EDGES && (uint32_t)abs(residual) <= window) {
+            zcStats.missed += cycles - 1;
+            lastEdge = now;
+            zcStats.edges++;
+            return true;
+        }
+        dropLock(now);
+        zcStats.edges++;
+        return true;
+    }
+
+    int32_t error = (int32_t)(dt << 4) - (int32_t)periodQ4;
+    periodQ4 += error >> PERIOD_GAIN_SHIFT;
+
+    uint32_t absError = abs(error);
+    jitterQ4 += ((int32_t)absError - (int32_t)jitterQ4) >> PERIOD_GAIN_SHIFT;
+    if ((absError >> 4) > zcStats.maxJitterMicros) zcStats.maxJitterMicros = absError >> 4;
+
+    lastEdge = now;
+    zcStats.edges++;
+    return true;
+}
+
+uint32_t IRAM_ATTR zeroCrossHalfPeriod() {
+    return periodQ4 >> 4;
+}
+
+void getZeroCrossStats(ZeroCrossStats &stats) {
+    stats = zcStats;
+    stats.locked = lockCount >= ZC_LOCK_EDGES;
+    stats.halfPeriodMicros = periodQ4 >> 4;
+    // Two zero-crosses per mains cycle: f = 1e6 / (2 * half period), in 0.01 Hz
+    stats.frequencyCentiHz = (uint32_t)(50000000ULL * 16 / periodQ4);
+    stats.jitterMicros = jitterQ4 >> 4;
+}
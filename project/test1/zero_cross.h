@@ -0,0 +1,38 @@
+#ifndef ZERO_CROSS_H
+#define ZERO_CROSS_H
+
+#include <Arduino.h>
+
+// Half-cycle lengths the tracker will lock to (45-65 Hz mains)
+const unsigned long ZC_MIN_HALF_PERIOD = 7600;
+const unsigned long ZC_MAX_HALF_PERIOD = 11200;
+
+// Assumed until the first period has been measured (50 Hz)
+const unsigned long ZC_NOMINAL_HALF_PERIOD = 10000;
+
+// Consecutive in-window edges needed before the tracker reports lock
+const int ZC_LOCK_EDGES = 8;
+
+struct ZeroCrossStats {
+    bool locked;
+    uint32_t halfPeriodMicros;  // Filtered half-cycle length
+    uint32_t frequencyCentiHz;  // Mains frequency in 0.01 Hz (5000 = 50.00 Hz)
+    uint32_t jitterMicros;      // Average distance of an edge from where it was predicted
+    uint32_t maxJitterMicros;   // Largest distance seen while locked
+    uint32_t edges;             // Accepted edges
+    uint32_t glitches;          // Edges rejected as noise
+    uint32_t missed;            // Edges that never arrived (gap of several half-cycles)
+    uint32_t relocks;           // Times the lock was lost and re-acquired
+};
+
+// Feed one zero-cross edge (micros() at the interrupt), from the zero-cross ISR
+// Returns true if the edge is a real zero-cross, false for noise to ignore
+bool zeroCrossUpdate(unsigned long now);
+
+// Current half-cycle length estimate in microseconds, safe to call from an ISR
+uint32_t zeroCrossHalfPeriod();
+
+// Copy of the tracker state
+void getZeroCrossStats(ZeroCrossStats &stats);
+
+#endif